@@ -25,9 +25,15 @@
 #include <kateconfig.h>
 #include <kateview.h>
 #include <kateglobal.h>
+#include <katebuffer.h>
+#include <katehighlight.h>
+#include <swapfile/kateswapfile.h>
+#include <kateundomanager.h>
 
 #include <QtTestWidgets>
 #include <QTemporaryFile>
+#include <QTemporaryDir>
+#include <QDir>
 #include <QSignalSpy>
 
 ///TODO: is there a FindValgrind cmake command we could use to
@@ -278,6 +284,93 @@ void KateDocumentTest::testRemoveTextPerformance()
     }
 }
 
+void KateDocumentTest::testInsertTextPerformance()
+{
+    const int lines = 2000;
+    const int columns = 80;
+
+    KTextEditor::DocumentPrivate doc;
+
+    // one long line, we paste into the middle of it
+    const QString longLine = QString().fill('b', 100000);
+    QString paste;
+    const QString line = QString().fill('a', columns);
+    for (int l = 0; l < lines; ++l) {
+        paste.append(line);
+        paste.append('\n');
+    }
+    paste.append(line);
+
+    QBENCHMARK {
+        doc.setText(longLine);
+
+        // cursors at the insert position must end up in front of/behind the pasted text
+        QScopedPointer<MovingCursor> stayCursor(doc.newMovingCursor(Cursor(0, 100), MovingCursor::StayOnInsert));
+        QScopedPointer<MovingCursor> moveCursor(doc.newMovingCursor(Cursor(0, 100), MovingCursor::MoveOnInsert));
+
+#ifdef USE_VALGRIND
+        CALLGRIND_START_INSTRUMENTATION
+#endif
+
+        doc.insertText(Cursor(0, 100), paste);
+
+#ifdef USE_VALGRIND
+        CALLGRIND_STOP_INSTRUMENTATION
+#endif
+
+        QCOMPARE(doc.lines(), lines + 1);
+        QCOMPARE(stayCursor->toCursor(), Cursor(0, 100));
+        QCOMPARE(moveCursor->toCursor(), Cursor(lines, columns));
+    }
+
+    QCOMPARE(doc.text(), longLine.left(100) + paste + longLine.mid(100));
+}
+
+void KateDocumentTest::testApplyEditsPerformance()
+{
+    const int lines = 10000;
+
+    KTextEditor::DocumentPrivate doc;
+    QStringList text;
+    for (int l = 0; l < lines; ++l) {
+        text << QStringLiteral("int   value%1 =   %1;").arg(l);
+    }
+
+    // 50k edits of a formatter: collapse double spaces, given front to back like a formatter does
+    QVector<QPair<Range, QString> > edits;
+    for (int l = 0; l < lines; ++l) {
+        const QString &line = text.at(l);
+        edits.append(qMakePair(Range(l, 3, l, 5), QString()));
+        const int assign = line.indexOf(QLatin1Char('='));
+        edits.append(qMakePair(Range(l, assign + 1, l, assign + 3), QString()));
+        edits.append(qMakePair(Range(l, 0, l, 0), QStringLiteral("const ")));
+        edits.append(qMakePair(Range(l, line.size() - 1, l, line.size()), QStringLiteral(";")));
+        edits.append(qMakePair(Range(l, line.size(), l, line.size()), QStringLiteral(" // %1").arg(l)));
+    }
+
+    QBENCHMARK_ONCE {
+        doc.setText(text);
+        QSignalSpy insertedSpy(&doc, &KTextEditor::DocumentPrivate::textInserted);
+        QSignalSpy removedSpy(&doc, &KTextEditor::DocumentPrivate::textRemoved);
+
+        QVERIFY(doc.applyEdits(edits));
+
+        // one coalesced change
+        QCOMPARE(insertedSpy.count(), 1);
+        QCOMPARE(removedSpy.count(), 1);
+        QCOMPARE(removedSpy.at(0).at(1).value<Range>(), Range(0, 0, lines - 1, text.last().size()));
+        QCOMPARE(insertedSpy.at(0).at(1).value<Range>(), Range(0, 0, lines - 1, doc.lineLength(lines - 1)));
+    }
+
+    QCOMPARE(doc.lines(), lines);
+    QCOMPARE(doc.line(0), QStringLiteral("const int value0 = 0; // 0"));
+    QCOMPARE(doc.line(lines - 1), QStringLiteral("const int value%1 = %1; // %1").arg(lines - 1));
+
+    // undone in one step
+    doc.undo();
+    QCOMPARE(doc.textLines(doc.documentRange()), text);
+}
+
 void KateDocumentTest::testForgivingApiUsage()
 {
     KTextEditor::DocumentPrivate doc;
@@ -446,6 +539,264 @@ void KateDocumentTest::testDigest()
     QCOMPARE(docDigest, fileDigest);
 }
 
+void KateDocumentTest::testBackgroundSave()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.path() + QStringLiteral("/background.txt");
+
+    KTextEditor::DocumentPrivate doc;
+    QStringList text;
+    for (int i = 0; i < 50000; ++i) {
+        text << QStringLiteral("int a%1 = %1;").arg(i);
+    }
+    doc.setText(text);
+    const QString savedText = doc.text();
+
+    // large documents are saved in the background and stay editable
+    KateGlobalConfig::global()->setBackgroundSaveThreshold(1000);
+    QSignalSpy savedSpy(&doc, &KTextEditor::DocumentPrivate::documentSavedOrUploaded);
+    QVERIFY(doc.saveAs(QUrl::fromLocalFile(path)));
+    QVERIFY(doc.buffer().isSavingAsync());
+    QVERIFY(!doc.isModified());
+    QVERIFY(doc.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("// edited during save\n")));
+    QVERIFY(doc.isModified());
+
+    // the file holds the text at the time of the save, the edit keeps the document modified
+    QVERIFY(savedSpy.wait());
+    QCOMPARE(savedSpy.count(), 1);
+    QVERIFY(!doc.buffer().isSavingAsync());
+    QVERIFY(doc.isModified());
+    QVERIFY(!doc.checksum().isEmpty());
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(QString::fromUtf8(file.readAll()), savedText + QLatin1Char('\n'));
+
+    KateGlobalConfig::global()->setBackgroundSaveThreshold(100000);
+}
+
+void KateDocumentTest::testHugeFileMode()
+{
+    KTextEditor::DocumentPrivate doc;
+    QStringList text;
+    for (int i = 0; i < 100000; ++i) {
+        text << QStringLiteral("int a%1 = %1; // comment").arg(i);
+    }
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    QVERIFY(doc.isReadWrite());
+    QVERIFY(!doc.isHugeFileMode());
+    QVERIFY(doc.undoManager());
+    QVERIFY(doc.undoCount() > 0);
+    const bool swapFileEnabled = doc.swapFile() != nullptr;
+    QCOMPARE(doc.hugeFileModeSavedMemory(), qint64(0));
+
+    // the undo history holds the inserted text, at least 20 characters per line
+    const qint64 undoMemory = doc.undoManager()->memoryUsage();
+    const qint64 swapFileMemory = swapFileEnabled ? doc.swapFile()->memoryUsage() : 0;
+    QVERIFY(undoMemory > qint64(text.size()) * 20 * qint64(sizeof(QChar)));
+
+    // explicitly enter the viewer mode
+    QSignalSpy modeSpy(&doc, &KTextEditor::DocumentPrivate::hugeFileModeChanged);
+    doc.setHugeFileMode(true);
+    QCOMPARE(modeSpy.count(), 1);
+    QVERIFY(doc.isHugeFileMode());
+    QVERIFY(!doc.isReadWrite());
+    QVERIFY(!doc.isOnTheFlySpellCheckingEnabled());
+
+    // no undo manager and no swap file for a read-only document
+    QVERIFY(!doc.undoManager());
+    QVERIFY(!doc.swapFile());
+    QCOMPARE(doc.undoCount(), 0u);
+    QCOMPARE(doc.hugeFileModeSavedMemory(), undoMemory + swapFileMemory);
+
+    // only the viewed lines are highlighted
+    doc.buffer().ensureHighlighted(doc.lines() - 100);
+    QVERIFY(doc.buffer().highlightedLines() < 1000);
+    QVERIFY(doc.buffer().plainLineData(doc.lines() - 100)->attributesList().size() > 0);
+
+    // enabling editing leaves the viewer mode, highlighting continues from the start
+    doc.setReadWrite(true);
+    QCOMPARE(modeSpy.count(), 2);
+    QVERIFY(!doc.isHugeFileMode());
+    QCOMPARE(doc.hugeFileModeSavedMemory(), qint64(0));
+    QVERIFY(doc.undoManager());
+    QCOMPARE(doc.swapFile() != nullptr, swapFileEnabled);
+    QVERIFY(doc.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("// ")));
+    QCOMPARE(doc.undoCount(), 1u);
+    doc.buffer().ensureHighlighted(doc.lines() - 100);
+    QVERIFY(doc.buffer().highlightedLines() >= doc.lines() - 100);
+}
+
+void KateDocumentTest::testBackgroundHighlighting()
+{
+    KTextEditor::DocumentPrivate doc;
+    QStringList text;
+    for (int i = 0; i < 20000; ++i) {
+        text << QStringLiteral("int a%1 = %1; // comment").arg(i);
+    }
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+
+    // lines near the highlighted ones are done at once
+    doc.buffer().ensureHighlightedForDisplay(100);
+    QVERIFY(doc.buffer().highlightedLines() > 100);
+
+    // far away lines are not highlighted at once, but tagged when the background is done
+    QSignalSpy tagSpy(&doc.buffer(), &KateBuffer::tagLines);
+    const int line = doc.lines() - 100;
+    doc.buffer().ensureHighlightedForDisplay(line);
+    QVERIFY(doc.buffer().highlightedLines() < line);
+    QTRY_VERIFY_WITH_TIMEOUT(doc.buffer().highlightedLines() > line, 30000);
+    QVERIFY(tagSpy.count() > 0);
+    QVERIFY(doc.buffer().plainLineData(line)->attributesList().size() > 0);
+}
+
+void KateDocumentTest::testHighlightingCache()
+{
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+    KateGlobalConfig::global()->setHighlightingCacheDirectory(cacheDir.path());
+
+    QTemporaryFile file(QDir::tempPath() + QStringLiteral("/katehlcacheXXXXXX.cpp"));
+    QVERIFY(file.open());
+    for (int i = 0; i < 12000; ++i) {
+        file.write(QStringLiteral("int a%1 = %1; // comment\n").arg(i).toUtf8());
+    }
+    file.close();
+
+    // unused cache file, evicted once a new one is stored
+    const QString staleFileName = QDir(cacheDir.path()).filePath(QStringLiteral("stale.hlcache"));
+    {
+        QFile stale(staleFileName);
+        QVERIFY(stale.open(QIODevice::WriteOnly));
+        stale.write("stale");
+        QVERIFY(stale.flush());
+        QVERIFY(stale.setFileTime(QDateTime::currentDateTime().addDays(-60), QFileDevice::FileModificationTime));
+    }
+
+    // first load: highlight everything, closing stores the cache
+    QVector<Kate::TextLineData::Attribute> attributes;
+    {
+        KTextEditor::DocumentPrivate doc;
+        QVERIFY(doc.openUrl(QUrl::fromLocalFile(file.fileName())));
+        QVERIFY(!doc.buffer().highlightingCacheLoaded());
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+        attributes = doc.buffer().plainLineData(doc.lines() - 1)->attributesList();
+        QVERIFY(!attributes.isEmpty());
+        QVERIFY(doc.closeUrl());
+    }
+    QCOMPARE(QDir(cacheDir.path()).entryList(QDir::Files).size(), 1);
+    QVERIFY(!QFile::exists(staleFileName));
+
+    // second load: attributes without highlighting
+    {
+        KTextEditor::DocumentPrivate doc;
+        QVERIFY(doc.openUrl(QUrl::fromLocalFile(file.fileName())));
+        QVERIFY(doc.buffer().highlightingCacheLoaded());
+        QVERIFY(doc.buffer().highlightedLines() < doc.lines());
+
+        // cached lines count as highlighted, no highlighting from the start
+        const int highlighted = doc.buffer().highlightedLines();
+        doc.buffer().ensureHighlighted(doc.lines() - 1);
+        QCOMPARE(doc.buffer().highlightedLines(), highlighted);
+
+        const QVector<Kate::TextLineData::Attribute> cached = doc.buffer().plainLineData(doc.lines() - 1)->attributesList();
+        QCOMPARE(cached.size(), attributes.size());
+        for (int i = 0; i < cached.size(); ++i) {
+            QCOMPARE(cached.at(i).offset, attributes.at(i).offset);
+            QCOMPARE(cached.at(i).length, attributes.at(i).length);
+            QCOMPARE(cached.at(i).attributeValue, attributes.at(i).attributeValue);
+        }
+
+        // edits stop using the cache
+        doc.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("/*"));
+        QVERIFY(!doc.buffer().highlightingCacheLoaded());
+    }
+
+    KateGlobalConfig::global()->setHighlightingCacheDirectory(QString());
+}
+
+void KateDocumentTest::testEditHighlightingEarlyStop()
+{
+    KTextEditor::DocumentPrivate doc;
+    QStringList text;
+    for (int i = 0; i < 2000; ++i) {
+        text << QStringLiteral("int a%1 = %1;").arg(i);
+    }
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    doc.buffer().ensureHighlighted(doc.lines() - 1);
+    QCOMPARE(doc.buffer().highlightedLines(), doc.lines());
+
+    // lines with the same context share the interned state
+    QCOMPARE(doc.buffer().plainLineData(100)->highlightingStateId(), doc.buffer().plainLineData(1000)->highlightingStateId());
+
+    // the state doesn't change: only the edited lines are highlighted again, the rest stays valid
+    const KateHighlighting::EditStatistics before = doc.highlight()->editStatistics();
+    doc.insertText(KTextEditor::Cursor(10, 0), QStringLiteral("x"));
+    QVERIFY(doc.buffer().lastEditHighlightedLines() <= 3);
+    QCOMPARE(doc.buffer().highlightedLines(), doc.lines());
+    QCOMPARE(doc.highlight()->editStatistics().edits, before.edits + 1);
+    QCOMPARE(doc.highlight()->editStatistics().unconvergedEdits, before.unconvergedEdits);
+
+    // an open comment changes the state of all lines behind: bounded look ahead, the rest is done lazily
+    doc.insertText(KTextEditor::Cursor(10, 0), QStringLiteral("/*"));
+    QVERIFY(doc.buffer().lastEditHighlightedLines() > 3);
+    QVERIFY(doc.buffer().highlightedLines() < doc.lines());
+    QCOMPARE(doc.highlight()->editStatistics().unconvergedEdits, before.unconvergedEdits + 1);
+    QVERIFY(doc.buffer().plainLineData(100)->highlightingStateId() != doc.buffer().plainLineData(5)->highlightingStateId());
+
+    // closing it again converges after the closing line
+    doc.insertText(KTextEditor::Cursor(20, 0), QStringLiteral("*/"));
+    QVERIFY(doc.buffer().plainLineData(100)->highlightingStateId() == doc.buffer().plainLineData(5)->highlightingStateId());
+    QCOMPARE(doc.highlight()->editStatistics().unconvergedEdits, before.unconvergedEdits + 1);
+
+    // the states belong to the document and are dropped with its highlighting
+    QVERIFY(doc.buffer().highlightingStates().count() > 1);
+    doc.setHighlightingMode(QStringLiteral("None"));
+    QCOMPARE(doc.buffer().highlightingStates().count(), 1);
+}
+
+void KateDocumentTest::testLongLineHighlighting()
+{
+    // one huge line, like minified JSON
+    KTextEditor::DocumentPrivate doc;
+    QString text;
+    for (int i = 0; i < 200000; ++i) {
+        text += QStringLiteral("{\"key\": 12345}, ");
+    }
+    doc.setText(QStringList() << text << QStringLiteral("{\"last\": 1}"));
+    doc.setHighlightingMode(QStringLiteral("JSON"));
+
+    // the first highlighting stops at the budget, the rest of the line has the default style
+    const qint64 linesOverBudget = doc.highlight()->linesOverBudget();
+    doc.buffer().ensureHighlighted(1);
+    Kate::TextLineData *line = doc.buffer().plainLineData(0);
+    QVERIFY(line->isHighlightingIncomplete());
+    QCOMPARE(doc.highlight()->linesOverBudget(), linesOverBudget + 1);
+    QVERIFY(line->attribute(8) != 0);
+    QCOMPARE(line->attribute(line->length() - 8), short(0));
+
+    // continued in the background, in chunks
+    QSignalSpy tagSpy(&doc.buffer(), &KateBuffer::tagLines);
+    QTRY_VERIFY_WITH_TIMEOUT(!doc.buffer().plainLineData(0)->isHighlightingIncomplete(), 60000);
+    QVERIFY(tagSpy.count() > 0);
+    line = doc.buffer().plainLineData(0);
+    QCOMPARE(line->attribute(line->length() - 8), line->attribute(8));
+
+    // a long line within the budget is highlighted in one go, the string continues behind the first chunk
+    doc.setText(QStringLiteral("x = \"") + QString(17 * 1024, QLatin1Char('a')) + QStringLiteral("\";"));
+    doc.setHighlightingMode(QStringLiteral("C++"));
+    const qint64 overBudget = doc.highlight()->linesOverBudget();
+    doc.buffer().ensureHighlighted(0);
+    line = doc.buffer().plainLineData(0);
+    QVERIFY(!line->isHighlightingIncomplete());
+    QCOMPARE(doc.highlight()->linesOverBudget(), overBudget);
+    QVERIFY(line->attribute(10) != 0);
+    QCOMPARE(line->attribute(16 * 1024 + 500), line->attribute(10));
+}
+
 void KateDocumentTest::testModelines()
 {
     // honor document variable indent-width
@@ -41,6 +41,8 @@ private Q_SLOTS:
 
     void testSetTextPerformance();
     void testRemoveTextPerformance();
+    void testInsertTextPerformance();
+    void testApplyEditsPerformance();
 
     void testForgivingApiUsage();
 
@@ -51,6 +53,12 @@ private Q_SLOTS:
     void testReplaceTabs();
 
     void testDigest();
+    void testBackgroundSave();
+    void testHugeFileMode();
+    void testBackgroundHighlighting();
+    void testHighlightingCache();
+    void testEditHighlightingEarlyStop();
+    void testLongLineHighlighting();
     void testModelines();
 
     void testDefStyleNum();
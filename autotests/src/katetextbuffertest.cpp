@@ -24,6 +24,11 @@
 #include "katetextbuffer.h"
 #include "katetextcursor.h"
 #include "katetextfolding.h"
+#include "katetextrange.h"
+
+#include <future>
+#include <memory>
+#include <vector>
 
 QTEST_MAIN(KateTextBufferTest)
 
@@ -500,3 +505,752 @@ void KateTextBufferTest::saveFileWithElevatedPrivileges()
     QVERIFY(f.remove());
     QVERIFY(dir.remove());
 }
+
+void KateTextBufferTest::mixedEndOfLineTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString file_path = dir.path() + QLatin1String("/foo");
+
+    // long lines to run over the vectorized scanning, too
+    const QByteArray longLine(100, 'x');
+
+    QFile f(file_path);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    f.write("a\r\n" + longLine + "\r\nb\r\nc");
+    f.close();
+
+    Kate::TextBuffer buffer(nullptr, 1);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    bool a, b;
+    int c;
+    QVERIFY(buffer.load(file_path, a, b, c, true));
+    QCOMPARE(buffer.lines(), 4);
+    QCOMPARE(buffer.line(1)->string(), QString::fromLatin1(longLine));
+    QCOMPARE(buffer.endOfLineMode(), Kate::TextBuffer::eolDos);
+    QVERIFY(!buffer.mixedEndOfLines());
+
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    f.write("a\n" + longLine + "\r\nb\rc\r");
+    f.close();
+
+    QVERIFY(buffer.load(file_path, a, b, c, true));
+    QCOMPARE(buffer.lines(), 5);
+    QCOMPARE(buffer.line(0)->string(), QStringLiteral("a"));
+    QCOMPARE(buffer.line(1)->string(), QString::fromLatin1(longLine));
+    QCOMPARE(buffer.line(2)->string(), QStringLiteral("b"));
+    QCOMPARE(buffer.line(3)->string(), QStringLiteral("c"));
+    QCOMPARE(buffer.line(4)->string(), QString());
+    QVERIFY(buffer.mixedEndOfLines());
+}
+
+void KateTextBufferTest::loadBenchmark()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString file_path = dir.path() + QLatin1String("/foo");
+
+    // generate some MB of lines with different lengths, large enough to measure, small enough for the CI
+    QFile f(file_path);
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    for (int i = 0; i < 200000; ++i) {
+        f.write(QByteArray(i % 160, 'a' + (i % 26)) + '\n');
+    }
+    f.close();
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    bool a, b;
+    int c;
+    QBENCHMARK {
+        QVERIFY(buffer.load(file_path, a, b, c, true));
+    }
+    QCOMPARE(buffer.lines(), 200001);
+}
+
+void KateTextBufferTest::blockIndexTest()
+{
+    // small blocks, many splits and merges
+    Kate::TextBuffer buffer(nullptr, 2);
+
+    // reference, one string per line
+    QStringList lines(QString());
+
+    // wrap and unwrap at pseudo random lines, check that every line is still found
+    uint seed = 42;
+    for (int round = 0; round < 500; ++round) {
+        seed = seed * 1103515245 + 12345;
+        const int line = (seed >> 8) % lines.size();
+
+        buffer.startEditing();
+        if (round < 300 || lines.size() == 1 || (seed & 1)) {
+            buffer.insertText(KTextEditor::Cursor(line, 0), QString::number(round));
+            lines[line].prepend(QString::number(round));
+            buffer.wrapLine(KTextEditor::Cursor(line, lines[line].size()));
+            lines.insert(line + 1, QString());
+        } else {
+            const int unwrap = qMax(1, line);
+            buffer.unwrapLine(unwrap);
+            lines[unwrap - 1].append(lines.takeAt(unwrap));
+        }
+        buffer.finishEditing();
+
+        QCOMPARE(buffer.lines(), lines.size());
+    }
+
+    for (int i = 0; i < lines.size(); ++i) {
+        QCOMPARE(buffer.line(i)->text(), lines.at(i));
+    }
+    QCOMPARE(buffer.text(), lines.join(QLatin1Char('\n')));
+}
+
+void KateTextBufferTest::asyncSaveTest()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString file_path = dir.path() + QLatin1String("/foo");
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+
+    // some lines to save
+    QString text;
+    buffer.startEditing();
+    for (int i = 0; i < 1000; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("line %1").arg(i));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.line(i)->length()));
+        text += QStringLiteral("line %1\n").arg(i);
+    }
+    buffer.finishEditing();
+    const qint64 savedRevision = buffer.revision();
+
+    QSignalSpy finishedSpy(&buffer, &Kate::TextBuffer::asyncSaveFinished);
+    QSignalSpy progressSpy(&buffer, &Kate::TextBuffer::saveProgress);
+    QVERIFY(buffer.saveAsync(file_path));
+    QVERIFY(buffer.isSavingAsync());
+
+    // edit while saving, must not end up in the file
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("modified "));
+    buffer.finishEditing();
+
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(finishedSpy.at(0).at(1).toBool(), true);
+    QVERIFY(!buffer.isSavingAsync());
+    QVERIFY(progressSpy.count() > 0);
+    QCOMPARE(progressSpy.last().at(0).toInt(), 1001);
+
+    // snapshot revision is saved, later edit keeps the buffer modified
+    QCOMPARE(buffer.history().lastSavedRevision(), savedRevision);
+    QVERIFY(buffer.revision() > savedRevision);
+
+    QFile f(file_path);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QCOMPARE(QString::fromUtf8(f.readAll()), text);
+}
+
+void KateTextBufferTest::digestTest()
+{
+    // known values, git hash-object and the xxHash64 reference implementation
+    Kate::TextDigest gitDigest(Kate::TextDigest::GitSha1);
+    gitDigest.reset(6);
+    gitDigest.addData("hello\n", 6);
+    QCOMPARE(gitDigest.result().toHex(), QByteArray("ce013625030ba8dba906f756967f9e9ca394464a"));
+
+    Kate::TextDigest fastDigest(Kate::TextDigest::XXHash64);
+    fastDigest.reset(0);
+    QCOMPARE(fastDigest.result().toHex(), QByteArray("ef46db3751d8e999"));
+    fastDigest.addData("abc", 3);
+    QCOMPARE(fastDigest.result().toHex(), QByteArray("44bc2cf5ad770999"));
+
+    // incremental data must not change the result
+    const QByteArray data = QByteArray("some text spanning more than one stripe of 32 bytes ").repeated(10);
+    fastDigest.reset(data.size());
+    fastDigest.addData(data.constData(), data.size());
+    const QByteArray wholeDigest = fastDigest.result();
+    fastDigest.reset(data.size());
+    for (int i = 0; i < data.size(); i += 7) {
+        fastDigest.addData(data.constData() + i, qMin(7, data.size() - i));
+    }
+    QCOMPARE(fastDigest.result(), wholeDigest);
+
+    // save computes both digests while writing, load while reading
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString file_path = dir.path() + QLatin1String("/foo");
+
+    Kate::TextBuffer buffer(nullptr);
+    buffer.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.setFallbackTextCodec(QTextCodec::codecForName("UTF-8"));
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QString::fromLatin1(data));
+    buffer.finishEditing();
+
+    QVERIFY(buffer.save(file_path));
+    const QByteArray gitDigest = Kate::TextDigest::digestForFile(file_path, Kate::TextDigest::GitSha1);
+    const QByteArray contentHash = Kate::TextDigest::digestForFile(file_path, Kate::TextDigest::XXHash64);
+    QCOMPARE(buffer.digest(), gitDigest);
+    QCOMPARE(buffer.contentHash(), contentHash);
+
+    QByteArray fileDigest, fileContentHash;
+    QVERIFY(Kate::TextDigest::digestsForFile(file_path, fileDigest, fileContentHash));
+    QCOMPARE(fileDigest, gitDigest);
+    QCOMPARE(fileContentHash, contentHash);
+
+    bool encodingErrors = false;
+    bool tooLongLines = false;
+    int longestLineLoaded;
+    QVERIFY(buffer.load(file_path, encodingErrors, tooLongLines, longestLineLoaded, false));
+    QCOMPARE(buffer.digest(), gitDigest);
+    QCOMPARE(buffer.contentHash(), contentHash);
+
+    // the background save computes them, too
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("more "));
+    buffer.finishEditing();
+    QVERIFY(buffer.saveAsync(file_path));
+    buffer.waitForAsyncSave();
+    QCOMPARE(buffer.digest(), Kate::TextDigest::digestForFile(file_path, Kate::TextDigest::GitSha1));
+    QCOMPARE(buffer.contentHash(), Kate::TextDigest::digestForFile(file_path, Kate::TextDigest::XXHash64));
+}
+
+void KateTextBufferTest::applyEditsTest()
+{
+    Kate::TextBuffer buffer(nullptr, 1);
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("aaa"));
+    buffer.wrapLine(KTextEditor::Cursor(0, 3));
+    buffer.insertText(KTextEditor::Cursor(1, 0), QStringLiteral("bbb"));
+    buffer.wrapLine(KTextEditor::Cursor(1, 3));
+    buffer.insertText(KTextEditor::Cursor(2, 0), QStringLiteral("ccc"));
+    buffer.finishEditing();
+
+    // all ranges refer to the original text, in arbitrary order
+    QSignalSpy startedSpy(&buffer, &Kate::TextBuffer::editingStarted);
+    QVector<Kate::TextBuffer::Edit> edits;
+    edits.append({KTextEditor::Range(2, 3, 2, 3), QStringLiteral("!\nnew")});
+    edits.append({KTextEditor::Range(0, 1, 0, 2), QStringLiteral("X")});
+    edits.append({KTextEditor::Range(1, 0, 2, 0), QString()});
+    edits.append({KTextEditor::Range(0, 0, 0, 0), QStringLiteral("1")});
+    edits.append({KTextEditor::Range(0, 0, 0, 0), QStringLiteral("2")});
+    QVERIFY(buffer.applyEdits(edits));
+    QCOMPARE(buffer.text(), QStringLiteral("12aXa\nccc!\nnew"));
+    QCOMPARE(startedSpy.count(), 1);
+
+    // overlapping or invalid edits change nothing
+    const qint64 revision = buffer.revision();
+    edits.clear();
+    edits.append({KTextEditor::Range(0, 0, 1, 1), QStringLiteral("x")});
+    edits.append({KTextEditor::Range(1, 0, 1, 2), QStringLiteral("y")});
+    QVERIFY(!buffer.applyEdits(edits));
+    edits.clear();
+    edits.append({KTextEditor::Range(5, 0, 5, 1), QStringLiteral("x")});
+    QVERIFY(!buffer.applyEdits(edits));
+    QCOMPARE(buffer.revision(), revision);
+    QCOMPARE(buffer.text(), QStringLiteral("12aXa\nccc!\nnew"));
+}
+
+void KateTextBufferTest::applyEditsBenchmark()
+{
+    const int lines = 10000;
+
+    // two equal buffers with cursors all over the place, one gets the edits one by one
+    Kate::TextBuffer buffer(nullptr, 64);
+    Kate::TextBuffer reference(nullptr, 64);
+    QStringList text;
+    for (Kate::TextBuffer *b : {&buffer, &reference}) {
+        b->startEditing();
+        for (int l = 0; l < lines; ++l) {
+            const QString line = QStringLiteral("int   value%1 =   %1;").arg(l);
+            if (b == &buffer) {
+                text << line;
+            }
+            if (l > 0) {
+                b->wrapLine(KTextEditor::Cursor(l - 1, b->lineData(l - 1)->length()));
+            }
+            b->insertText(KTextEditor::Cursor(l, 0), line);
+        }
+        b->finishEditing();
+    }
+
+    std::vector<std::unique_ptr<Kate::TextCursor>> cursors;
+    std::vector<std::unique_ptr<Kate::TextCursor>> referenceCursors;
+    for (int l = 0; l < lines; l += 7) {
+        for (int column : {0, 3, 4, 5, 12, text.at(l).size() - 1, text.at(l).size(), text.at(l).size() + 2}) {
+            for (auto behavior : {Kate::TextCursor::MoveOnInsert, Kate::TextCursor::StayOnInsert}) {
+                cursors.emplace_back(new Kate::TextCursor(buffer, KTextEditor::Cursor(l, column), behavior));
+                referenceCursors.emplace_back(new Kate::TextCursor(reference, KTextEditor::Cursor(l, column), behavior));
+            }
+        }
+    }
+
+    // 50k edits of a formatter: collapse double spaces, insert and replace around existing text
+    QVector<Kate::TextBuffer::Edit> edits;
+    for (int l = 0; l < lines; ++l) {
+        const QString &line = text.at(l);
+        const int assign = line.indexOf(QLatin1Char('='));
+        edits.append({KTextEditor::Range(l, 3, l, 5), QString()});
+        edits.append({KTextEditor::Range(l, assign + 1, l, assign + 3), QString()});
+        edits.append({KTextEditor::Range(l, 0, l, 0), QStringLiteral("const ")});
+        edits.append({KTextEditor::Range(l, line.size() - 1, l, line.size()), QStringLiteral(";")});
+        edits.append({KTextEditor::Range(l, line.size(), l, line.size()), QStringLiteral(" // %1").arg(l)});
+    }
+
+    QVector<Kate::TextBuffer::Edit> sortedEdits = edits;
+    QVERIFY(reference.prepareEdits(sortedEdits));
+    reference.startEditing();
+    for (const Kate::TextBuffer::Edit &edit : qAsConst(sortedEdits)) {
+        reference.removeText(edit.range);
+        reference.insertText(edit.range.start(), edit.text);
+    }
+    reference.finishEditing();
+
+    const qint64 startRevision = buffer.revision();
+    QBENCHMARK_ONCE {
+        QVERIFY(buffer.applyEdits(edits));
+    }
+
+    // each recorded edit has its own revision, the current one included
+    QVector<qint64> revisions;
+    for (qint64 revision = startRevision + 1; revision <= startRevision + 100; ++revision) {
+        revisions << revision;
+    }
+    revisions << buffer.revision();
+    for (qint64 revision : qAsConst(revisions)) {
+        int line = 0, column = 0;
+        buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::MoveOnInsert, revision, startRevision);
+        QVERIFY(line != -1 && column != -1);
+    }
+    int line = 0, column = 0;
+    buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::StayOnInsert, startRevision, buffer.revision());
+    QCOMPARE(KTextEditor::Cursor(line, column), KTextEditor::Cursor(0, 0));
+    buffer.history().lockRevision(buffer.revision());
+    line = 5;
+    column = 0;
+    buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::StayOnInsert, buffer.revision(), startRevision);
+    QCOMPARE(KTextEditor::Cursor(line, column), KTextEditor::Cursor(5, 0));
+    buffer.history().unlockRevision(buffer.revision());
+
+    QCOMPARE(buffer.lines(), lines);
+    QCOMPARE(buffer.line(0)->string(), QStringLiteral("const int value0 = 0; // 0"));
+    QCOMPARE(buffer.text(), reference.text());
+    QCOMPARE(buffer.revision(), reference.revision());
+    QCOMPARE(buffer.history().revision(), reference.history().revision());
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        QCOMPARE(cursors.at(i)->toCursor(), referenceCursors.at(i)->toCursor());
+    }
+}
+
+void KateTextBufferTest::attributeIteratorTest()
+{
+    // runs with gaps in between, like the highlighting creates them, enough for several checkpoints
+    Kate::TextLineData line(QString(1000, QLatin1Char('x')));
+    QVector<Kate::TextLineData::Attribute> runs;
+    for (int i = 0; i < 100; ++i) {
+        runs.append(Kate::TextLineData::Attribute(i * 10, (i % 3) + 5, short(i + 1)));
+    }
+    line.setAttributesList(runs);
+    QCOMPARE(line.lastAttribute(), short(100));
+
+    // the checkpoint search must see the runs as they were set
+    for (int pos = 0; pos < 1010; ++pos) {
+        const int run = pos / 10;
+        const short expected = (run < runs.size() && pos < runs.at(run).offset + runs.at(run).length) ? runs.at(run).attributeValue : 0;
+        QCOMPARE(line.attribute(pos), expected);
+    }
+
+    // sequential lookup must match it, forward, backward and jumping around
+    Kate::TextLineData::AttributeIterator attributes(line);
+    for (int pos = 0; pos < 1010; ++pos) {
+        QCOMPARE(attributes.attribute(pos), line.attribute(pos));
+    }
+    for (int pos = 1009; pos >= 0; --pos) {
+        QCOMPARE(attributes.attribute(pos), line.attribute(pos));
+    }
+    for (int pos : {750, 3, 999, 42, 0, 557}) {
+        QCOMPARE(attributes.attribute(pos), line.attribute(pos));
+    }
+
+    // foldings behind the checkpoints and runs survive setting the runs again
+    line.addFolding(5, 1);
+    line.setAttributesList(runs.mid(0, 40));
+    QCOMPARE(line.lastAttribute(), short(40));
+    QCOMPARE(line.attribute(391), short(40));
+    QCOMPARE(line.foldings().size(), 1);
+    QCOMPARE(line.foldings().at(0).offset, 5);
+}
+
+void KateTextBufferTest::packedAttributesTest()
+{
+    // adjacent runs with the same value are merged, large offsets, lengths and values survive packing
+    Kate::TextLineData line(QString(100000, QLatin1Char('x')));
+    QVector<Kate::TextLineData::Attribute> attributes;
+    attributes << Kate::TextLineData::Attribute(0, 3, 1) << Kate::TextLineData::Attribute(3, 4, 1)
+               << Kate::TextLineData::Attribute(10, 200, 300) << Kate::TextLineData::Attribute(210, 0, 5)
+               << Kate::TextLineData::Attribute(20000, 70000, -2);
+    QVERIFY(!line.hasAttributes());
+    line.setAttributesList(attributes);
+    QVERIFY(line.hasAttributes());
+
+    const QVector<Kate::TextLineData::Attribute> packed = line.attributesList();
+    QCOMPARE(packed.size(), 3);
+    QCOMPARE(packed.at(0).offset, 0);
+    QCOMPARE(packed.at(0).length, 7);
+    QCOMPARE(packed.at(1).offset, 10);
+    QCOMPARE(packed.at(1).length, 200);
+    QCOMPARE(packed.at(1).attributeValue, short(300));
+    QCOMPARE(packed.at(2).offset, 20000);
+    QCOMPARE(packed.at(2).length, 70000);
+    QCOMPARE(packed.at(2).attributeValue, short(-2));
+
+    // lookups see the same runs
+    QCOMPARE(line.attribute(6), short(1));
+    QCOMPARE(line.attribute(7), short(0));
+    QCOMPARE(line.attribute(209), short(300));
+    QCOMPARE(line.attribute(210), short(0));
+    QCOMPARE(line.attribute(89999), short(-2));
+    QCOMPARE(line.attribute(90000), short(0));
+
+    int runs = 0;
+    line.forEachAttribute([&runs, &packed](const Kate::TextLineData::Attribute &attribute) {
+        QCOMPARE(attribute.offset, packed.at(runs).offset);
+        ++runs;
+    });
+    QCOMPARE(runs, 3);
+
+    line.clearAttributesAndFoldings();
+    QVERIFY(!line.hasAttributes());
+    QCOMPARE(line.attribute(0), short(0));
+}
+
+void KateTextBufferTest::packedFoldingsTest()
+{
+    Kate::TextLineData line(QStringLiteral("\t  caf") + QChar(0xe9) + QStringLiteral(" au lait;  "));
+
+    // attributes and foldings share one allocation, setting attributes keeps the foldings
+    line.addFolding(2, 1);
+    line.addFolding(12, -1);
+    line.setAttributesList(QVector<Kate::TextLineData::Attribute>() << Kate::TextLineData::Attribute(0, 5, 3));
+    QCOMPARE(line.attribute(4), short(3));
+    const QVector<Kate::TextLineData::Folding> foldings = line.foldings();
+    QCOMPARE(foldings.size(), 2);
+    QCOMPARE(foldings.at(0).offset, 2);
+    QCOMPARE(foldings.at(0).foldingValue, 1);
+    QCOMPARE(foldings.at(1).offset, 12);
+    QCOMPARE(foldings.at(1).foldingValue, -1);
+}
+
+void KateTextBufferTest::snapshotTest()
+{
+    // small blocks to get more than one block
+    Kate::TextBuffer buffer(nullptr, 4);
+    buffer.startEditing();
+    for (int i = 0; i < 19; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("line %1").arg(i));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.lineData(i)->length()));
+    }
+    buffer.finishEditing();
+
+    const QString oldText = buffer.text();
+    const Kate::TextSnapshot first = buffer.snapshot();
+    QCOMPARE(first.revision(), buffer.revision());
+    QCOMPARE(first.lines(), buffer.lines());
+    QCOMPARE(first.text(), oldText);
+    QCOMPARE(first.line(7), QStringLiteral("line 7"));
+    QCOMPARE(first.lineLength(7), 6);
+    QCOMPARE(first.line(-1), QString());
+    QCOMPARE(first.lineLength(first.lines()), -1);
+
+    // edit, old snapshot must stay untouched
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("changed "));
+    buffer.wrapLine(KTextEditor::Cursor(2, 0));
+    buffer.finishEditing();
+
+    const Kate::TextSnapshot second = buffer.snapshot();
+    QCOMPARE(first.text(), oldText);
+    QCOMPARE(first.line(0), QStringLiteral("line 0"));
+    QCOMPARE(second.text(), buffer.text());
+    QCOMPARE(second.line(0), QStringLiteral("changed line 0"));
+    QCOMPARE(second.lines(), first.lines() + 1);
+    QVERIFY(second.revision() > first.revision());
+    QCOMPARE(second.line(second.lines() - 2), first.line(first.lines() - 2));
+
+    // read from another thread while the buffer is modified
+    std::future<QString> reader = std::async(std::launch::async, [second]() {
+        return second.text();
+    });
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(0, 0, 0, 8));
+    buffer.finishEditing();
+    QCOMPARE(reader.get(), second.text());
+    QCOMPARE(buffer.snapshot().line(0), QStringLiteral("line 0"));
+}
+
+void KateTextBufferTest::blockCompressionTest()
+{
+    // small blocks with repetitive content and some attributes
+    Kate::TextBuffer buffer(nullptr, 8);
+    buffer.startEditing();
+    for (int i = 0; i < 99; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("int value%1 = compute(value%1, %1);").arg(i));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.lineData(i)->length()));
+    }
+    buffer.finishEditing();
+    buffer.line(5)->setAttributesList(QVector<Kate::TextLineData::Attribute>() << Kate::TextLineData::Attribute(0, 3, 7));
+    buffer.line(5)->addFolding(4, 1);
+    buffer.line(5)->setAutoWrapped(true);
+    const QString text = buffer.text();
+
+    // first round only forgets the accesses, the next one compresses all blocks, a few per call
+    QSignalSpy compressedSpy(&buffer, &Kate::TextBuffer::linesCompressed);
+    QCOMPARE(buffer.compressIdleBlocks(), 0);
+    QCOMPARE(buffer.compressIdleBlocks(), 8);
+    QVERIFY(buffer.compressIdleBlocks() > 0);
+    Kate::TextBuffer::CompressionStatistics statistics = buffer.compressionStatistics();
+    QVERIFY(statistics.blocks > 8);
+    QCOMPARE(statistics.compressedBlocks, statistics.blocks);
+    QCOMPARE(compressedSpy.count(), statistics.blocks);
+    QCOMPARE(compressedSpy.first().at(0).toInt(), 0);
+    QCOMPARE(compressedSpy.last().at(1).toInt(), 99);
+    QVERIFY(statistics.compressedBytes < statistics.uncompressedBytes);
+    QCOMPARE(buffer.lines(), 100);
+
+    // access restores only the touched block
+    const Kate::TextLine line = buffer.line(5);
+    QCOMPARE(line->string(), QStringLiteral("int value5 = compute(value5, 5);"));
+    QCOMPARE(line->attribute(1), short(7));
+    QCOMPARE(line->foldings().size(), 1);
+    QVERIFY(line->isAutoWrapped());
+    QCOMPARE(buffer.compressionStatistics().compressedBlocks, statistics.blocks - 1);
+
+    // everything else is restored on access, too
+    QCOMPARE(buffer.text(), text);
+    QCOMPARE(buffer.compressionStatistics().compressedBlocks, 0);
+
+    // never compress during editing
+    buffer.compressIdleBlocks();
+    buffer.startEditing();
+    QCOMPARE(buffer.compressIdleBlocks(), 0);
+    buffer.insertText(KTextEditor::Cursor(50, 0), QStringLiteral("x"));
+    buffer.finishEditing();
+    QVERIFY(buffer.compressIdleBlocks() > 0);
+    QCOMPARE(buffer.line(50)->string(), QStringLiteral("xint value50 = compute(value50, 50);"));
+}
+
+void KateTextBufferTest::maximumLineLengthTest()
+{
+    Kate::TextBuffer buffer(nullptr, 4);
+    QCOMPARE(buffer.maximumLineLength(), 0);
+
+    buffer.startEditing();
+    for (int i = 0; i < 20; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QString(i % 7, QLatin1Char('x')));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.lineData(i)->length()));
+    }
+    buffer.insertText(KTextEditor::Cursor(3, 0), QStringLiteral("\t\t"));
+    buffer.finishEditing();
+    QCOMPARE(buffer.maximumLineLength(), 6);
+    QCOMPARE(buffer.maximumVirtualLineLength(4), 11);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 19);
+
+    // longer line in a later block, then shorten it again
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(17, 0), QString(30, QLatin1Char('y')));
+    buffer.finishEditing();
+    QCOMPARE(buffer.maximumLineLength(), 33);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 33);
+
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(17, 0, 17, 30));
+    buffer.unwrapLine(13);
+    buffer.finishEditing();
+    QCOMPARE(buffer.maximumLineLength(), 11);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 19);
+
+    // longest line in two blocks, shortening one of them keeps the maximum
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(1, 0), QString(20, QLatin1Char('z')));
+    buffer.insertText(KTextEditor::Cursor(18, 0), QString(16, QLatin1Char('z')));
+    buffer.finishEditing();
+    QCOMPARE(buffer.maximumLineLength(), 21);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 21);
+
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(1, 0, 1, 10));
+    buffer.finishEditing();
+    QCOMPARE(buffer.maximumLineLength(), 21);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 21);
+
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(18, 0, 18, 10));
+    buffer.finishEditing();
+    QCOMPARE(buffer.maximumLineLength(), 11);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 19);
+
+    // clear resets everything
+    buffer.clear();
+    QCOMPARE(buffer.maximumLineLength(), 0);
+    QCOMPARE(buffer.maximumVirtualLineLength(8), 0);
+}
+
+void KateTextBufferTest::movingRangesBenchmark()
+{
+    // 1000 lines with 100 words each
+    const int lines = 1000;
+    const int wordsPerLine = 100;
+    Kate::TextBuffer buffer(nullptr);
+    const QString text = QStringLiteral("word ").repeated(wordsPerLine);
+    buffer.startEditing();
+    for (int l = 0; l < lines; ++l) {
+        buffer.insertText(KTextEditor::Cursor(l, 0), text);
+        if (l + 1 < lines) {
+            buffer.wrapLine(KTextEditor::Cursor(l, text.size()));
+        }
+    }
+    buffer.finishEditing();
+
+    // one moving range per word, 100k ranges
+    std::vector<std::unique_ptr<Kate::TextRange> > ranges;
+    ranges.reserve(lines * wordsPerLine);
+    for (int l = 0; l < lines; ++l) {
+        for (int w = 0; w < wordsPerLine; ++w) {
+            ranges.emplace_back(new Kate::TextRange(buffer, KTextEditor::Range(l, w * 5, l, w * 5 + 4), KTextEditor::MovingRange::DoNotExpand));
+        }
+    }
+
+    // keystroke cost: type and remove a char in the middle of the document
+    QBENCHMARK {
+        buffer.startEditing();
+        buffer.insertText(KTextEditor::Cursor(500, 0), QStringLiteral("x"));
+        buffer.removeText(KTextEditor::Range(500, 0, 500, 1));
+        buffer.finishEditing();
+    }
+    QCOMPARE(ranges[500 * wordsPerLine + 1]->toRange(), KTextEditor::Range(500, 5, 500, 9));
+
+    // cursors must follow wrapping and unwrapping
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(500, 0), QStringLiteral("x"));
+    buffer.wrapLine(KTextEditor::Cursor(500, 251));
+    buffer.finishEditing();
+    QCOMPARE(ranges[500 * wordsPerLine]->toRange(), KTextEditor::Range(500, 1, 500, 5));
+    QCOMPARE(ranges[500 * wordsPerLine + 50]->toRange(), KTextEditor::Range(501, 0, 501, 4));
+    QCOMPARE(ranges[600 * wordsPerLine + 1]->toRange(), KTextEditor::Range(601, 5, 601, 9));
+
+    buffer.startEditing();
+    buffer.unwrapLine(501);
+    buffer.removeText(KTextEditor::Range(500, 0, 500, 1));
+    buffer.finishEditing();
+    for (int l = 0; l < lines; l += 99) {
+        for (int w = 0; w < wordsPerLine; w += 7) {
+            QCOMPARE(ranges[l * wordsPerLine + w]->toRange(), KTextEditor::Range(l, w * 5, l, w * 5 + 4));
+        }
+    }
+
+    // ranges must be gone before the buffer
+    ranges.clear();
+}
+
+void KateTextBufferTest::hugeLineEditsBenchmark()
+{
+    // one line with 1M characters, like minified sources or logs without line breaks
+    const int length = 1000 * 1000;
+    Kate::TextBuffer buffer(nullptr);
+    buffer.startEditing();
+    buffer.insertText(KTextEditor::Cursor(0, 0), QStringLiteral("abcdefghij").repeated(length / 10));
+    buffer.finishEditing();
+
+    Kate::TextCursor end(buffer, KTextEditor::Cursor(0, length), Kate::TextCursor::MoveOnInsert);
+    Kate::TextRange middle(buffer, KTextEditor::Range(0, length / 2, 0, length / 2 + 10), KTextEditor::MovingRange::DoNotExpand);
+
+    // edits near the start of the line, each one moves the whole rest of the line
+    const qint64 startRevision = buffer.revision();
+    QBENCHMARK {
+        buffer.startEditing();
+        for (int i = 0; i < 1000; ++i) {
+            buffer.insertText(KTextEditor::Cursor(0, 10 + i), QStringLiteral("x"));
+        }
+        QCOMPARE(end.toCursor(), KTextEditor::Cursor(0, length + 1000));
+        for (int i = 0; i < 1000; ++i) {
+            buffer.removeText(KTextEditor::Range(0, 10, 0, 11));
+        }
+        buffer.finishEditing();
+    }
+
+    // all edits are undone again, cursors, ranges and history must agree
+    QCOMPARE(buffer.lineData(0)->length(), length);
+    QCOMPARE(end.toCursor(), KTextEditor::Cursor(0, length));
+    QCOMPARE(middle.toRange(), KTextEditor::Range(0, length / 2, 0, length / 2 + 10));
+    QVERIFY(buffer.revision() >= startRevision + 2000);
+    int line = 0, column = length / 2;
+    buffer.history().transformCursor(line, column, KTextEditor::MovingCursor::MoveOnInsert, startRevision, buffer.revision());
+    QCOMPARE(KTextEditor::Cursor(line, column), KTextEditor::Cursor(0, length / 2));
+    QCOMPARE(buffer.line(0)->string(0, 20), QStringLiteral("abcdefghijabcdefghij"));
+}
+
+void KateTextBufferTest::multiLineRangesTest()
+{
+    // small blocks, ranges spanning many of them
+    Kate::TextBuffer buffer(nullptr, 4);
+    buffer.startEditing();
+    for (int i = 0; i < 40; ++i) {
+        buffer.insertText(KTextEditor::Cursor(i, 0), QStringLiteral("line %1").arg(i));
+        buffer.wrapLine(KTextEditor::Cursor(i, buffer.lineData(i)->length()));
+    }
+    buffer.finishEditing();
+
+    std::vector<std::unique_ptr<Kate::TextRange> > ranges;
+    for (int i = 0; i < 40; i += 3) {
+        ranges.emplace_back(new Kate::TextRange(buffer, KTextEditor::Range(i, 2, qMin(40, i + (i % 17)), 1), KTextEditor::MovingRange::DoNotExpand));
+    }
+
+    // compare the lookup with checking all ranges
+    auto verify = [&buffer, &ranges]() {
+        for (int line = 0; line < buffer.lines(); ++line) {
+            QSet<Kate::TextRange *> expected;
+            for (const auto &range : ranges) {
+                if (range->toRange().isValid() && range->start().line() <= line && line <= range->end().line()) {
+                    expected.insert(range.get());
+                }
+            }
+            const QList<Kate::TextRange *> found = buffer.rangesForLine(line, nullptr, false);
+            QCOMPARE(found.size(), expected.size());
+            QCOMPARE(found.toSet(), expected);
+
+            // visitor sees the same ranges
+            QList<Kate::TextRange *> visited;
+            buffer.forEachRangeForLine(line, nullptr, false, [&visited](Kate::TextRange *range) {
+                visited.append(range);
+            });
+            QCOMPARE(visited, found);
+        }
+    };
+    verify();
+
+    // line count changes inside and in front of the ranges
+    buffer.startEditing();
+    buffer.wrapLine(KTextEditor::Cursor(5, 3));
+    buffer.wrapLine(KTextEditor::Cursor(20, 0));
+    buffer.unwrapLine(31);
+    buffer.finishEditing();
+    verify();
+
+    // ranges changing between single- and multi-line
+    ranges[2]->setRange(KTextEditor::Range(7, 0, 7, 2));
+    ranges[3]->setRange(KTextEditor::Range(1, 0, 38, 0));
+    verify();
+
+    buffer.startEditing();
+    buffer.removeText(KTextEditor::Range(12, 0, 12, 2));
+    buffer.unwrapLine(13);
+    buffer.unwrapLine(2);
+    buffer.finishEditing();
+    verify();
+
+    // ranges must be gone before the buffer
+    ranges.clear();
+}
@@ -41,6 +41,22 @@ private Q_SLOTS:
     void nestedFoldingTest();
     void saveFileInUnwritableFolder();
     void saveFileWithElevatedPrivileges();
+    void mixedEndOfLineTest();
+    void loadBenchmark();
+    void blockIndexTest();
+    void asyncSaveTest();
+    void digestTest();
+    void applyEditsTest();
+    void applyEditsBenchmark();
+    void attributeIteratorTest();
+    void packedAttributesTest();
+    void packedFoldingsTest();
+    void snapshotTest();
+    void blockCompressionTest();
+    void maximumLineLengthTest();
+    void movingRangesBenchmark();
+    void hugeLineEditsBenchmark();
+    void multiLineRangesTest();
 };
 
 #endif // KATETEXTBUFFERTEST_H
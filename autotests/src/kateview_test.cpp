@@ -529,3 +529,30 @@ void KateViewTest::testGotoMatchingBracket()
 }
 
 // kate: indent-mode cstyle; indent-width 4; replace-tabs on;
+
+void KateViewTest::testPaintScrolledToEnd()
+{
+    KTextEditor::DocumentPrivate doc;
+    QStringList text;
+    for (int i = 0; i < 20000; ++i) {
+        text << QStringLiteral("int a%1 = %1; // comment").arg(i);
+    }
+    doc.setText(text);
+    doc.setHighlightingMode(QStringLiteral("C++"));
+
+    // all borders on, they ask for the lines while painting, too
+    KTextEditor::ViewPrivate view(&doc, nullptr);
+    view.config()->setIconBar(true);
+    view.config()->setLineNumbers(true);
+    view.config()->setFoldingBar(true);
+    view.resize(400, 300);
+
+    // painting the end must not highlight everything in front of it at once
+    view.setCursorPosition(Cursor(doc.lines() - 1, 0));
+    view.grab();
+    QVERIFY(doc.buffer().highlightedLines() < doc.lines() / 2);
+
+    // the background highlighting gets there
+    QTRY_VERIFY_WITH_TIMEOUT(doc.buffer().highlightedLines() >= doc.lines() - 1, 20000);
+    view.grab();
+}
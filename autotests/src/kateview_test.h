@@ -44,6 +44,7 @@ private Q_SLOTS:
     void testFoldFirstLine();
     void testDragAndDrop();
     void testGotoMatchingBracket();
+    void testPaintScrolledToEnd();
 };
 
 #endif // KATE_VIEW_TEST_H
@@ -28,6 +28,8 @@
 
 #include <QtTestWidgets>
 
+#include <algorithm>
+
 using namespace KTextEditor;
 
 QTEST_MAIN(RevisionTest)
@@ -155,3 +157,174 @@ void RevisionTest::testTransformRange()
     QCOMPARE(r2, Range(Cursor(1, 2), Cursor(1, 2)));
     QCOMPARE(invalidOnEmpty, Range::invalid());
 }
+
+// tests:
+// - transformCursors() gives the same results as transformCursor()
+void RevisionTest::testTransformCursors()
+{
+    KTextEditor::DocumentPrivate doc;
+
+    doc.setText("0000\n"
+                "1111\n"
+                "2222\n"
+                "3333");
+
+    // lock current revision
+    qint64 rev = doc.revision();
+    doc.lockRevision(rev);
+
+    // sorted cursors on all lines, including some behind the line end
+    QVector<Cursor> cursors;
+    for (int line = 0; line < 4; ++line) {
+        for (int column = 0; column < 7; ++column) {
+            cursors.append(Cursor(line, column));
+        }
+    }
+
+    // mix of all editing primitives
+    doc.insertText(Cursor(0, 2), "\nxx\nyy");
+    doc.removeText(Range(Cursor(3, 1), Cursor(4, 2)));
+    doc.insertText(Cursor(4, 4), "zz");
+    doc.removeText(Range(Cursor(1, 0), Cursor(1, 2)));
+
+    for (auto behavior : {MovingCursor::MoveOnInsert, MovingCursor::StayOnInsert}) {
+        QVector<Cursor> expected = cursors;
+        for (Cursor &cursor : expected) {
+            doc.transformCursor(cursor, behavior, rev, -1);
+        }
+
+        // through the public extension interface
+        QVector<Cursor> transformed = cursors;
+        auto iface = qobject_cast<KTextEditor::MovingInterfaceV2 *>(&doc);
+        QVERIFY(iface);
+        iface->transformCursors(transformed, behavior, rev, -1);
+        QCOMPARE(transformed, expected);
+
+        // and back again
+        const qint64 current = doc.revision();
+        std::sort(transformed.begin(), transformed.end());
+        expected = transformed;
+        for (Cursor &cursor : expected) {
+            doc.transformCursor(cursor, behavior, current, rev);
+        }
+
+        doc.transformCursors(transformed, behavior, current, rev);
+        QCOMPARE(transformed, expected);
+    }
+
+    doc.unlockRevision(rev);
+}
+
+// tests:
+// - compaction of the history on unlockRevision()
+void RevisionTest::testCompaction()
+{
+    KTextEditor::DocumentPrivate doc;
+    doc.buffer().history().setCompactionEnabled(true);
+
+    doc.setText("0000");
+
+    // lock revision before and while typing
+    const qint64 rev = doc.revision();
+    doc.lockRevision(rev);
+
+    doc.insertText(Cursor(0, 2), "a");
+    const qint64 typingRev = doc.revision();
+    doc.lockRevision(typingRev);
+    doc.insertText(Cursor(0, 3), "b");
+    doc.insertText(Cursor(0, 4), "c");
+
+    // releasing the intermediate revision merges the typing, locked revisions stay usable
+    doc.unlockRevision(typingRev);
+
+    Cursor stayOnInsert(0, 2);
+    Cursor moveOnInsert(0, 2);
+    Cursor behind(0, 3);
+    doc.transformCursor(stayOnInsert, MovingCursor::StayOnInsert, rev, -1);
+    doc.transformCursor(moveOnInsert, MovingCursor::MoveOnInsert, rev, -1);
+    doc.transformCursor(behind, MovingCursor::StayOnInsert, rev, -1);
+
+    QCOMPARE(stayOnInsert, Cursor(0, 2));
+    QCOMPARE(moveOnInsert, Cursor(0, 5));
+    QCOMPARE(behind, Cursor(0, 6));
+
+    doc.transformCursor(behind, MovingCursor::StayOnInsert, -1, rev);
+    QCOMPARE(behind, Cursor(0, 3));
+
+    // the released revision is gone, no wrong positions for it
+    Cursor compacted(0, 3);
+    doc.transformCursor(compacted, MovingCursor::StayOnInsert, typingRev, -1);
+    QVERIFY(!compacted.isValid());
+
+    Range compactedRange(0, 1, 0, 3);
+    doc.transformRange(compactedRange, MovingRange::DoNotExpand, MovingRange::AllowEmpty, typingRev, -1);
+    QVERIFY(!compactedRange.isValid());
+
+    QVector<Cursor> compactedCursors = {Cursor(0, 1), Cursor(0, 3)};
+    doc.transformCursors(compactedCursors, MovingCursor::StayOnInsert, typingRev, -1);
+    QCOMPARE(compactedCursors, QVector<Cursor>({Cursor::invalid(), Cursor::invalid()}));
+
+    // locking it again is harmless
+    doc.lockRevision(typingRev);
+    doc.unlockRevision(typingRev);
+
+    doc.unlockRevision(rev);
+}
+
+// tests:
+// - memory limit and statistics of the history
+void RevisionTest::testMemoryLimit()
+{
+    KTextEditor::DocumentPrivate doc;
+    Kate::TextHistory &history = doc.buffer().history();
+    history.setMemoryLimit(0);
+
+    // a leaking locker keeps the whole history around
+    const qint64 rev = doc.revision();
+    doc.lockRevision(rev);
+    for (int i = 0; i < 100; ++i) {
+        doc.insertText(Cursor(0, 0), QStringLiteral("\n"));
+    }
+
+    Kate::TextHistory::Statistics statistics = history.statistics();
+    QVERIFY(statistics.entries > 100);
+    QCOMPARE(statistics.locks, 1);
+    QCOMPARE(statistics.oldestLockedRevision, rev);
+    QCOMPARE(statistics.expiredRevision, qint64(-1));
+
+    // limit to the size of 40 entries, typing is merged, the wraps must be dropped
+    history.setMemoryLimit(statistics.memoryUsage / statistics.entries * 40);
+    for (int i = 0; i < 10; ++i) {
+        doc.insertText(Cursor(0, i), QStringLiteral("x"));
+    }
+
+    statistics = history.statistics();
+    QVERIFY(statistics.entries <= 40);
+    QVERIFY(statistics.discardedEntries > 0);
+    QVERIFY(statistics.expiredRevision >= rev);
+    QCOMPARE(statistics.locks, 1);
+    QCOMPARE(statistics.oldestLockedRevision, statistics.expiredRevision);
+
+    // expired revisions give no wrong positions, but can still be released
+    Cursor cursor(0, 0);
+    doc.transformCursor(cursor, MovingCursor::MoveOnInsert, rev, -1);
+    QVERIFY(!cursor.isValid());
+
+    Range range(0, 0, 0, 1);
+    doc.transformRange(range, MovingRange::DoNotExpand, MovingRange::AllowEmpty, -1, rev);
+    QVERIFY(!range.isValid());
+
+    // still fine between revisions in the history
+    const qint64 recent = doc.revision();
+    doc.lockRevision(recent);
+    doc.insertText(Cursor(0, 0), QStringLiteral("y"));
+    cursor = Cursor(0, 0);
+    doc.transformCursor(cursor, MovingCursor::MoveOnInsert, recent, -1);
+    QCOMPARE(cursor, Cursor(0, 1));
+    doc.unlockRevision(recent);
+
+    doc.unlockRevision(rev);
+    statistics = history.statistics();
+    QCOMPARE(statistics.locks, 0);
+    QCOMPARE(statistics.oldestLockedRevision, qint64(-1));
+}
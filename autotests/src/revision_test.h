@@ -33,6 +33,9 @@ public:
 private Q_SLOTS:
     void testTransformCursor();
     void testTransformRange();
+    void testTransformCursors();
+    void testCompaction();
+    void testMemoryLimit();
 };
 
 #endif // KATE_REVISION_TEST_H
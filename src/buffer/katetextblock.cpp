@@ -21,14 +21,18 @@
 #include "katetextblock.h"
 #include "katetextbuffer.h"
 
+#include <algorithm>
+#include <iterator>
+
+#include <QDataStream>
 #include <QVarLengthArray>
 
 namespace Kate
 {
 
-TextBlock::TextBlock(TextBuffer *buffer, int startLine)
+TextBlock::TextBlock(TextBuffer *buffer, int blockIndex)
     : m_buffer(buffer)
-    , m_startLine(startLine)
+    , m_blockIndex(blockIndex)
 {
     // reserve the block size
     m_lines.reserve(m_buffer->m_blockSize);
@@ -38,18 +42,25 @@ TextBlock::~TextBlock()
 {
     // blocks should be empty before they are deleted!
     Q_ASSERT(m_lines.empty());
-    Q_ASSERT(m_cursors.empty());
+    Q_ASSERT(m_compressed.isEmpty());
+    Q_ASSERT(m_cursorCount == 0);
 
     // it only is a hint for ranges for this block, not the storage of them
+
+    // the buffer must not look at the line lengths of this block any longer
+    if (m_lineLengthsChanged) {
+        m_buffer->blockDeleted(this);
+    }
 }
 
-void TextBlock::setStartLine(int startLine)
+int TextBlock::startLine() const
 {
-    // allow only valid lines
-    Q_ASSERT(startLine >= 0);
-    Q_ASSERT(startLine < m_buffer->lines());
-
-    m_startLine = startLine;
+    // only ask the index again if some line count changed since we did it the last time
+    if (m_startLineRevision != m_buffer->m_startLinesRevision) {
+        m_startLine = m_buffer->startLineOfBlock(m_blockIndex);
+        m_startLineRevision = m_buffer->m_startLinesRevision;
+    }
+    return m_startLine;
 }
 
 TextLine TextBlock::line(int line) const
@@ -58,34 +69,69 @@ TextLine TextBlock::line(int line) const
     Q_ASSERT(line >= startLine());
 
     // get text line, at will bail out on out-of-range
+    ensureUncompressed();
     return m_lines.at(line - startLine());
 }
 
 void TextBlock::appendLine(const QString &textOfLine)
 {
+    ensureUncompressed();
     m_lines.push_back(TextLine::create(textOfLine));
+    invalidateLineCaches();
+    invalidateMultiLineRangeIndex();
 }
 
 void TextBlock::clearLines()
 {
-    m_lines.clear();
+    clearLineStorage();
+}
+
+void TextBlock::appendLineTexts(QVector<QString> &texts) const
+{
+    ensureUncompressed();
+    for (const auto &line : m_lines) {
+        texts.append(line->text());
+    }
+}
+
+void TextBlock::appendCompressedLineTexts(const QByteArray &compressed, QVector<QString> &texts)
+{
+    // same layout as written by compressIfIdle(), only the texts are kept
+    const QByteArray data = qUncompress(compressed);
+    QDataStream stream(data);
+    QString text;
+    quint32 flags = 0;
+    qint32 stateId = 0;
+    QByteArray highlighting;
+    while (!stream.atEnd()) {
+        stream >> text >> flags >> stateId >> highlighting;
+        texts.append(text);
+    }
 }
 
 void TextBlock::text(QString &text) const
 {
+    ensureUncompressed();
+
     // combine all lines
+    const bool firstBlock = (startLine() == 0);
     for (size_t i = 0; i < m_lines.size(); ++i) {
         // not first line, insert \n
-        if (i > 0 || startLine() > 0) {
+        if (i > 0 || !firstBlock) {
             text.append(QLatin1Char('\n'));
         }
 
-        text.append(m_lines.at(i)->text());
+        m_lines.at(i)->appendText(text);
     }
 }
 
 void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesStartIndex)
 {
+    // text will change, drop the caches
+    ensureUncompressed();
+    invalidateLineCaches();
+    invalidateMultiLineRangeIndex();
+
     // calc internal line
     int line = position.line() - startLine();
 
@@ -97,7 +143,7 @@ void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesS
     Q_ASSERT(position.column() <= text.size());
 
     // create new line and insert it
-    m_lines.insert(m_lines.begin() + line + 1, TextLine(new TextLineData()));
+    m_lines.insert(m_lines.begin() + line + 1, TextLine::create());
 
     // cases for modification:
     // 1. line is wrapped in the middle
@@ -139,44 +185,50 @@ void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesS
 
     // no cursors will leave or join this block
 
-    // no cursors in this block, no work to do..
-    if (m_cursors.empty()) {
+    // no cursors on the wrapped line or behind it, no work to do..
+    if (size_t(line) >= m_cursorsPerLine.size()) {
         return;
     }
 
-    // move all cursors on the line which has the text inserted
+    // new empty bucket for the new line
+    m_cursorsPerLine.insert(m_cursorsPerLine.begin() + line + 1, std::vector<TextCursor *>());
+
+    // move all cursors behind the wrapped line one line down
     // remember all ranges modified, optimize for the standard case of a few ranges
     QVarLengthArray<TextRange *, 32> changedRanges;
-    for (TextCursor *cursor : m_cursors) {
-        // skip cursors on lines in front of the wrapped one!
-        if (cursor->lineInBlock() < line) {
-            continue;
-        }
-
-        // either this is simple, line behind the wrapped one
-        if (cursor->lineInBlock() > line) {
+    for (size_t i = line + 2; i < m_cursorsPerLine.size(); ++i) {
+        for (TextCursor *cursor : m_cursorsPerLine[i]) {
             // patch line of cursor
             cursor->m_line++;
-        }
 
-        // this is the wrapped line
-        else {
-            // skip cursors with too small column
-            if (cursor->column() <= position.column()) {
-                if (cursor->column() < position.column() || !cursor->m_moveOnInsert) {
-                    continue;
-                }
+            // remember range, if any, avoid double insert
+            auto range = cursor->kateRange();
+            if (range && !range->isValidityCheckRequired()) {
+                range->setValidityCheckRequired();
+                changedRanges.push_back(range);
             }
+        }
+    }
 
-            // move cursor
-
-            // patch line of cursor
-            cursor->m_line++;
+    // move cursors on the wrapped line behind the wrap position to the new line
+    auto &cursorsOfLine = m_cursorsPerLine[line];
+    for (auto it = cursorsOfLine.begin(); it != cursorsOfLine.end();) {
+        auto cursor = *it;
 
-            // patch column
-            cursor->m_column -= position.column();
+        // skip cursors with too small column
+        if (cursor->column() <= position.column()) {
+            if (cursor->column() < position.column() || !cursor->m_moveOnInsert) {
+                ++it;
+                continue;
+            }
         }
 
+        // patch line and column of cursor and move it to the bucket of the new line
+        cursor->m_line++;
+        cursor->m_column -= position.column();
+        m_cursorsPerLine[line + 1].push_back(cursor);
+        it = cursorsOfLine.erase(it);
+
         // remember range, if any, avoid double insert
         auto range = cursor->kateRange();
         if (range && !range->isValidityCheckRequired()) {
@@ -194,6 +246,16 @@ void TextBlock::wrapLine(const KTextEditor::Cursor &position, int fixStartLinesS
 
 void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLinesStartIndex)
 {
+    // text will change, drop the caches, the previous block might lose a line, too
+    ensureUncompressed();
+    invalidateLineCaches();
+    invalidateMultiLineRangeIndex();
+    if (previousBlock) {
+        previousBlock->ensureUncompressed();
+        previousBlock->invalidateLineCaches();
+        previousBlock->invalidateMultiLineRangeIndex();
+    }
+
     // calc internal line
     line = line - startLine();
 
@@ -210,20 +272,17 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
         m_lines[0] = newFirst;
         previousBlock->m_lines.erase(previousBlock->m_lines.begin() + (previousBlock->lines() - 1));
 
-        const int oldSizeOfPreviousLine = newFirst->text().size();
+        const int oldSizeOfPreviousLine = newFirst->length();
         if (oldFirst->length() > 0) {
             // append text
-            newFirst->textReadWrite().append(oldFirst->text());
+            oldFirst->appendText(newFirst->textReadWrite());
 
             // mark line as modified, since text was appended
             newFirst->markAsModified(true);
         }
 
-        // patch startLine of this block
-        --m_startLine;
-
         /**
-         * fix all start lines
+         * fix all start lines, the previous block has one line less, this moves our start line, too
          * we need to do this NOW, else the range update will FAIL!
          * bug 313759
          */
@@ -238,17 +297,18 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
          * cursor and range handling below
          */
 
-        // no cursors in this block and the previous one, no work to do..
-        if (m_cursors.empty() && previousBlock->m_cursors.empty()) {
+        // no cursors on the unwrapped line and the moved line of the previous block, no work to do..
+        const bool cursorsOnFirstLine = !m_cursorsPerLine.empty() && !m_cursorsPerLine[0].empty();
+        const bool cursorsOnMovedLine = size_t(lastLineOfPreviousBlock) < previousBlock->m_cursorsPerLine.size();
+        if (!cursorsOnFirstLine && !cursorsOnMovedLine) {
             return;
         }
 
         // move all cursors because of the unwrapped line
         // remember all ranges modified, optimize for the standard case of a few ranges
         QVarLengthArray<TextRange *, 32> changedRanges;
-        for (TextCursor *cursor : m_cursors) {
-            // this is the unwrapped line
-            if (cursor->lineInBlock() == 0) {
+        if (cursorsOnFirstLine) {
+            for (TextCursor *cursor : m_cursorsPerLine[0]) {
                 // patch column
                 cursor->m_column += oldSizeOfPreviousLine;
 
@@ -262,12 +322,16 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
         }
 
         // move cursors of the moved line from previous block to this block now
-        for (auto it = previousBlock->m_cursors.begin(); it != previousBlock->m_cursors.end();) {
-            auto cursor = *it;
-            if (cursor->lineInBlock() == lastLineOfPreviousBlock) {
+        if (cursorsOnMovedLine) {
+            if (m_cursorsPerLine.empty()) {
+                m_cursorsPerLine.resize(1);
+            }
+            for (TextCursor *cursor : previousBlock->m_cursorsPerLine[lastLineOfPreviousBlock]) {
                 cursor->m_line = 0;
                 cursor->m_block = this;
-                m_cursors.insert(cursor);
+                m_cursorsPerLine[0].push_back(cursor);
+                ++m_cursorCount;
+                --previousBlock->m_cursorCount;
 
                 // remember range, if any, avoid double insert
                 auto range = cursor->kateRange();
@@ -275,13 +339,10 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
                     range->setValidityCheckRequired();
                     changedRanges.push_back(range);
                 }
-
-                // remove from previous block
-                it = previousBlock->m_cursors.erase(it);
-            } else {
-                // keep in previous block
-                ++it;
             }
+
+            // the line is gone from the previous block
+            previousBlock->m_cursorsPerLine.resize(lastLineOfPreviousBlock);
         }
 
         // fixup the ranges that might be effected, because they moved from last line to this block
@@ -304,7 +365,7 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
     const int oldSizeOfPreviousLine = m_lines.at(line - 1)->length();
     const int sizeOfCurrentLine = m_lines.at(line)->length();
     if (sizeOfCurrentLine > 0) {
-        m_lines.at(line - 1)->textReadWrite().append(m_lines.at(line)->text());
+        m_lines.at(line)->appendText(m_lines.at(line - 1)->textReadWrite());
     }
 
     const bool lineChanged = (oldSizeOfPreviousLine > 0 && m_lines.at(line - 1)->markedAsModified())
@@ -332,37 +393,39 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
      * cursor and range handling below
      */
 
-    // no cursors in this block, no work to do..
-    if (m_cursors.empty()) {
+    // no cursors on the unwrapped line or behind it, no work to do..
+    if (size_t(line) >= m_cursorsPerLine.size()) {
         return;
     }
 
-    // move all cursors because of the unwrapped line
+    // move all cursors on and behind the unwrapped line one line up
     // remember all ranges modified, optimize for the standard case of a few ranges
     QVarLengthArray<TextRange *, 32> changedRanges;
-    for (TextCursor *cursor : m_cursors) {
-        // skip cursors in lines in front of removed one
-        if (cursor->lineInBlock() < line) {
-            continue;
-        }
-
-        // this is the unwrapped line
-        if (cursor->lineInBlock() == line) {
-            // patch column
-            cursor->m_column += oldSizeOfPreviousLine;
-        }
+    for (size_t i = line; i < m_cursorsPerLine.size(); ++i) {
+        for (TextCursor *cursor : m_cursorsPerLine[i]) {
+            // this is the unwrapped line
+            if (cursor->lineInBlock() == line) {
+                // patch column
+                cursor->m_column += oldSizeOfPreviousLine;
+            }
 
-        // patch line of cursor
-        cursor->m_line--;
+            // patch line of cursor
+            cursor->m_line--;
 
-        // remember range, if any, avoid double insert
-        auto range = cursor->kateRange();
-        if (range && !range->isValidityCheckRequired()) {
-            range->setValidityCheckRequired();
-            changedRanges.push_back(range);
+            // remember range, if any, avoid double insert
+            auto range = cursor->kateRange();
+            if (range && !range->isValidityCheckRequired()) {
+                range->setValidityCheckRequired();
+                changedRanges.push_back(range);
+            }
         }
     }
 
+    // cursors of the unwrapped line join the previous line, the bucket of the line is gone
+    auto &cursorsOfPreviousLine = m_cursorsPerLine[line - 1];
+    cursorsOfPreviousLine.insert(cursorsOfPreviousLine.end(), m_cursorsPerLine[line].begin(), m_cursorsPerLine[line].end());
+    m_cursorsPerLine.erase(m_cursorsPerLine.begin() + line);
+
     // we might need to invalidate ranges or notify about their changes
     // checkValidity might trigger delete of the range!
     for (TextRange *range : qAsConst(changedRanges)) {
@@ -372,6 +435,10 @@ void TextBlock::unwrapLine(int line, TextBlock *previousBlock, int fixStartLines
 
 void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &text)
 {
+    // text will change, drop the caches
+    ensureUncompressed();
+    invalidateLineCaches();
+
     // calc internal line
     int line = position.line() - startLine();
 
@@ -396,20 +463,15 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
      * cursor and range handling below
      */
 
-    // no cursors in this block, no work to do..
-    if (m_cursors.empty()) {
+    // no cursors on this line, no work to do..
+    if (size_t(line) >= m_cursorsPerLine.size() || m_cursorsPerLine[line].empty()) {
         return;
     }
 
     // move all cursors on the line which has the text inserted
     // remember all ranges modified, optimize for the standard case of a few ranges
     QVarLengthArray<TextRange *, 32> changedRanges;
-    for (TextCursor *cursor : m_cursors) {
-        // skip cursors not on this line!
-        if (cursor->lineInBlock() != line) {
-            continue;
-        }
-
+    for (TextCursor *cursor : m_cursorsPerLine[line]) {
         // skip cursors with too small column
         if (cursor->column() <= position.column()) {
             if (cursor->column() < position.column() || !cursor->m_moveOnInsert) {
@@ -445,6 +507,10 @@ void TextBlock::insertText(const KTextEditor::Cursor &position, const QString &t
 
 void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText)
 {
+    // text will change, drop the caches
+    ensureUncompressed();
+    invalidateLineCaches();
+
     // calc internal line
     int line = range.start().line() - startLine();
 
@@ -474,20 +540,15 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
      * cursor and range handling below
      */
 
-    // no cursors in this block, no work to do..
-    if (m_cursors.empty()) {
+    // no cursors on this line, no work to do..
+    if (size_t(line) >= m_cursorsPerLine.size() || m_cursorsPerLine[line].empty()) {
         return;
     }
 
     // move all cursors on the line which has the text removed
     // remember all ranges modified, optimize for the standard case of a few ranges
     QVarLengthArray<TextRange *, 32> changedRanges;
-    for (TextCursor *cursor : m_cursors) {
-        // skip cursors not on this line!
-        if (cursor->lineInBlock() != line) {
-            continue;
-        }
-
+    for (TextCursor *cursor : m_cursorsPerLine[line]) {
         // skip cursors with too small column
         if (cursor->column() <= range.start().column()) {
             continue;
@@ -516,42 +577,180 @@ void TextBlock::removeText(const KTextEditor::Range &range, QString &removedText
     }
 }
 
+void TextBlock::replaceText(int line, const QVector<KTextEditor::Range> &ranges, const QStringList &texts, QStringList &removedTexts)
+{
+    Q_ASSERT(ranges.size() == texts.size());
+
+    // text will change, drop the caches
+    ensureUncompressed();
+    invalidateLineCaches();
+
+    // calc internal line
+    const int blockLine = line - startLine();
+
+    // get text
+    QString &textOfLine = m_lines.at(blockLine)->textReadWrite();
+    const int oldLength = textOfLine.size();
+
+    // rebuild the line front to back in one go, the ranges are sorted back to front
+    int newLength = oldLength;
+    removedTexts.clear();
+    for (int i = 0; i < ranges.size(); ++i) {
+        const KTextEditor::Range &range = ranges.at(i);
+        Q_ASSERT(range.start().line() == line && range.end().line() == line);
+        Q_ASSERT(range.start().column() >= 0 && range.end().column() <= oldLength);
+        Q_ASSERT(i == 0 || range.end() <= ranges.at(i - 1).start());
+        removedTexts.append(textOfLine.mid(range.start().column(), range.columnWidth()));
+        newLength += texts.at(i).size() - range.columnWidth();
+    }
+
+    QString newText;
+    newText.reserve(newLength);
+    int column = 0;
+    for (int i = ranges.size() - 1; i >= 0; --i) {
+        newText.append(textOfLine.midRef(column, ranges.at(i).start().column() - column));
+        newText.append(texts.at(i));
+        column = ranges.at(i).end().column();
+    }
+    newText.append(textOfLine.midRef(column));
+    textOfLine = newText;
+    m_lines.at(blockLine)->markAsModified(true);
+
+    /**
+     * notify the text history, in the order of the single removeText() + insertText() calls
+     * each entry gets its own revision, the buffer revision moves on with each of them
+     * remember the line length before each edit and the summed up length change of all edits in front of it
+     */
+    QVarLengthArray<int, 32> lengthBefore(ranges.size());
+    QVarLengthArray<int, 32> deltaInFront(ranges.size() + 1);
+    int length = oldLength;
+    for (int i = 0; i < ranges.size(); ++i) {
+        const KTextEditor::Range &range = ranges.at(i);
+        lengthBefore[i] = length;
+        if (!range.isEmpty()) {
+            m_buffer->history().removeText(range, length);
+            ++m_buffer->m_revision;
+            length -= range.columnWidth();
+        }
+        if (!texts.at(i).isEmpty()) {
+            m_buffer->history().insertText(range.start(), texts.at(i).size(), length);
+            ++m_buffer->m_revision;
+            length += texts.at(i).size();
+        }
+    }
+    deltaInFront[ranges.size()] = 0;
+    for (int i = ranges.size() - 1; i >= 0; --i) {
+        deltaInFront[i] = deltaInFront[i + 1] + texts.at(i).size() - ranges.at(i).columnWidth();
+    }
+
+    /**
+     * cursor and range handling below
+     */
+
+    // no cursors on this line, no work to do..
+    if (size_t(blockLine) >= m_cursorsPerLine.size() || m_cursorsPerLine[blockLine].empty()) {
+        return;
+    }
+
+    // move all cursors on the line in one pass
+    // remember all ranges modified, optimize for the standard case of a few ranges
+    QVarLengthArray<TextRange *, 32> changedRanges;
+    for (TextCursor *cursor : m_cursorsPerLine[blockLine]) {
+        // edits behind the cursor don't move it, skip them
+        int i = std::partition_point(ranges.begin(), ranges.end(), [cursor](const KTextEditor::Range &range) {
+            return range.start().column() > cursor->m_column;
+        }) - ranges.begin();
+
+        // apply the edits touching the cursor like removeText() + insertText() do
+        // once the cursor is behind an edit, all edits in front of it just shift it
+        int newColumn = cursor->m_column;
+        for (; i < ranges.size(); ++i) {
+            const KTextEditor::Range &range = ranges.at(i);
+            int length = lengthBefore[i];
+            if (newColumn > range.end().column() && newColumn <= length) {
+                newColumn += deltaInFront[i];
+                break;
+            }
+
+            if (newColumn > range.start().column()) {
+                newColumn = (newColumn <= range.end().column()) ? range.start().column() : newColumn - range.columnWidth();
+            }
+            length -= range.columnWidth();
+
+            const int insertedLength = texts.at(i).size();
+            if (insertedLength > 0 && (newColumn > range.start().column() || (newColumn == range.start().column() && cursor->m_moveOnInsert))) {
+                if (newColumn <= length) {
+                    newColumn += insertedLength;
+                } else if (newColumn < length + insertedLength) {
+                    newColumn = length + insertedLength;
+                }
+            }
+        }
+
+        if (newColumn == cursor->m_column) {
+            continue;
+        }
+        cursor->m_column = newColumn;
+
+        // remember range, if any, avoid double insert
+        // we only need to trigger checkValidity later if the range has feedback or might be invalidated
+        auto range = cursor->kateRange();
+        if (range && !range->isValidityCheckRequired() && (range->feedback() || range->start().line() == range->end().line())) {
+            range->setValidityCheckRequired();
+            changedRanges.push_back(range);
+        }
+    }
+
+    // we might need to invalidate ranges or notify about their changes
+    // checkValidity might trigger delete of the range!
+    for (TextRange *range : qAsConst(changedRanges)) {
+        range->checkValidity();
+    }
+}
+
 void TextBlock::debugPrint(int blockIndex) const
 {
+    ensureUncompressed();
+
     // print all blocks
     for (size_t i = 0; i < m_lines.size(); ++i)
         printf("%4d - %4lld : %4d : '%s'\n", blockIndex, (unsigned long long)startLine() + i
                , m_lines.at(i)->text().size(), qPrintable(m_lines.at(i)->text()));
 }
 
-TextBlock *TextBlock::splitBlock(int fromLine)
+void TextBlock::splitBlock(int fromLine, TextBlock *newBlock)
 {
+    ensureUncompressed();
+
     // half the block
     int linesOfNewBlock = lines() - fromLine;
 
-    // create and insert new block
-    TextBlock *newBlock = new TextBlock(m_buffer, startLine() + fromLine);
-
     // move lines
     newBlock->m_lines.reserve(linesOfNewBlock);
     for (size_t i = fromLine; i < m_lines.size(); ++i) {
         newBlock->m_lines.push_back(m_lines.at(i));
     }
     m_lines.resize(fromLine);
-
-    // move cursors
-    for (auto it = m_cursors.begin(); it != m_cursors.end();) {
-        auto cursor = *it;
-        if (cursor->lineInBlock() >= fromLine) {
-            cursor->m_line = cursor->lineInBlock() - fromLine;
-            cursor->m_block = newBlock;
-
-            // add to new, remove from current
-            newBlock->m_cursors.insert(cursor);
-            it = m_cursors.erase(it);
-        } else {
-            // keep in current
-            ++it;
+    invalidateLineCaches();
+    newBlock->invalidateLineCaches();
+    invalidateMultiLineRangeIndex();
+    newBlock->invalidateMultiLineRangeIndex();
+
+    // new block was inserted, start lines must be right before ranges are updated
+    m_buffer->rebuildStartLines();
+
+    // move cursors, complete buckets of the lines moved to the new block
+    if (size_t(fromLine) < m_cursorsPerLine.size()) {
+        Q_ASSERT(newBlock->m_cursorsPerLine.empty());
+        newBlock->m_cursorsPerLine.assign(std::make_move_iterator(m_cursorsPerLine.begin() + fromLine), std::make_move_iterator(m_cursorsPerLine.end()));
+        m_cursorsPerLine.resize(fromLine);
+        for (const auto &cursors : newBlock->m_cursorsPerLine) {
+            for (TextCursor *cursor : cursors) {
+                cursor->m_line = cursor->lineInBlock() - fromLine;
+                cursor->m_block = newBlock;
+            }
+            newBlock->m_cursorCount += int(cursors.size());
+            m_cursorCount -= int(cursors.size());
         }
     }
 
@@ -562,20 +761,28 @@ TextBlock *TextBlock::splitBlock(int fromLine)
         updateRange(range);
         newBlock->updateRange(range);
     }
-
-    // return the new generated block
-    return newBlock;
 }
 
 void TextBlock::mergeBlock(TextBlock *targetBlock)
 {
+    ensureUncompressed();
+    targetBlock->ensureUncompressed();
+
     // move cursors, do this first, now still lines() count is correct for target
-    for (TextCursor *cursor : m_cursors) {
-        cursor->m_line = cursor->lineInBlock() + targetBlock->lines();
-        cursor->m_block = targetBlock;
-        targetBlock->m_cursors.insert(cursor);
+    if (!m_cursorsPerLine.empty()) {
+        const int targetLines = targetBlock->lines();
+        for (const auto &cursors : m_cursorsPerLine) {
+            for (TextCursor *cursor : cursors) {
+                cursor->m_line = cursor->lineInBlock() + targetLines;
+                cursor->m_block = targetBlock;
+            }
+        }
+        targetBlock->m_cursorsPerLine.resize(targetLines);
+        targetBlock->m_cursorsPerLine.insert(targetBlock->m_cursorsPerLine.end(), std::make_move_iterator(m_cursorsPerLine.begin()), std::make_move_iterator(m_cursorsPerLine.end()));
+        targetBlock->m_cursorCount += m_cursorCount;
+        m_cursorsPerLine.clear();
+        m_cursorCount = 0;
     }
-    m_cursors.clear();
 
     // move lines
     targetBlock->m_lines.reserve(targetBlock->lines() + lines());
@@ -583,6 +790,10 @@ void TextBlock::mergeBlock(TextBlock *targetBlock)
         targetBlock->m_lines.push_back(m_lines.at(i));
     }
     m_lines.clear();
+    invalidateLineCaches();
+    targetBlock->invalidateLineCaches();
+    invalidateMultiLineRangeIndex();
+    targetBlock->invalidateMultiLineRangeIndex();
 
     // fix ALL ranges!
     const QList<TextRange *> allRanges = m_uncachedRanges.toList() + m_cachedLineForRanges.keys();
@@ -596,53 +807,76 @@ void TextBlock::mergeBlock(TextBlock *targetBlock)
 void TextBlock::deleteBlockContent()
 {
     // kill cursors, if not belonging to a range
-    // we can do in-place editing of the current set of cursors as
+    // we can do in-place editing of the current buckets of cursors as
     // we remove them before deleting
-    for (auto it = m_cursors.begin(); it != m_cursors.end();) {
-        auto cursor = *it;
-        if (!cursor->kateRange()) {
-            // remove it and advance to next element
-            it = m_cursors.erase(it);
-
-            // delete after cursor is gone from the set
-            // else the destructor will modify it!
-            delete cursor;
-        } else {
-            // keep this cursor
-            ++it;
+    for (auto &cursors : m_cursorsPerLine) {
+        for (auto it = cursors.begin(); it != cursors.end();) {
+            auto cursor = *it;
+            if (!cursor->kateRange()) {
+                // remove it and advance to next element
+                it = cursors.erase(it);
+                --m_cursorCount;
+
+                // delete after cursor is gone from the bucket and detached from this block
+                // else the destructor will modify it!
+                cursor->m_block = nullptr;
+                delete cursor;
+            } else {
+                // keep this cursor
+                ++it;
+            }
         }
     }
 
     // kill lines
-    m_lines.clear();
+    clearLineStorage();
 }
 
 void TextBlock::clearBlockContent(TextBlock *targetBlock)
 {
     // move cursors, if not belonging to a range
-    // we can do in-place editing of the current set of cursors
-    for (auto it = m_cursors.begin(); it != m_cursors.end();) {
-        auto cursor = *it;
-        if (!cursor->kateRange()) {
-            cursor->m_column = 0;
-            cursor->m_line = 0;
-            cursor->m_block = targetBlock;
-            targetBlock->m_cursors.insert(cursor);
-
-            // remove it and advance to next element
-            it = m_cursors.erase(it);
-        } else {
-            // keep this cursor
-            ++it;
+    // we can do in-place editing of the current buckets of cursors
+    for (auto &cursors : m_cursorsPerLine) {
+        for (auto it = cursors.begin(); it != cursors.end();) {
+            auto cursor = *it;
+            if (!cursor->kateRange()) {
+                // remove it and advance to next element
+                it = cursors.erase(it);
+                --m_cursorCount;
+
+                cursor->m_column = 0;
+                cursor->m_line = 0;
+                cursor->m_block = targetBlock;
+                targetBlock->insertCursor(cursor);
+            } else {
+                // keep this cursor
+                ++it;
+            }
         }
     }
 
     // kill lines
-    m_lines.clear();
+    clearLineStorage();
+}
+
+TextSnapshot::BlockLines TextBlock::snapshot() const
+{
+    // lines are shared with the buffer via QString, only the vector itself is created here
+    // compressed blocks stay compressed, the snapshot gets its own decoded texts
+    QVector<QString> texts;
+    texts.reserve(lines());
+    if (isCompressed()) {
+        appendCompressedLineTexts(m_compressed, texts);
+    } else {
+        appendLineTexts(texts);
+    }
+    return TextSnapshot::BlockLines(new QVector<QString>(std::move(texts)));
 }
 
 void TextBlock::markModifiedLinesAsSaved()
 {
+    ensureUncompressed();
+
     // mark all modified lines as saved
     for (auto &textLine : m_lines) {
         if (textLine->markedAsModified()) {
@@ -651,6 +885,182 @@ void TextBlock::markModifiedLinesAsSaved()
     }
 }
 
+void TextBlock::insertCursor(Kate::TextCursor *cursor)
+{
+    const size_t line = cursor->lineInBlock();
+    if (line >= m_cursorsPerLine.size()) {
+        m_cursorsPerLine.resize(line + 1);
+    }
+
+    m_cursorsPerLine[line].push_back(cursor);
+    ++m_cursorCount;
+}
+
+void TextBlock::removeCursor(Kate::TextCursor *cursor)
+{
+    const size_t line = cursor->lineInBlock();
+    Q_ASSERT(line < m_cursorsPerLine.size());
+
+    // order inside the bucket doesn't matter, swap with the last one
+    auto &cursors = m_cursorsPerLine[line];
+    auto it = std::find(cursors.begin(), cursors.end(), cursor);
+    Q_ASSERT(it != cursors.end());
+    *it = cursors.back();
+    cursors.pop_back();
+    --m_cursorCount;
+
+    // drop trailing empty buckets, keeps the early outs of the edit functions cheap
+    while (!m_cursorsPerLine.empty() && m_cursorsPerLine.back().empty()) {
+        m_cursorsPerLine.pop_back();
+    }
+}
+
+void TextBlock::invalidateLineCaches()
+{
+    // tell the buffer before the cached lengths are gone, it might have counted them for its maximum
+    m_buffer->blockLineLengthsChanged(this);
+    m_maximumLineLength = -1;
+    m_maximumVirtualLineLength = -1;
+}
+
+int TextBlock::maximumLineLength() const
+{
+    if (m_maximumLineLength < 0) {
+        ensureUncompressed();
+        int length = 0;
+        for (const auto &line : m_lines) {
+            length = qMax(length, line->length());
+        }
+        m_maximumLineLength = length;
+    }
+
+    return m_maximumLineLength;
+}
+
+int TextBlock::maximumVirtualLineLength(int tabWidth) const
+{
+    if (m_maximumVirtualLineLength < 0 || m_maximumVirtualLineLengthTabWidth != tabWidth) {
+        ensureUncompressed();
+        int length = 0;
+        for (const auto &line : m_lines) {
+            length = qMax(length, line->virtualLength(tabWidth));
+        }
+        m_maximumVirtualLineLength = length;
+        m_maximumVirtualLineLengthTabWidth = tabWidth;
+    }
+
+    return m_maximumVirtualLineLength;
+}
+
+bool TextBlock::compressIfIdle()
+{
+    // block was used since the last round? remember that it was not yet used in this round
+    if (m_accessed) {
+        m_accessed = false;
+        return false;
+    }
+
+    // nothing to do for empty or already compressed blocks
+    if (m_lines.empty() || !m_compressed.isEmpty()) {
+        return false;
+    }
+
+    // serialize everything
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        for (const auto &line : m_lines) {
+            stream << line->m_text << quint32(line->m_flags) << qint32(line->m_highlightingStateId) << line->m_highlighting;
+        }
+    }
+
+    // fast compression, this is done in the background of the event loop
+    // not worth it if the data doesn't shrink
+    QByteArray compressed = qCompress(data, 1);
+    if (compressed.size() >= data.size()) {
+        return false;
+    }
+
+    // switch over to the compressed storage
+    m_compressed = compressed;
+    m_compressedLines = int(m_lines.size());
+    m_uncompressedSize = data.size();
+    m_lines.clear();
+    m_lines.shrink_to_fit();
+    return true;
+}
+
+void TextBlock::uncompress() const
+{
+    Q_ASSERT(!m_compressed.isEmpty());
+    Q_ASSERT(m_lines.empty());
+
+    // recreate the lines in the order they were written
+    const QByteArray data = qUncompress(m_compressed);
+    QDataStream stream(data);
+    m_lines.reserve(qMax(m_buffer->m_blockSize, m_compressedLines));
+    for (int i = 0; i < m_compressedLines; ++i) {
+        TextLine line = TextLine::create();
+        quint32 flags = 0;
+        qint32 stateId = 0;
+        stream >> line->m_text >> flags >> stateId >> line->m_highlighting;
+        line->m_flags = flags;
+        line->m_highlightingStateId = stateId;
+        m_lines.push_back(line);
+    }
+    Q_ASSERT(stream.status() == QDataStream::Ok);
+
+    // lines are back, drop the compressed storage
+    m_compressed.clear();
+    m_compressedLines = 0;
+}
+
+QVector<TextRange *> TextBlock::rangesForLine(int line) const
+{
+    QVector<TextRange *> ranges;
+    forEachRangeForLine(line, [&ranges](TextRange *range) {
+        ranges.append(range);
+    });
+    return ranges;
+}
+
+void TextBlock::updateMultiLineRangeIndex() const
+{
+    if (m_multiLineRangeIndexValid) {
+        return;
+    }
+    m_multiLineRangeIndexValid = true;
+
+    m_blockSpanningRanges.clear();
+    m_multiLineRangesPerLine.clear();
+
+    // clamp all ranges to the lines of this block
+    const int blockStartLine = startLine();
+    const int lastLine = lines() - 1;
+    for (TextRange *range : m_uncachedRanges) {
+        const int start = qMax(0, range->startInternal().lineInternal() - blockStartLine);
+        const int end = qMin(lastLine, range->endInternal().lineInternal() - blockStartLine);
+
+        // not intersecting this block, lookup not yet fixed by TextRange::checkValidity()
+        if (start > end) {
+            continue;
+        }
+
+        // common case for large ranges: intersecting all lines, no bucket needed
+        if (start == 0 && end == lastLine) {
+            m_blockSpanningRanges.push_back(range);
+            continue;
+        }
+
+        if (m_multiLineRangesPerLine.size() <= size_t(end)) {
+            m_multiLineRangesPerLine.resize(end + 1);
+        }
+        for (int line = start; line <= end; ++line) {
+            m_multiLineRangesPerLine[line].push_back(range);
+        }
+    }
+}
+
 void TextBlock::updateRange(TextRange *range)
 {
     /**
@@ -660,10 +1070,12 @@ void TextBlock::updateRange(TextRange *range)
     const int endLine = range->endInternal().lineInternal();
     const bool isSingleLine = startLine == endLine;
 
+    const int blockStartLine = this->startLine();
+
     /**
      * perhaps remove range and be done
      */
-    if ((endLine < m_startLine) || (startLine >= (m_startLine + lines()))) {
+    if ((endLine < blockStartLine) || (startLine >= (blockStartLine + lines()))) {
         removeRange(range);
         return;
     }
@@ -671,14 +1083,16 @@ void TextBlock::updateRange(TextRange *range)
     /**
      * The range is still a single-line range, and is still cached to the correct line.
      */
-    if (isSingleLine && m_cachedLineForRanges.contains(range) && (m_cachedLineForRanges.value(range) == startLine - m_startLine)) {
+    if (isSingleLine && m_cachedLineForRanges.contains(range) && (m_cachedLineForRanges.value(range) == startLine - blockStartLine)) {
         return;
     }
 
     /**
      * The range is still a multi-line range, and is already in the correct set.
+     * Its lines might have changed, the index needs an update.
      */
     if (!isSingleLine && m_uncachedRanges.contains(range)) {
+        invalidateMultiLineRangeIndex();
         return;
     }
 
@@ -695,13 +1109,14 @@ void TextBlock::updateRange(TextRange *range)
          * The range cannot be cached per line, as it spans multiple lines
          */
         m_uncachedRanges.insert(range);
+        invalidateMultiLineRangeIndex();
         return;
     }
 
     /**
      * The range is contained by a single line, put it into the line-cache
      */
-    const int lineOffset = startLine - m_startLine;
+    const int lineOffset = startLine - blockStartLine;
 
     /**
      * enlarge cache if needed
@@ -727,6 +1142,7 @@ void TextBlock::removeRange(TextRange *range)
          * must be only uncached!
          */
         Q_ASSERT(!m_cachedLineForRanges.contains(range));
+        invalidateMultiLineRangeIndex();
         return;
     }
 
@@ -21,14 +21,16 @@
 #ifndef KATE_TEXTBLOCK_H
 #define KATE_TEXTBLOCK_H
 
-#include <unordered_set>
+#include <vector>
 
 #include <QVector>
 #include <QSet>
+#include <QStringList>
 
 #include <ktexteditor_export.h>
 #include <ktexteditor/cursor.h>
 #include "katetextline.h"
+#include "katetextsnapshot.h"
 
 namespace Kate
 {
@@ -48,9 +50,9 @@ public:
     /**
      * Construct an empty text block.
      * @param buffer parent text buffer
-     * @param startLine start line of this block
+     * @param blockIndex index of this block in the buffer
      */
-    TextBlock(TextBuffer *buffer, int startLine);
+    TextBlock(TextBuffer *buffer, int blockIndex);
 
     /**
      * Destruct the text block
@@ -59,18 +61,29 @@ public:
 
     /**
      * Start line of this block.
+     * Cached, O(1) as long as no line count changed, else looked up in the
+     * start line index of the buffer, O(log(blocks)).
      * @return start line of this block
      */
-    int startLine() const
+    int startLine() const;
+
+    /**
+     * Index of this block in the buffer.
+     * @return index of this block
+     */
+    int blockIndex() const
     {
-        return m_startLine;
+        return m_blockIndex;
     }
 
     /**
-     * Set start line of this block.
-     * @param startLine new start line of this block
+     * Set index of this block in the buffer.
+     * @param blockIndex new index of this block
      */
-    void setStartLine(int startLine);
+    void setBlockIndex(int blockIndex)
+    {
+        m_blockIndex = blockIndex;
+    }
 
     /**
      * Retrieve a text line.
@@ -79,6 +92,19 @@ public:
      */
     TextLine line(int line) const;
 
+    /**
+     * Retrieve a text line without touching the reference count.
+     * The returned pointer is borrowed, it is only valid until the next edit of this block
+     * or until the block is compressed, which only happens from the event loop.
+     * @param line wanted line number
+     * @return text line data
+     */
+    TextLineData *lineData(int line) const
+    {
+        ensureUncompressed();
+        return m_lines.at(line - startLine()).data();
+    }
+
     /**
      * Append a new line with given text.
      * @param textOfLine text of the line to append
@@ -96,9 +122,33 @@ public:
      */
     int lines() const
     {
-        return m_lines.size();
+        return m_compressed.isEmpty() ? int(m_lines.size()) : m_compressedLines;
+    }
+
+    /**
+     * Append the text of all lines of this block, the strings are shared.
+     * @param texts list to append the line texts to
+     */
+    void appendLineTexts(QVector<QString> &texts) const;
+
+    /**
+     * Compressed data of this block, to decode the line texts later without uncompressing the block.
+     * The array is implicitly shared, see appendCompressedLineTexts().
+     * @return compressed data, empty if the block is not compressed
+     */
+    QByteArray compressedData() const
+    {
+        return m_compressed;
     }
 
+    /**
+     * Append the texts of the lines stored in compressed block data.
+     * Only works on the given data, can be used from any thread.
+     * @param compressed data from compressedData()
+     * @param texts list to append the line texts to
+     */
+    static void appendCompressedLineTexts(const QByteArray &compressed, QVector<QString> &texts);
+
     /**
      * Retrieve text of block.
      * @param text for this block, lines separated by '\n'
@@ -134,6 +184,17 @@ public:
      */
     void removeText(const KTextEditor::Range &range, QString &removedText);
 
+    /**
+     * Replace several ranges of one line at once, the line text is rebuilt and the cursors are moved in one pass.
+     * The outcome is the same as removing each range and inserting its text, back to front.
+     * The buffer revision is increased for each recorded removal and insertion.
+     * @param line line to change
+     * @param ranges ranges on this line, sorted back to front like TextBuffer::prepareEdits() does, not overlapping
+     * @param texts replacement text for each range, without newlines
+     * @param removedTexts will be filled with the removed text of each range
+     */
+    void replaceText(int line, const QVector<KTextEditor::Range> &ranges, const QStringList &texts, QStringList &removedTexts);
+
     /**
      * Debug output, print whole block content with line numbers and line length
      * @param blockIndex index of this block in buffer
@@ -141,12 +202,12 @@ public:
     void debugPrint(int blockIndex) const;
 
     /**
-     * Split given block. A new block will be created and all lines starting from the given index will
-     * be moved to it, together with the cursors belonging to it.
+     * Split given block. All lines starting from the given index will be moved to the new block,
+     * together with the cursors belonging to it.
      * @param fromLine line from which to split
-     * @return new block containing the lines + cursors removed from this one
+     * @param newBlock empty block, already inserted into the buffer behind this one
      */
-    TextBlock *splitBlock(int fromLine);
+    void splitBlock(int fromLine, TextBlock *newBlock);
 
     /**
      * Merge this block with given one, the given one must be a direct predecessor.
@@ -169,13 +230,43 @@ public:
     void clearBlockContent(TextBlock *targetBlock);
 
     /**
-     * Return all ranges in this block which might intersect the given line.
+     * Return all ranges in this block which intersect the given line.
+     * Multi-line ranges are looked up in a per-line index that is rebuilt lazily after
+     * lines were added or removed or a multi-line range changed, see updateMultiLineRangeIndex().
      * @param line line to check intersection
-     * @return list of sets of possible candidate ranges
+     * @return ranges intersecting the line
      */
-    QList<QSet<TextRange *> > rangesForLine(int line) const
+    QVector<TextRange *> rangesForLine(int line) const;
+
+    /**
+     * Call the visitor for all ranges in this block which intersect the given line, same ranges as rangesForLine().
+     * Allocation free, as long as the index of the multi-line ranges is up-to-date.
+     * The visitor must not modify ranges or the buffer.
+     * @param line line to check intersection
+     * @param visitor callable taking a TextRange *
+     */
+    template<typename Visitor>
+    void forEachRangeForLine(int line, Visitor &&visitor) const
     {
-        return QList<QSet<TextRange *> >() << m_uncachedRanges << cachedRangesForLine(line);
+        line -= startLine();
+
+        // multi-line ranges, from the index
+        updateMultiLineRangeIndex();
+        for (TextRange *range : m_blockSpanningRanges) {
+            visitor(range);
+        }
+        if (line >= 0 && size_t(line) < m_multiLineRangesPerLine.size()) {
+            for (TextRange *range : m_multiLineRangesPerLine[line]) {
+                visitor(range);
+            }
+        }
+
+        // single-line ranges, from the line cache
+        if (line >= 0 && line < m_cachedRangesForLine.size()) {
+            for (TextRange *range : m_cachedRangesForLine[line]) {
+                visitor(range);
+            }
+        }
     }
 
     /**
@@ -188,28 +279,81 @@ public:
         return m_cachedLineForRanges.contains(range) || m_uncachedRanges.contains(range);
     }
 
+    /**
+     * Immutable list of the texts of all lines of this block, see TextBuffer::snapshot().
+     * The strings are shared with the lines, compressed blocks are decoded without uncompressing them.
+     * @return shared texts of the lines
+     */
+    TextSnapshot::BlockLines snapshot() const;
+
+    /**
+     * Length of the longest line of this block.
+     * Cached until the next modification of this block.
+     * @return maximal line length in characters
+     */
+    int maximumLineLength() const;
+
+    /**
+     * Length of the longest line of this block with tabs expanded.
+     * Cached until the next modification of this block or a change of the tab width.
+     * @param tabWidth tab width used to expand the tabs
+     * @return maximal virtual line length
+     */
+    int maximumVirtualLineLength(int tabWidth) const;
+
+    /**
+     * Is this block compressed in memory?
+     * Any access to the lines will uncompress it again.
+     * @return block compressed?
+     */
+    bool isCompressed() const
+    {
+        return !m_compressed.isEmpty();
+    }
+
+    /**
+     * Compress the lines of this block in memory if it was not accessed since the last call.
+     * Text, attributes, foldings and flags are stored as one compressed array,
+     * the highlighting states are kept as they are, they are implicitly shared.
+     * @return true if the block was compressed by this call
+     */
+    bool compressIfIdle();
+
+    /**
+     * Size of the compressed data of this block.
+     * @return compressed size in bytes, 0 if not compressed
+     */
+    int compressedSize() const
+    {
+        return m_compressed.size();
+    }
+
+    /**
+     * Size of the data of this block before it was compressed.
+     * @return uncompressed size in bytes, 0 if not compressed
+     */
+    int uncompressedSize() const
+    {
+        return m_compressed.isEmpty() ? 0 : m_uncompressedSize;
+    }
+
     /**
      * Flag all modified text lines as saved on disk.
      */
     void markModifiedLinesAsSaved();
 
     /**
-     * Insert cursor into this block.
+     * Insert cursor into this block, it is sorted in by its current line in the block.
      * @param cursor cursor to insert
      */
-    void insertCursor(Kate::TextCursor *cursor)
-    {
-        m_cursors.insert(cursor);
-    }
+    void insertCursor(Kate::TextCursor *cursor);
 
     /**
      * Remove cursor from this block.
+     * Must be called before the line of the cursor is changed.
      * @param cursor cursor to remove
      */
-    void removeCursor(Kate::TextCursor *cursor)
-    {
-        m_cursors.erase(cursor);
-    }
+    void removeCursor(Kate::TextCursor *cursor);
 
     /**
      * Update a range from this block.
@@ -232,7 +376,7 @@ public:
      */
     QSet<TextRange *> cachedRangesForLine(int line) const
     {
-        line -= m_startLine;
+        line -= startLine();
         if (line >= 0 && line < m_cachedRangesForLine.size()) {
             return m_cachedRangesForLine[line];
         } else {
@@ -240,6 +384,58 @@ public:
         }
     }
 
+private:
+    /**
+     * Drop the cached line lengths, must be called on each modification of the lines.
+     * The buffer is told to take the line lengths of this block into account again.
+     */
+    void invalidateLineCaches();
+
+    /**
+     * Mark the index of the multi-line ranges as outdated.
+     * Must be called if lines are added or removed or a multi-line range is added, moved or removed.
+     */
+    void invalidateMultiLineRangeIndex()
+    {
+        m_multiLineRangeIndexValid = false;
+    }
+
+    /**
+     * Rebuild the index of the multi-line ranges, if outdated.
+     * Ranges covering all lines of the block are kept in one list, the others
+     * are put into a bucket for each line of the block they intersect.
+     */
+    void updateMultiLineRangeIndex() const;
+
+    /**
+     * Mark this block as accessed and uncompress it if needed.
+     * Must be called before any access to m_lines.
+     */
+    void ensureUncompressed() const
+    {
+        m_accessed = true;
+        if (Q_UNLIKELY(!m_compressed.isEmpty())) {
+            uncompress();
+        }
+    }
+
+    /**
+     * Restore the lines from the compressed data.
+     */
+    void uncompress() const;
+
+    /**
+     * Drop all lines, compressed or not.
+     */
+    void clearLineStorage()
+    {
+        m_lines.clear();
+        m_compressed.clear();
+        m_compressedLines = 0;
+        invalidateLineCaches();
+        invalidateMultiLineRangeIndex();
+    }
+
 private:
     /**
      * parent text buffer
@@ -249,19 +445,77 @@ private:
     /**
      * Lines contained in this buffer. These are shared pointers.
      * We need no sharing, use STL.
+     * Empty while the block is compressed, restored on first access.
+     */
+    mutable std::vector<Kate::TextLine> m_lines;
+
+    /**
+     * Cached length of the longest line, -1 if invalidated.
+     */
+    mutable int m_maximumLineLength = -1;
+
+    /**
+     * Cached length of the longest line with tabs expanded, -1 if invalidated.
+     */
+    mutable int m_maximumVirtualLineLength = -1;
+
+    /**
+     * Tab width m_maximumVirtualLineLength was computed for.
      */
-    std::vector<Kate::TextLine> m_lines;
+    mutable int m_maximumVirtualLineLengthTabWidth = 0;
 
     /**
-     * Startline of this block
+     * Is this block in the list of blocks with changed line lengths of the buffer?
      */
-    int m_startLine;
+    mutable bool m_lineLengthsChanged = false;
 
     /**
-     * Set of cursors for this block.
+     * Compressed text, attributes, foldings and flags of all lines, empty if not compressed.
+     */
+    mutable QByteArray m_compressed;
+
+    /**
+     * Number of lines while compressed.
+     */
+    mutable int m_compressedLines = 0;
+
+    /**
+     * Size of the data before compression.
+     */
+    int m_uncompressedSize = 0;
+
+    /**
+     * Was this block accessed since the last compressIfIdle() call?
+     */
+    mutable bool m_accessed = true;
+
+    /**
+     * Index of this block in the buffer, used to look up the start line
+     */
+    int m_blockIndex;
+
+    /**
+     * Cached start line of this block, valid if m_startLineRevision matches the buffer.
+     */
+    mutable int m_startLine = 0;
+
+    /**
+     * Start lines revision of the buffer m_startLine was computed for.
+     */
+    mutable unsigned int m_startLineRevision = 0;
+
+    /**
+     * Cursors of this block, bucketed by their line in the block.
+     * Edits only need to look at the cursors of the changed line and the ones behind it.
+     * Might be shorter than the number of lines, missing trailing buckets are empty.
      * We need no sharing, use STL.
      */
-    std::unordered_set<TextCursor *> m_cursors;
+    std::vector<std::vector<TextCursor *> > m_cursorsPerLine;
+
+    /**
+     * Number of cursors in m_cursorsPerLine.
+     */
+    int m_cursorCount = 0;
 
     /**
      * Contains for each line-offset the ranges that were cached into it.
@@ -278,6 +532,22 @@ private:
      * This contains all the ranges that are not cached.
      */
     QSet<TextRange *> m_uncachedRanges;
+
+    /**
+     * Multi-line ranges intersecting all lines of this block, part of the index of m_uncachedRanges.
+     */
+    mutable std::vector<TextRange *> m_blockSpanningRanges;
+
+    /**
+     * Multi-line ranges starting or ending inside this block, in the bucket of each line they intersect.
+     * Might be shorter than the number of lines, missing trailing buckets are empty.
+     */
+    mutable std::vector<std::vector<TextRange *> > m_multiLineRangesPerLine;
+
+    /**
+     * Is the index of the multi-line ranges up-to-date?
+     */
+    mutable bool m_multiLineRangeIndexValid = true;
 };
 
 }
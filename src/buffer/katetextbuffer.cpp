@@ -44,6 +44,10 @@
 #include <QFileInfo>
 #include <QCryptographicHash>
 #include <QBuffer>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <functional>
 
 #if 0
 #define BUFFER_DEBUG qCDebug(LOG_KTE)
@@ -54,13 +58,161 @@
 namespace Kate
 {
 
+/**
+ * save: number of characters encoded and written at once
+ */
+static const int KATE_SAVE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+/**
+ * save: the encoded data of files up to this size is kept to compute the git digest at the end, larger ones are read again
+ */
+static const qint64 KATE_SAVE_DIGEST_BUFFER_SIZE = 64 * 1024 * 1024;
+
+/**
+ * block compression: maximal number of blocks compressed by one compressIdleBlocks() call
+ */
+static const int KATE_MAX_BLOCKS_COMPRESSED_PER_CALL = 8;
+
+/**
+ * Encode and write lines in large chunks, used by TextBuffer::save and TextBuffer::saveAsync.
+ * @param saveFile open device to write to, will be closed at the end
+ * @param totalLines number of lines to write
+ * @param appendLineText appends the text of a line to the chunk
+ * @param codec codec to encode with
+ * @param eol end of line string
+ * @param generateByteOrderMark write byte order mark?
+ * @param newLineAtEof add eol after the last line?
+ * @param digest set to the git digest of the written bytes, may be null, left empty if the file is too large
+ * @param contentHash set to the xxHash64 of the written bytes, may be null
+ * @param progress called with the number of written lines after each chunk, may be empty
+ * @return success
+ */
+static bool writeLines(KCompressionDevice *saveFile, int totalLines, const std::function<void(int, QString &)> &appendLineText, QTextCodec *codec,
+                       const QString &eol, bool generateByteOrderMark, bool newLineAtEof, QByteArray *digest, QByteArray *contentHash,
+                       const std::function<void(int)> &progress)
+{
+    // the git digest header needs the size, keep the encoded chunks until all is written
+    TextDigest fastDigest(TextDigest::XXHash64);
+    QVector<QByteArray> encodedChunks;
+    qint64 encodedSize = 0;
+    bool keepChunks = (digest != nullptr);
+
+    // same header handling as QTextStream
+    QTextCodec::ConverterState state(generateByteOrderMark ? QTextCodec::DefaultConversion : QTextCodec::IgnoreHeader);
+
+    // collect large chunks of text, encode and write them at once
+    QString chunk;
+    chunk.reserve(KATE_SAVE_CHUNK_SIZE + 1024);
+    for (int i = 0; i < totalLines; ++i) {
+        appendLineText(i, chunk);
+        if ((i + 1) < totalLines || newLineAtEof) {
+            chunk.append(eol);
+        }
+
+        if (chunk.size() >= KATE_SAVE_CHUNK_SIZE || (i + 1) == totalLines) {
+            const QByteArray encoded = codec->fromUnicode(chunk.constData(), chunk.size(), &state);
+            if (saveFile->write(encoded) != encoded.size()) {
+                return false;
+            }
+            chunk.clear();
+
+            // digests of exactly the bytes that end up on disk
+            encodedSize += encoded.size();
+            if (contentHash) {
+                fastDigest.addData(encoded.constData(), encoded.size());
+            }
+            if (keepChunks) {
+                if (encodedSize <= KATE_SAVE_DIGEST_BUFFER_SIZE) {
+                    encodedChunks.append(encoded);
+                } else {
+                    keepChunks = false;
+                    encodedChunks.clear();
+                }
+            }
+
+            if (progress) {
+                progress(i + 1);
+            }
+        }
+    }
+
+    // close the file, flushes the compression
+    saveFile->close();
+    if (saveFile->error() != QFileDevice::NoError) {
+        return false;
+    }
+
+    // now the size for the git header is known
+    if (keepChunks) {
+        TextDigest gitDigest(TextDigest::GitSha1);
+        gitDigest.reset(encodedSize);
+        for (const QByteArray &encoded : qAsConst(encodedChunks)) {
+            gitDigest.addData(encoded.constData(), encoded.size());
+        }
+        *digest = gitDigest.result();
+    }
+    if (contentHash) {
+        *contentHash = fastDigest.result();
+    }
+    return true;
+}
+
+/**
+ * Lines of one block in the snapshot of TextBuffer::saveAsync.
+ * Either the shared texts of the lines or, for compressed blocks, the shared compressed data.
+ */
+struct AsyncSaveBlock {
+    QVector<QString> lines;
+    QByteArray compressed;
+};
+
+/**
+ * Worker of TextBuffer::saveAsync, encodes and writes the snapshot of the lines.
+ * Only touches the given device + snapshot + digests, progress is reported to the buffer via queued calls.
+ * Compressed blocks are decoded here, one at a time.
+ */
+static bool writeLinesAsync(TextBuffer *buffer, KCompressionDevice *saveFile, const QVector<AsyncSaveBlock> &blocks, int totalLines, QTextCodec *codec,
+                            const QString &eol, bool generateByteOrderMark, bool newLineAtEof, QByteArray *digest, QByteArray *contentHash)
+{
+    // lines are requested in order, walk the blocks along
+    int block = -1;
+    int blockStartLine = 0;
+    const QVector<QString> *blockLines = nullptr;
+    QVector<QString> decodedLines;
+    auto appendLineText = [&](int line, QString &chunk) {
+        while (!blockLines || line - blockStartLine >= blockLines->size()) {
+            if (blockLines) {
+                blockStartLine += blockLines->size();
+            }
+            const AsyncSaveBlock &next = blocks.at(++block);
+            if (next.compressed.isEmpty()) {
+                blockLines = &next.lines;
+            } else {
+                decodedLines.clear();
+                TextBlock::appendCompressedLineTexts(next.compressed, decodedLines);
+                blockLines = &decodedLines;
+            }
+        }
+        chunk.append(blockLines->at(line - blockStartLine));
+    };
+
+    return writeLines(saveFile, totalLines, appendLineText, codec, eol,
+                      generateByteOrderMark, newLineAtEof, digest, contentHash, [buffer, totalLines](int savedLines) {
+        QMetaObject::invokeMethod(buffer, [buffer, savedLines, totalLines]() {
+            emit buffer->saveProgress(savedLines, totalLines);
+        }, Qt::QueuedConnection);
+    });
+}
+
 TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize, bool alwaysUseKAuth)
     : QObject(parent)
     , m_document(parent)
     , m_history(*this)
+    , m_initialBlockSize(blockSize)
     , m_blockSize(blockSize)
     , m_lines(0)
-    , m_lastUsedBlock(0)
+    , m_blockLinesTreeStep(0)
+    , m_startLinesRevision(1)
     , m_revision(0)
     , m_editingTransactions(0)
     , m_editingLastRevision(0)
@@ -72,13 +224,21 @@ TextBuffer::TextBuffer(KTextEditor::DocumentPrivate *parent, int blockSize, bool
     , m_textCodec(nullptr)
     , m_generateByteOrderMark(false)
     , m_endOfLineMode(eolUnix)
+    , m_mixedEndOfLines(false)
     , m_newLineAtEof(false)
     , m_lineLengthLimit(4096)
     , m_alwaysUseKAuthForSave(alwaysUseKAuth)
+    , m_asyncSaveRevision(-1)
 {
     // minimal block size must be > 0
     Q_ASSERT(m_blockSize > 0);
 
+    // finish background saves in the event loop
+    connect(&m_asyncSaveWatcher, &QFutureWatcherBase::finished, this, &TextBuffer::finishAsyncSave);
+
+    // compress idle blocks in the event loop, started by setBlockCompressionDelay()
+    connect(&m_blockCompressionTimer, &QTimer::timeout, this, &TextBuffer::compressIdleBlocks);
+
     // create initial state
     clear();
 }
@@ -91,6 +251,12 @@ TextBuffer::~TextBuffer()
     // not allowed during editing
     Q_ASSERT(m_editingTransactions == 0);
 
+    // let a running background save write the file completely
+    if (m_asyncSaveFile) {
+        m_asyncSaveFuture.waitForFinished();
+        m_asyncSaveFile.reset();
+    }
+
     // kill all ranges, work on copy, they will remove themself from the hash
     QSet<TextRange *> copyRanges = m_ranges;
     qDeleteAll(copyRanges);
@@ -126,6 +292,9 @@ void TextBuffer::clear()
     // not allowed during editing
     Q_ASSERT(m_editingTransactions == 0);
 
+    // revision is reset below, finish a running background save before
+    waitForAsyncSave();
+
     invalidateRanges();
 
     // new block for empty buffer
@@ -144,9 +313,12 @@ void TextBuffer::clear()
     // insert one block with one empty line
     m_blocks.append(newBlock);
 
-    // reset lines and last used block
+    // reset lines and start line index
     m_lines = 1;
-    m_lastUsedBlock = 0;
+    rebuildStartLines();
+
+    // reset block size, might have been enlarged by loading
+    m_blockSize = m_initialBlockSize;
 
     // reset revision
     m_revision = 0;
@@ -173,6 +345,15 @@ TextLine TextBuffer::line(int line) const
     return m_blocks.at(blockIndex)->line(line);
 }
 
+TextLineData *TextBuffer::lineData(int line) const
+{
+    // get block, this will assert on invalid line
+    int blockIndex = blockForLine(line);
+
+    // get line
+    return m_blocks.at(blockIndex)->lineData(line);
+}
+
 QString TextBuffer::text() const
 {
     QString text;
@@ -186,6 +367,169 @@ QString TextBuffer::text() const
     return text;
 }
 
+int TextBuffer::maximumLineLength() const
+{
+    // any tab width will do, prefer the one already computed
+    updateMaximumLineLengths(m_maximumLineLengthsTabWidth > 0 ? m_maximumLineLengthsTabWidth : 8);
+    return m_maximumLineLength;
+}
+
+int TextBuffer::maximumVirtualLineLength(int tabWidth) const
+{
+    updateMaximumLineLengths(tabWidth);
+    return m_maximumVirtualLineLength;
+}
+
+/**
+ * Count a block for a maximum: a longer line replaces the maximum, an equal one is one more block at it.
+ */
+static void countForMaximum(int length, int &maximum, int &blocks)
+{
+    if (length > maximum) {
+        maximum = length;
+        blocks = 1;
+    } else if (length == maximum) {
+        ++blocks;
+    }
+}
+
+void TextBuffer::updateMaximumLineLengths(int tabWidth) const
+{
+    // merge the changed blocks, the others are still counted
+    if (m_maximumLineLength >= 0 && tabWidth == m_maximumLineLengthsTabWidth) {
+        for (TextBlock *block : m_lineLengthsChangedBlocks) {
+            block->m_lineLengthsChanged = false;
+            countForMaximum(block->maximumLineLength(), m_maximumLineLength, m_maximumLineLengthBlocks);
+            countForMaximum(block->maximumVirtualLineLength(tabWidth), m_maximumVirtualLineLength, m_maximumVirtualLineLengthBlocks);
+        }
+        m_lineLengthsChangedBlocks.clear();
+
+        // still some block at the maximum, done
+        if (m_maximumLineLengthBlocks > 0 && m_maximumVirtualLineLengthBlocks > 0) {
+            return;
+        }
+    }
+
+    // first time, other tab width or the longest line got shorter: count all blocks, their cached lengths are reused
+    for (TextBlock *block : m_lineLengthsChangedBlocks) {
+        block->m_lineLengthsChanged = false;
+    }
+    m_lineLengthsChangedBlocks.clear();
+
+    m_maximumLineLength = 0;
+    m_maximumLineLengthBlocks = 0;
+    m_maximumVirtualLineLength = 0;
+    m_maximumVirtualLineLengthBlocks = 0;
+    m_maximumLineLengthsTabWidth = tabWidth;
+    for (const TextBlock *block : m_blocks) {
+        countForMaximum(block->maximumLineLength(), m_maximumLineLength, m_maximumLineLengthBlocks);
+        countForMaximum(block->maximumVirtualLineLength(tabWidth), m_maximumVirtualLineLength, m_maximumVirtualLineLengthBlocks);
+    }
+}
+
+void TextBuffer::blockLineLengthsChanged(TextBlock *block) const
+{
+    // nothing counted yet or block already waiting to be merged again
+    if (m_maximumLineLength < 0 || block->m_lineLengthsChanged) {
+        return;
+    }
+
+    // the block might no longer reach the maximum, it is counted again on the next query
+    if (block->m_maximumLineLength >= 0 && block->m_maximumLineLength == m_maximumLineLength) {
+        --m_maximumLineLengthBlocks;
+    }
+    if (block->m_maximumVirtualLineLength >= 0 && block->m_maximumVirtualLineLengthTabWidth == m_maximumLineLengthsTabWidth
+        && block->m_maximumVirtualLineLength == m_maximumVirtualLineLength) {
+        --m_maximumVirtualLineLengthBlocks;
+    }
+
+    block->m_lineLengthsChanged = true;
+    m_lineLengthsChangedBlocks.push_back(block);
+}
+
+void TextBuffer::blockDeleted(TextBlock *block) const
+{
+    block->m_lineLengthsChanged = false;
+    m_lineLengthsChangedBlocks.erase(std::remove(m_lineLengthsChangedBlocks.begin(), m_lineLengthsChangedBlocks.end(), block), m_lineLengthsChangedBlocks.end());
+}
+
+TextSnapshot TextBuffer::snapshot() const
+{
+    TextSnapshot snapshot;
+    snapshot.m_revision = m_revision;
+    snapshot.m_lines = m_lines;
+
+    // share the texts of all blocks, nothing is uncompressed
+    snapshot.m_blocks.reserve(m_blocks.size());
+    snapshot.m_blockStartLines.reserve(m_blocks.size());
+    for (TextBlock *block : m_blocks) {
+        snapshot.m_blockStartLines.append(block->startLine());
+        snapshot.m_blocks.append(block->snapshot());
+    }
+
+    return snapshot;
+}
+
+void TextBuffer::setBlockCompressionDelay(int seconds)
+{
+    m_blockCompressionDelay = qMax(0, seconds);
+
+    // a block is compressed after not being accessed during one full interval
+    if (m_blockCompressionDelay > 0) {
+        m_blockCompressionTimer.start(m_blockCompressionDelay * 1000);
+    } else {
+        m_blockCompressionTimer.stop();
+    }
+}
+
+int TextBuffer::compressIdleBlocks()
+{
+    // never touch the lines in the middle of an edit, retry after the next full delay
+    if (m_editingTransactions > 0) {
+        if (m_blockCompressionDelay > 0) {
+            m_blockCompressionTimer.start(m_blockCompressionDelay * 1000);
+        }
+        return 0;
+    }
+
+    // compress only a few blocks per call, each one takes some time
+    int compressed = 0;
+    while (m_blockCompressionIndex < m_blocks.size() && compressed < KATE_MAX_BLOCKS_COMPRESSED_PER_CALL) {
+        TextBlock *block = m_blocks.at(m_blockCompressionIndex++);
+        if (block->compressIfIdle()) {
+            ++compressed;
+            const int startLine = block->startLine();
+            emit linesCompressed(startLine, startLine + block->lines() - 1);
+        }
+    }
+
+    // round done: next one after the full delay, else continue with the next event loop iteration
+    const bool roundDone = m_blockCompressionIndex >= m_blocks.size();
+    if (roundDone) {
+        m_blockCompressionIndex = 0;
+    }
+    if (m_blockCompressionDelay > 0) {
+        m_blockCompressionTimer.start(roundDone ? m_blockCompressionDelay * 1000 : 0);
+    }
+
+    BUFFER_DEBUG << "compressed" << compressed << "idle blocks";
+    return compressed;
+}
+
+TextBuffer::CompressionStatistics TextBuffer::compressionStatistics() const
+{
+    CompressionStatistics statistics;
+    statistics.blocks = m_blocks.size();
+    for (const TextBlock *block : m_blocks) {
+        if (block->isCompressed()) {
+            ++statistics.compressedBlocks;
+            statistics.compressedBytes += block->compressedSize();
+            statistics.uncompressedBytes += block->uncompressedSize();
+        }
+    }
+    return statistics;
+}
+
 bool TextBuffer::startEditing()
 {
     // increment transaction counter
@@ -282,6 +626,146 @@ void TextBuffer::wrapLine(const KTextEditor::Cursor &position)
         emit m_document->KTextEditor::Document::lineWrapped(m_document, position);
 }
 
+bool TextBuffer::prepareEdits(QVector<Edit> &edits) const
+{
+    // validate all ranges against the current content
+    for (const Edit &edit : qAsConst(edits)) {
+        const KTextEditor::Range &range = edit.range;
+        if (!range.isValid() || range.end().line() >= m_lines
+            || range.start().column() > lineData(range.start().line())->length()
+            || range.end().column() > lineData(range.end().line())->length()) {
+            return false;
+        }
+    }
+
+    // back to front, on same start the larger range first
+    // reversed before the stable sort: insertions at the same position are applied last to first
+    std::reverse(edits.begin(), edits.end());
+    std::stable_sort(edits.begin(), edits.end(), [](const Edit &a, const Edit &b) {
+        if (a.range.start() != b.range.start()) {
+            return a.range.start() > b.range.start();
+        }
+        return a.range.end() > b.range.end();
+    });
+
+    // no overlaps allowed, the outcome would depend on the order
+    for (int i = 1; i < edits.size(); ++i) {
+        if (edits.at(i).range.end() > edits.at(i - 1).range.start()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TextBuffer::applyEdits(QVector<Edit> edits)
+{
+    if (!prepareEdits(edits)) {
+        return false;
+    }
+
+    applyPreparedEdits(edits);
+    return true;
+}
+
+void TextBuffer::applyPreparedEdits(const QVector<Edit> &edits)
+{
+    startEditing();
+
+    // buffers for the edits of one line, reused for all lines
+    QVector<KTextEditor::Range> lineRanges;
+    QStringList lineTexts;
+    QStringList removedTexts;
+
+    // block of the last line, single line edits don't move the block borders
+    int blockIndex = -1;
+
+    for (int e = 0; e < edits.size();) {
+        const KTextEditor::Cursor start = edits.at(e).range.start();
+        const KTextEditor::Cursor end = edits.at(e).range.end();
+
+        /**
+         * edits inside one line: collect all of them for this line and let the block apply them in one go
+         */
+        if (start.line() == end.line() && !edits.at(e).text.contains(QLatin1Char('\n'))) {
+            const int line = start.line();
+            lineRanges.resize(0);
+            lineTexts.clear();
+            for (; e < edits.size(); ++e) {
+                const Edit &edit = edits.at(e);
+                if (edit.range.start().line() != line || edit.range.end().line() != line || edit.text.contains(QLatin1Char('\n'))) {
+                    break;
+                }
+                lineRanges.append(edit.range);
+                lineTexts.append(edit.text);
+            }
+
+            if (blockIndex < 0 || line < m_blocks.at(blockIndex)->startLine()) {
+                blockIndex = blockForLine(line);
+            }
+            m_blocks.at(blockIndex)->replaceText(line, lineRanges, lineTexts, removedTexts);
+
+            // update changed line interval
+            if (line < m_editingMinimalLineChanged || m_editingMinimalLineChanged == -1) {
+                m_editingMinimalLineChanged = line;
+            }
+
+            if (line > m_editingMaximalLineChanged) {
+                m_editingMaximalLineChanged = line;
+            }
+
+            // one signal per done change, like removeText() + insertText(), replaceText() did the revisions
+            for (int i = 0; i < lineRanges.size(); ++i) {
+                const KTextEditor::Range &range = lineRanges.at(i);
+                if (!range.isEmpty()) {
+                    emit textRemoved(range, removedTexts.at(i));
+                    if (m_document)
+                        emit m_document->KTextEditor::Document::textRemoved(m_document, range, removedTexts.at(i));
+                }
+                if (!lineTexts.at(i).isEmpty()) {
+                    emit textInserted(range.start(), lineTexts.at(i));
+                    if (m_document)
+                        emit m_document->KTextEditor::Document::textInserted(m_document, range.start(), lineTexts.at(i));
+                }
+            }
+            continue;
+        }
+
+        /**
+         * edits spanning lines: wrap and unwrap them one by one, that moves the block borders
+         */
+        blockIndex = -1;
+
+        // remove the range: head of the last line, all lines in between, then the tail of the first line
+        if (start.line() == end.line()) {
+            removeText(edits.at(e).range);
+        } else {
+            removeText(KTextEditor::Range(KTextEditor::Cursor(end.line(), 0), end));
+            for (int line = end.line() - 1; line > start.line(); --line) {
+                removeText(KTextEditor::Range(line, 0, line, lineData(line)->length()));
+                unwrapLine(line + 1);
+            }
+            removeText(KTextEditor::Range(start, KTextEditor::Cursor(start.line(), lineData(start.line())->length())));
+            unwrapLine(start.line() + 1);
+        }
+
+        // insert the new text, wrapping at each newline
+        KTextEditor::Cursor position = start;
+        const QVector<QStringRef> parts = edits.at(e).text.splitRef(QLatin1Char('\n'));
+        for (int i = 0; i < parts.size(); ++i) {
+            if (i > 0) {
+                wrapLine(position);
+                position = KTextEditor::Cursor(position.line() + 1, 0);
+            }
+            insertText(position, parts.at(i).toString());
+            position.setColumn(position.column() + parts.at(i).size());
+        }
+        ++e;
+    }
+
+    finishEditing();
+}
+
 void TextBuffer::unwrapLine(int line)
 {
     // debug output for REAL low-level debugging
@@ -425,61 +909,34 @@ int TextBuffer::blockForLine(int line) const
         qFatal("out of range line requested in text buffer (%d out of [0, %d[)", line, lines());
     }
 
-    // we need blocks and last used block should not be negative
+    // we need blocks and an up-to-date index
     Q_ASSERT(!m_blocks.isEmpty());
-    Q_ASSERT(m_lastUsedBlock >= 0);
+    Q_ASSERT(m_blockLines.size() == size_t(m_blocks.size()));
 
     /**
-     * shortcut: try last block first
+     * search the block in the start line index
+     * descend the tree, summing up the lines of all blocks in front of the line
+     * empty blocks are skipped, as their start line is <= line, too
      */
-    if (m_lastUsedBlock < m_blocks.size()) {
-        /**
-         * check if block matches
-         * if yes, just return again this block
-         */
-        TextBlock *block = m_blocks[m_lastUsedBlock];
-        const int start = block->startLine();
-        const int lines = block->lines();
-        if (start <= line && line < (start + lines)) {
-            return m_lastUsedBlock;
+    const int blockCount = m_blocks.size();
+    int blockIndex = 0;
+    int remainingLines = line;
+    for (int step = m_blockLinesTreeStep; step > 0; step >>= 1) {
+        const int next = blockIndex + step;
+        if (next <= blockCount && m_blockLinesTree[next] <= remainingLines) {
+            blockIndex = next;
+            remainingLines -= m_blockLinesTree[next];
         }
     }
 
-    /**
-     * search for right block
-     * use binary search
-     * if we leave this loop not by returning the found element we have an error
-     */
-    int blockStart = 0;
-    int blockEnd = m_blocks.size() - 1;
-    while (blockEnd >= blockStart) {
-        // get middle and ensure it is OK
-        int middle = blockStart + ((blockEnd - blockStart) / 2);
-        Q_ASSERT(middle >= 0);
-        Q_ASSERT(middle < m_blocks.size());
-
-        // facts bout this block
-        TextBlock *block = m_blocks[middle];
-        const int start = block->startLine();
-        const int lines = block->lines();
-
-        // right block found, remember it and return it
-        if (start <= line && line < (start + lines)) {
-            m_lastUsedBlock = middle;
-            return middle;
-        }
-
-        // half our stuff ;)
-        if (line < start) {
-            blockEnd = middle - 1;
-        } else {
-            blockStart = middle + 1;
-        }
+    // we should always find a block
+    if (blockIndex >= blockCount) {
+        qFatal("line requested in text buffer (%d out of [0, %d[), no block found", line, lines());
+        return -1;
     }
 
-    // we should always find a block
-    qFatal("line requested in text buffer (%d out of [0, %d[), no block found", line, lines());
-    return -1;
+    Q_ASSERT(remainingLines < m_blocks[blockIndex]->lines());
+    return blockIndex;
 }
 
 void TextBuffer::fixStartLines(int startBlock)
@@ -487,19 +944,46 @@ void TextBuffer::fixStartLines(int startBlock)
     // only allow valid start block
     Q_ASSERT(startBlock >= 0);
     Q_ASSERT(startBlock < m_blocks.size());
+    Q_ASSERT(m_blockLines.size() == size_t(m_blocks.size()));
 
-    // new start line for next block
-    TextBlock *block = m_blocks.at(startBlock);
-    int newStartLine = block->startLine() + block->lines();
+    // only the line count of this block changed, update it in the tree, this moves all later blocks
+    const int delta = m_blocks.at(startBlock)->lines() - m_blockLines[startBlock];
+    if (delta == 0) {
+        return;
+    }
+
+    m_blockLines[startBlock] += delta;
+    ++m_startLinesRevision;
+    for (size_t i = startBlock + 1; i < m_blockLinesTree.size(); i += (i & -i)) {
+        m_blockLinesTree[i] += delta;
+    }
+}
 
-    // fixup block
-    for (int index = startBlock + 1; index < m_blocks.size(); ++index) {
-        // set new start line
-        block = m_blocks.at(index);
-        block->setStartLine(newStartLine);
+void TextBuffer::rebuildStartLines()
+{
+    const int blockCount = m_blocks.size();
+    m_blockLines.resize(blockCount);
+    m_blockLinesTree.assign(blockCount + 1, 0);
+    ++m_startLinesRevision;
+
+    // build the tree in linear time, each node passes its sum on to its parent
+    for (int index = 0; index < blockCount; ++index) {
+        TextBlock *block = m_blocks.at(index);
+        block->setBlockIndex(index);
+        m_blockLines[index] = block->lines();
+
+        const int node = index + 1;
+        m_blockLinesTree[node] += block->lines();
+        const int parent = node + (node & -node);
+        if (parent <= blockCount) {
+            m_blockLinesTree[parent] += m_blockLinesTree[node];
+        }
+    }
 
-        // calculate next start line
-        newStartLine += block->lines();
+    // start step for searches
+    m_blockLinesTreeStep = 1;
+    while (m_blockLinesTreeStep * 2 <= blockCount) {
+        m_blockLinesTreeStep *= 2;
     }
 }
 
@@ -515,10 +999,10 @@ void TextBuffer::balanceBlock(int index)
         // half the block
         int halfSize = blockToBalance->lines() / 2;
 
-        // create and insert new block behind current one, already set right start line
-        TextBlock *newBlock = blockToBalance->splitBlock(halfSize);
-        Q_ASSERT(newBlock);
+        // create and insert new block behind current one, the split will fill it and fix the start lines
+        TextBlock *newBlock = new TextBlock(this, index + 1);
         m_blocks.insert(m_blocks.begin() + index + 1, newBlock);
+        blockToBalance->splitBlock(halfSize, newBlock);
 
         // split is done
         return;
@@ -546,6 +1030,9 @@ void TextBuffer::balanceBlock(int index)
     // delete old block
     delete blockToBalance;
     m_blocks.erase(m_blocks.begin() + index);
+
+    // block removed, fix the start lines
+    rebuildStartLines();
 }
 
 void TextBuffer::debugPrint(const QString &title) const
@@ -577,6 +1064,13 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
      */
     Kate::TextLoader file(filename, m_encodingProberType);
 
+    /**
+     * adapt the block size to the file size, huge files would otherwise end up with a huge number of blocks
+     * estimate ~64 bytes per line and aim for at most 8192 blocks, but keep the blocks reasonable small for editing
+     */
+    const qint64 estimatedLines = QFileInfo(filename).size() / 64;
+    m_blockSize = qMax(m_initialBlockSize, int(qMin(estimatedLines / 8192, qint64(4096))));
+
     /**
      * triple play, maximal three loading rounds
      * 0) use the given encoding, be done, if no encoding errors happen
@@ -618,6 +1112,7 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
             // create one dummy textline, in any case
             m_blocks.last()->appendLine(QString());
             m_lines++;
+            rebuildStartLines();
             return false;
         }
 
@@ -688,7 +1183,7 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
                  * ensure blocks aren't too large
                  */
                 if (m_blocks.last()->lines() >= m_blockSize) {
-                    m_blocks.append(new TextBlock(this, m_blocks.last()->startLine() + m_blocks.last()->lines()));
+                    m_blocks.append(new TextBlock(this, m_blocks.size()));
                 }
 
                 /**
@@ -707,8 +1202,12 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
         }
     }
 
+    // blocks were appended, build the start line index
+    rebuildStartLines();
+
     // save checksum of file on disk
     setDigest(file.digest());
+    setContentHash(file.contentHash());
 
     // remember if BOM was found
     if (file.byteOrderMarkFound()) {
@@ -719,6 +1218,7 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
     if (file.eol() != eolUnknown) {
         setEndOfLineMode(file.eol());
     }
+    m_mixedEndOfLines = file.mixedEndOfLines();
 
     // remember mime type for filter device
     m_mimeTypeForFilterDev = file.mimeTypeForFilterDev();
@@ -732,6 +1232,9 @@ bool TextBuffer::load(const QString &filename, bool &encodingErrors, bool &tooLo
     // report BOM
     BUFFER_DEBUG << (file.byteOrderMarkFound() ? "Found" : "Didn't find") << "byte order mark";
 
+    // report mixed end of lines
+    BUFFER_DEBUG << (m_mixedEndOfLines ? "Found" : "Didn't find") << "mixed end of lines";
+
     // report filter device mime-type
     BUFFER_DEBUG << "used filter device for mime-type" << m_mimeTypeForFilterDev;
 
@@ -752,6 +1255,16 @@ void TextBuffer::setDigest(const QByteArray &checksum)
     m_digest = checksum;
 }
 
+const QByteArray &TextBuffer::contentHash() const
+{
+    return m_contentHash;
+}
+
+void TextBuffer::setContentHash(const QByteArray &contentHash)
+{
+    m_contentHash = contentHash;
+}
+
 void TextBuffer::setTextCodec(QTextCodec *codec)
 {
     m_textCodec = codec;
@@ -773,7 +1286,12 @@ bool TextBuffer::save(const QString &filename)
      */
     Q_ASSERT(m_textCodec);
 
-    SaveResult saveRes = saveBufferUnprivileged(filename);
+    // don't write the file concurrently with a background save
+    waitForAsyncSave();
+
+    QByteArray digest;
+    QByteArray contentHash;
+    SaveResult saveRes = saveBufferUnprivileged(filename, digest, contentHash);
 
     if (saveRes == SaveResult::Failed) {
         return false;
@@ -783,11 +1301,17 @@ bool TextBuffer::save(const QString &filename)
          * either unit-test mode or we're missing permissions to write to the
          * file => use temporary file and try to use authhelper
          */
-        if (!saveBufferEscalated(filename)) {
+        digest.clear();
+        contentHash.clear();
+        if (!saveBufferEscalated(filename, digest, contentHash)) {
             return false;
         }
     }
 
+    // digests computed while writing, if empty, the owner needs to compute them from the file on disk
+    setDigest(digest);
+    setContentHash(contentHash);
+
     // remember this revision as last saved
     m_history.setLastSavedRevision();
 
@@ -799,19 +1323,50 @@ bool TextBuffer::save(const QString &filename)
     return true;
 }
 
-bool TextBuffer::saveBuffer(const QString &filename, KCompressionDevice &saveFile)
+bool TextBuffer::saveAsync(const QString &filename)
 {
     /**
-     * construct stream + disable Unicode headers
+     * codec must be set, else below we fail!
      */
-    QTextStream stream(&saveFile);
-    stream.setCodec(QTextCodec::codecForName("UTF-16"));
+    Q_ASSERT(m_textCodec);
+
+    // only one background save at once
+    waitForAsyncSave();
+
+    // unit-testing mode, simulates missing permissions, needs save()
+    if (m_alwaysUseKAuthForSave) {
+        return false;
+    }
 
-    // set the correct codec
-    stream.setCodec(m_textCodec);
+    /**
+     * open the file here, errors are reported directly
+     * we try to use the same compression as for opening
+     */
+    const KCompressionDevice::CompressionType type = KFilterDev::compressionTypeForMimeType(m_mimeTypeForFilterDev);
+    QScopedPointer<KCompressionDevice> saveFile(new KCompressionDevice(filename, type));
+    if (!saveFile->open(QIODevice::WriteOnly)) {
+        BUFFER_DEBUG << "Background save of file " << filename << "failed to open the file";
+        return false;
+    }
 
-    // generate byte order mark?
-    stream.setGenerateByteOrderMark(generateByteOrderMark());
+    /**
+     * snapshot of all lines, the strings are implicitly shared
+     * compressed blocks stay compressed, their data is shared and decoded by the worker
+     * edits done during the save will detach them, the worker never sees them
+     */
+    QVector<AsyncSaveBlock> blocks;
+    blocks.reserve(m_blocks.size());
+    const int totalLines = m_lines;
+    for (const TextBlock *block : qAsConst(m_blocks)) {
+        AsyncSaveBlock saveBlock;
+        if (block->isCompressed()) {
+            saveBlock.compressed = block->compressedData();
+        } else {
+            saveBlock.lines.reserve(block->lines());
+            block->appendLineTexts(saveBlock.lines);
+        }
+        blocks.append(saveBlock);
+    }
 
     // our loved eol string ;)
     QString eol = QStringLiteral("\n");
@@ -821,54 +1376,115 @@ bool TextBuffer::saveBuffer(const QString &filename, KCompressionDevice &saveFil
         eol = QStringLiteral("\r");
     }
 
-    // just dump the lines out ;)
-    for (int i = 0; i < m_lines; ++i) {
-        // dump current line
-        stream << line(i)->text();
+    // do we need to add a trailing newline char?
+    bool newLineAtEof = false;
+    if (m_newLineAtEof) {
+        const Kate::TextLineData *lastLine = lineData(m_lines - 1);
+        newLineAtEof = (lastLine->firstChar() > -1 || lastLine->length() > 0);
+    }
 
-        // append correct end of line string
-        if ((i + 1) < m_lines) {
-            stream << eol;
-        }
+    // start the worker
+    m_asyncSaveFile.reset(saveFile.take());
+    m_asyncSaveFilename = filename;
+    m_asyncSaveRevision = revision();
+    KCompressionDevice *device = m_asyncSaveFile.data();
+    QTextCodec *codec = m_textCodec;
+    const bool generateBom = generateByteOrderMark();
+    const bool computeDigest = canDigestWhileSaving();
+    QByteArray *asyncDigest = &m_asyncSaveDigest;
+    QByteArray *asyncContentHash = &m_asyncSaveContentHash;
+    m_asyncSaveDigest.clear();
+    m_asyncSaveContentHash.clear();
+    m_asyncSaveFuture = QtConcurrent::run([this, device, blocks, totalLines, codec, eol, generateBom, newLineAtEof, computeDigest, asyncDigest, asyncContentHash]() {
+        return writeLinesAsync(this, device, blocks, totalLines, codec, eol, generateBom, newLineAtEof, computeDigest ? asyncDigest : nullptr,
+                               computeDigest ? asyncContentHash : nullptr);
+    });
+    m_asyncSaveWatcher.setFuture(m_asyncSaveFuture);
+    return true;
+}
 
-        // early out on stream errors
-        if (stream.status() != QTextStream::Ok) {
-            return false;
-        }
+void TextBuffer::waitForAsyncSave()
+{
+    if (!m_asyncSaveFile) {
+        return;
     }
 
-    // do we need to add a trailing newline char?
-    if (m_newLineAtEof) {
-        Q_ASSERT(m_lines > 0); // see .h file
-        const Kate::TextLine lastLine = line(m_lines - 1);
-        const int firstChar = lastLine->firstChar();
-        if (firstChar > -1 || lastLine->length() > 0) {
-            stream << eol;
+    m_asyncSaveFuture.waitForFinished();
+    finishAsyncSave();
+}
+
+void TextBuffer::finishAsyncSave()
+{
+    // already finished by waitForAsyncSave()?
+    if (!m_asyncSaveFile) {
+        return;
+    }
+
+    const bool success = m_asyncSaveFuture.result();
+    m_asyncSaveFile.reset();
+
+    if (success) {
+        // the snapshot revision is on disk, later edits keep the buffer modified
+        m_history.setLastSavedRevision(m_asyncSaveRevision);
+
+        // digests computed while writing, if empty, the owner needs to compute them from the file on disk
+        setDigest(m_asyncSaveDigest);
+        setContentHash(m_asyncSaveContentHash);
+
+        // without edits meanwhile, all lines are on disk now
+        if (m_asyncSaveRevision == revision()) {
+            markModifiedLinesAsSaved();
         }
+
+        emit saved(m_asyncSaveFilename);
+    } else {
+        BUFFER_DEBUG << "Background save of file " << m_asyncSaveFilename << "failed";
     }
 
-    // flush stream
-    stream.flush();
+    emit asyncSaveFinished(m_asyncSaveFilename, success);
+}
 
-    // only finalize if stream status == OK
-    if (stream.status() != QTextStream::Ok) {
-        return false;
+bool TextBuffer::canDigestWhileSaving() const
+{
+    // for compressed files, the digest is over the compressed data on disk
+    return KFilterDev::compressionTypeForMimeType(m_mimeTypeForFilterDev) == KCompressionDevice::None;
+}
+
+bool TextBuffer::saveBuffer(const QString &filename, KCompressionDevice &saveFile, QByteArray &digest, QByteArray &contentHash)
+{
+    // our loved eol string ;)
+    QString eol = QStringLiteral("\n");
+    if (endOfLineMode() == eolDos) {
+        eol = QStringLiteral("\r\n");
+    } else if (endOfLineMode() == eolMac) {
+        eol = QStringLiteral("\r");
     }
 
-    // close the file, we might want to read from underlying buffer below
-    saveFile.close();
+    // do we need to add a trailing newline char?
+    bool newLineAtEof = false;
+    if (m_newLineAtEof) {
+        Q_ASSERT(m_lines > 0); // see .h file
+        const Kate::TextLineData *lastLine = lineData(m_lines - 1);
+        newLineAtEof = (lastLine->firstChar() > -1 || lastLine->length() > 0);
+    }
+
+    // just dump the lines out ;)
+    // if possible, compute the digests of the written data on the fly, avoids reading the file again
+    const bool computeDigest = canDigestWhileSaving();
+    const bool success = writeLines(&saveFile, m_lines, [this](int line, QString &chunk) { lineData(line)->appendText(chunk); }, m_textCodec, eol,
+                                    generateByteOrderMark(), newLineAtEof, computeDigest ? &digest : nullptr, computeDigest ? &contentHash : nullptr,
+                                    std::function<void(int)>());
 
     // did save work?
-    if (saveFile.error() != QFileDevice::NoError) {
+    if (!success) {
         BUFFER_DEBUG << "Saving file " << filename << "failed with error" << saveFile.errorString();
         return false;
     }
-
     return true;
 }
 
 
-TextBuffer::SaveResult TextBuffer::saveBufferUnprivileged(const QString &filename)
+TextBuffer::SaveResult TextBuffer::saveBufferUnprivileged(const QString &filename, QByteArray &digest, QByteArray &contentHash)
 {
     if (m_alwaysUseKAuthForSave) {
         // unit-testing mode, simulate we need privileges
@@ -891,14 +1507,14 @@ TextBuffer::SaveResult TextBuffer::saveBufferUnprivileged(const QString &filenam
         return SaveResult::MissingPermissions;
     }
 
-    if (!saveBuffer(filename, *saveFile)) {
+    if (!saveBuffer(filename, *saveFile, digest, contentHash)) {
         return SaveResult::Failed;
     }
 
     return SaveResult::Success;
 }
 
-bool TextBuffer::saveBufferEscalated(const QString &filename)
+bool TextBuffer::saveBufferEscalated(const QString &filename, QByteArray &digest, QByteArray &contentHash)
 {
     /**
      * construct correct filter device
@@ -934,7 +1550,7 @@ bool TextBuffer::saveBufferEscalated(const QString &filename)
         return false;
     }
 
-    if( !saveBuffer(filename, *saveFile) ) {
+    if( !saveBuffer(filename, *saveFile, digest, contentHash) ) {
         return false;
     }
 
@@ -1025,42 +1641,11 @@ void TextBuffer::markModifiedLinesAsSaved()
 
 QList<TextRange *> TextBuffer::rangesForLine(int line, KTextEditor::View *view, bool rangesWithAttributeOnly) const
 {
-    // get block, this will assert on invalid line
-    const int blockIndex = blockForLine(line);
-
-    // get the ranges of the right block
+    // collect the ranges of the right block
     QList<TextRange *> rightRanges;
-    foreach (const QSet<TextRange *> &ranges, m_blocks.at(blockIndex)->rangesForLine(line)) {
-        foreach (TextRange *const range, ranges) {
-            /**
-            * we want only ranges with attributes, but this one has none
-            */
-            if (rangesWithAttributeOnly && !range->hasAttribute()) {
-                continue;
-            }
-
-            /**
-            * we want ranges for no view, but this one's attribute is only valid for views
-            */
-            if (!view && range->attributeOnlyForViews()) {
-                continue;
-            }
-
-            /**
-            * the range's attribute is not valid for this view
-            */
-            if (range->view() && range->view() != view) {
-                continue;
-            }
-
-            /**
-            * if line is in the range, ok
-            */
-            if (range->startInternal().lineInternal() <= line && line <= range->endInternal().lineInternal()) {
-                rightRanges.append(range);
-            }
-        }
-    }
+    forEachRangeForLine(line, view, rangesWithAttributeOnly, [&rightRanges](TextRange *range) {
+        rightRanges.append(range);
+    });
 
     // return right ranges
     return rightRanges;
@@ -26,6 +26,10 @@
 #include <QVector>
 #include <QSet>
 #include <QTextCodec>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QScopedPointer>
+#include <QTimer>
 
 #include <ktexteditor/document.h>
 
@@ -35,6 +39,8 @@
 #include "katetextcursor.h"
 #include "katetextrange.h"
 #include "katetexthistory.h"
+#include "katetextdigest.h"
+#include "katetextsnapshot.h"
 
 // encoding prober
 #include <KEncodingProber>
@@ -181,6 +187,15 @@ public:
         return m_endOfLineMode;
     }
 
+    /**
+     * Did the last loaded file contain different kinds of end of lines?
+     * @return mixed end of lines found on load
+     */
+    bool mixedEndOfLines() const
+    {
+        return m_mixedEndOfLines;
+    }
+
     /**
      * Set whether to insert a newline character on save at the end of the file
      * @param newlineAtEof should newline be added if non-existing
@@ -222,6 +237,33 @@ public:
      */
     virtual bool save(const QString &filename);
 
+    /**
+     * Save the current buffer content to the given file in the background.
+     * A snapshot of all lines is taken, encoding and writing happen in a worker thread,
+     * the buffer stays editable meanwhile. Edits done during the save are not part of the file,
+     * the last saved revision is the revision of the snapshot.
+     * Files that need elevated privileges are not supported, use save() for them.
+     * Emits saveProgress() while saving and saved() + asyncSaveFinished() at the end.
+     * Before calling this, setTextCodec and setFallbackTextCodec must have been used to set codec!
+     * @param filename file to save
+     * @return true if the save was started
+     */
+    bool saveAsync(const QString &filename);
+
+    /**
+     * Is a background save running?
+     * @return background save running
+     */
+    bool isSavingAsync() const
+    {
+        return !m_asyncSaveFile.isNull();
+    }
+
+    /**
+     * Block until a running background save is done, finishes it like it would be done by the event loop.
+     */
+    void waitForAsyncSave();
+
     /**
      * Lines currently stored in this buffer.
      * This is never 0, even clear will let one empty line remain.
@@ -249,12 +291,47 @@ public:
      */
     TextLine line(int line) const;
 
+    /**
+     * Retrieve a text line without touching the reference count, for internal read paths.
+     * The returned pointer is borrowed, it is only valid until the next edit of the buffer
+     * and must not be kept across the event loop, idle blocks might get compressed.
+     * Use line() if the line must be kept around.
+     * @param line wanted line number
+     * @return text line data
+     */
+    TextLineData *lineData(int line) const;
+
     /**
      * Retrieve text of complete buffer.
      * @return text for this buffer, lines separated by '\n'
      */
     QString text() const;
 
+    /**
+     * Length of the longest line of the buffer.
+     * The buffer keeps the maximum and the number of blocks reaching it, after an edit only the changed
+     * blocks are scanned. Only if the longest line got shorter, the cached maxima of all blocks are compared.
+     * @return maximal line length in characters
+     */
+    int maximumLineLength() const;
+
+    /**
+     * Length of the longest line of the buffer with each tab expanded to the next tab stop.
+     * Kept up to date like maximumLineLength(), a change of the tab width rescans all lines once.
+     * @param tabWidth tab width used to expand the tabs
+     * @return maximal virtual line length
+     */
+    int maximumVirtualLineLength(int tabWidth) const;
+
+    /**
+     * Take an immutable snapshot of the text of the current revision.
+     * The snapshot shares the texts of all lines with the buffer, only the lists of lines are created,
+     * compressed blocks are decoded without uncompressing them. It may be read from other threads.
+     * Must be called from the thread owning the buffer, not during an editing transaction.
+     * @return snapshot of the current text
+     */
+    TextSnapshot snapshot() const;
+
     /**
      * Start an editing transaction, the wrapLine/unwrapLine/insertText and removeText functions
      * are only allowed to be called inside a editing transaction.
@@ -365,6 +442,40 @@ public:
      */
     virtual void removeText(const KTextEditor::Range &range);
 
+    /**
+     * One edit of a batch, replaces the text in the range with the given text.
+     * Empty ranges insert, empty texts remove.
+     */
+    struct Edit {
+        KTextEditor::Range range;
+        QString text;
+    };
+
+    /**
+     * Validate a batch of edits and sort it for applying.
+     * All ranges refer to the buffer before any edit of the batch is applied and must not overlap.
+     * The edits are sorted back to front, that way applying one doesn't move the positions of
+     * the following ones. Insertions at the same position end up in the given order.
+     * @param edits edits to validate, will be sorted for applying
+     * @return edits valid and not overlapping
+     */
+    bool prepareEdits(QVector<Edit> &edits) const;
+
+    /**
+     * Apply a batch of edits in one editing transaction, see prepareEdits() for the rules.
+     * Only one editingStarted() + editingFinished() is emitted for the complete batch.
+     * @param edits edits to apply
+     * @return success, nothing is changed for invalid edits
+     */
+    bool applyEdits(QVector<Edit> edits);
+
+    /**
+     * Apply a batch of edits already validated and sorted by prepareEdits().
+     * Edits inside one line are applied per line in one go, each block touched once for them.
+     * @param edits edits as returned by prepareEdits()
+     */
+    void applyPreparedEdits(const QVector<Edit> &edits);
+
     /**
      * TextHistory of this buffer
      * @return text history for this buffer
@@ -394,6 +505,20 @@ Q_SIGNALS:
      */
     void saved(const QString &filename);
 
+    /**
+     * Progress of a background save started with saveAsync().
+     * @param savedLines number of lines already written
+     * @param totalLines number of lines of the snapshot
+     */
+    void saveProgress(int savedLines, int totalLines);
+
+    /**
+     * Background save started with saveAsync() is done.
+     * @param filename file which was saved
+     * @param success did the save work?
+     */
+    void asyncSaveFinished(const QString &filename, bool success);
+
     /**
      * Editing transaction has started.
      */
@@ -430,6 +555,15 @@ Q_SIGNALS:
      */
     void textRemoved(const KTextEditor::Range &range, const QString &text);
 
+    /**
+     * Lines got compressed in memory, see compressIdleBlocks().
+     * TextLine objects of them kept elsewhere are no longer the ones of the buffer,
+     * the lines are recreated on the next access and must be fetched again.
+     * @param fromLine first compressed line
+     * @param toLine last compressed line
+     */
+    void linesCompressed(int fromLine, int toLine);
+
 private:
 
     /**
@@ -450,11 +584,52 @@ private:
     int blockForLine(int line) const;
 
     /**
-     * Fix start lines of all blocks after the given one
+     * Fix start lines of all blocks after the given one.
+     * Only the line count of the given block is allowed to have changed, O(log(blocks)).
      * @param startBlock index of block from which we start to fix
      */
     void fixStartLines(int startBlock);
 
+    /**
+     * The lines of a block changed, called by the block before it drops its cached line lengths.
+     * If the block was counted for the maximal line lengths, it is not any longer.
+     * @param block changed block
+     */
+    void blockLineLengthsChanged(TextBlock *block) const;
+
+    /**
+     * A block with changed line lengths is deleted, forget it.
+     * @param block deleted block
+     */
+    void blockDeleted(TextBlock *block) const;
+
+    /**
+     * Bring the maximal line lengths up to date, merges the changed blocks.
+     * @param tabWidth tab width for the virtual line length
+     */
+    void updateMaximumLineLengths(int tabWidth) const;
+
+    /**
+     * Rebuild the start line index from scratch, needed after blocks got inserted or removed.
+     * Updates the block indices of all blocks, too.
+     */
+    void rebuildStartLines();
+
+    /**
+     * Start line of the block with the given index.
+     * @param index block index
+     * @return start line of the block
+     */
+    int startLineOfBlock(int index) const
+    {
+        // prefix sum of the line counts of all blocks in front of this one
+        int startLine = 0;
+        for (int i = index; i > 0; i -= (i & -i)) {
+            startLine += m_blockLinesTree[i];
+        }
+        return startLine;
+    }
+
     /**
      * Balance the given block. Look if it is too small or too large.
      * @param index block to balance
@@ -490,20 +665,34 @@ private:
      *
      * @param filename path name for display/debugging purposes
      * @param saveFile open device to write the buffer to
+     * @param digest git digest of the written file, computed while writing if possible, else left empty
+     * @param contentHash xxHash64 of the written file, computed while writing if possible, else left empty
      */
-    bool saveBuffer(const QString &filename, KCompressionDevice &saveFile);
+    bool saveBuffer(const QString &filename, KCompressionDevice &saveFile, QByteArray &digest, QByteArray &contentHash);
 
     /**
      * Attempt to save the buffer content in the given filename location using
      * current privileges.
      */
-    SaveResult saveBufferUnprivileged(const QString &filename);
+    SaveResult saveBufferUnprivileged(const QString &filename, QByteArray &digest, QByteArray &contentHash);
 
     /**
      * Attempt to save the buffer content in the given filename location using
      * escalated privileges.
      */
-    bool saveBufferEscalated(const QString &filename);
+    bool saveBufferEscalated(const QString &filename, QByteArray &digest, QByteArray &contentHash);
+
+    /**
+     * Can the digests of the file be computed while writing it?
+     * Only possible for uncompressed files.
+     * @return digest can be computed on the fly
+     */
+    bool canDigestWhileSaving() const;
+
+    /**
+     * Finish the running background save, called once the worker is done.
+     */
+    void finishAsyncSave();
 
 public:
     /**
@@ -530,6 +719,50 @@ public:
      */
     QList<TextRange *> rangesForLine(int line, KTextEditor::View *view, bool rangesWithAttributeOnly) const;
 
+    /**
+     * Call the visitor for each range which affects the given line, same ranges as rangesForLine().
+     * Doesn't allocate, use this on hot paths like painting.
+     * The visitor must not modify or delete ranges or modify the buffer.
+     * @param line line to look at
+     * @param view only visit ranges associated with given view
+     * @param rangesWithAttributeOnly only visit ranges which have a attribute set
+     * @param visitor callable taking a TextRange *
+     */
+    template<typename Visitor>
+    void forEachRangeForLine(int line, KTextEditor::View *view, bool rangesWithAttributeOnly, Visitor &&visitor) const
+    {
+        // get block, this will assert on invalid line
+        m_blocks.at(blockForLine(line))->forEachRangeForLine(line, [line, view, rangesWithAttributeOnly, &visitor](TextRange *range) {
+            /**
+            * we want only ranges with attributes, but this one has none
+            */
+            if (rangesWithAttributeOnly && !range->hasAttribute()) {
+                return;
+            }
+
+            /**
+            * we want ranges for no view, but this one's attribute is only valid for views
+            */
+            if (!view && range->attributeOnlyForViews()) {
+                return;
+            }
+
+            /**
+            * the range's attribute is not valid for this view
+            */
+            if (range->view() && range->view() != view) {
+                return;
+            }
+
+            /**
+            * if line is in the range, ok
+            */
+            if (range->startInternal().lineInternal() <= line && line <= range->endInternal().lineInternal()) {
+                visitor(range);
+            }
+        });
+    }
+
     /**
      * Check if the given range pointer is still valid.
      * @return range pointer still belongs to range for this buffer
@@ -544,6 +777,82 @@ public:
      */
     void invalidateRanges();
 
+    //
+    // compression of idle blocks
+    //
+public:
+    /**
+     * Memory statistics of the block compression.
+     */
+    struct CompressionStatistics {
+        /**
+         * number of blocks of the buffer
+         */
+        int blocks = 0;
+
+        /**
+         * number of compressed blocks
+         */
+        int compressedBlocks = 0;
+
+        /**
+         * size of the compressed data of all compressed blocks
+         */
+        qint64 compressedBytes = 0;
+
+        /**
+         * size of the data of all compressed blocks before compression
+         */
+        qint64 uncompressedBytes = 0;
+    };
+
+    /**
+     * Set after which time unused blocks are compressed in memory.
+     * Compressed blocks are transparently uncompressed on the next access of one of their lines.
+     * @param seconds blocks not accessed for this time are compressed, 0 disables the compression
+     */
+    void setBlockCompressionDelay(int seconds);
+
+    /**
+     * Get the delay after which unused blocks are compressed.
+     * @return delay in seconds, 0 if disabled
+     */
+    int blockCompressionDelay() const
+    {
+        return m_blockCompressionDelay;
+    }
+
+    /**
+     * Compress the blocks that were not accessed since they were last visited.
+     * One round visits all blocks, a call compresses at most a few of them and the next call
+     * continues the round, like that the event loop is never blocked for long.
+     * Called periodically if a compression delay is set, does nothing during editing transactions.
+     * @return number of blocks compressed by this call
+     */
+    int compressIdleBlocks();
+
+    /**
+     * Current memory statistics of the block compression.
+     * @return statistics for all blocks of this buffer
+     */
+    CompressionStatistics compressionStatistics() const;
+
+private:
+    /**
+     * delay for the block compression in seconds, 0 if disabled
+     */
+    int m_blockCompressionDelay = 0;
+
+    /**
+     * timer triggering compressIdleBlocks()
+     */
+    QTimer m_blockCompressionTimer;
+
+    /**
+     * index of the block the running compression round continues with
+     */
+    int m_blockCompressionIndex = 0;
+
     //
     // checksum handling
     //
@@ -562,8 +871,22 @@ public:
      */
     void setDigest(const QByteArray &checksum);
 
+    /**
+     * Fast xxHash64 of the document on disk, computed together with digest().
+     * Only for internal checks if the file on disk changed, never exported.
+     * @return content hash, empty if unknown
+     */
+    const QByteArray &contentHash() const;
+
+    /**
+     * Set the content hash of this buffer, see contentHash().
+     * @param contentHash xxHash64 of the document on disk
+     */
+    void setContentHash(const QByteArray &contentHash);
+
 private:
     QByteArray m_digest;
+    QByteArray m_contentHash;
 
 private:
     /**
@@ -576,10 +899,16 @@ private:
      */
     TextHistory m_history;
 
+    /**
+     * block size in lines the buffer was constructed with
+     */
+    const int m_initialBlockSize;
+
     /**
      * block size in lines the buffer will try to hold
+     * enlarged on load of large files to avoid too many blocks
      */
-    const int m_blockSize;
+    int m_blockSize;
 
     /**
      * List of blocks which contain the lines of this buffer
@@ -592,10 +921,56 @@ private:
     int m_lines;
 
     /**
-     * Last used block in the buffer. Is used for speeding up blockForLine.
-     * May contain invalid index, must be checked before using.
+     * Line count of each block, as known by the start line index.
      */
-    mutable int m_lastUsedBlock;
+    std::vector<int> m_blockLines;
+
+    /**
+     * Fenwick tree over m_blockLines, index 1 based.
+     * Allows to get the start line of a block and the block of a line in O(log(blocks)).
+     */
+    std::vector<int> m_blockLinesTree;
+
+    /**
+     * Largest power of two <= number of blocks, start step for searches in m_blockLinesTree.
+     */
+    int m_blockLinesTreeStep;
+
+    /**
+     * Incremented each time the start line of any block changes.
+     * Blocks cache their start line and only query the index again if this changed.
+     */
+    unsigned int m_startLinesRevision;
+
+    /**
+     * Length of the longest line, -1 if not yet computed.
+     */
+    mutable int m_maximumLineLength = -1;
+
+    /**
+     * Number of blocks not in m_lineLengthsChangedBlocks with a longest line of m_maximumLineLength.
+     */
+    mutable int m_maximumLineLengthBlocks = 0;
+
+    /**
+     * Length of the longest line with tabs expanded, valid together with m_maximumLineLength.
+     */
+    mutable int m_maximumVirtualLineLength = 0;
+
+    /**
+     * Number of blocks not in m_lineLengthsChangedBlocks with a longest virtual line of m_maximumVirtualLineLength.
+     */
+    mutable int m_maximumVirtualLineLengthBlocks = 0;
+
+    /**
+     * Tab width m_maximumVirtualLineLength was computed for.
+     */
+    mutable int m_maximumLineLengthsTabWidth = 0;
+
+    /**
+     * Blocks modified since the maxima were updated, their lengths are merged on the next query.
+     */
+    mutable std::vector<TextBlock *> m_lineLengthsChangedBlocks;
 
     /**
      * Revision of the buffer.
@@ -669,6 +1044,11 @@ private:
      */
     EndOfLineMode m_endOfLineMode;
 
+    /**
+     * Did the last loaded file contain mixed end of lines?
+     */
+    bool m_mixedEndOfLines;
+
     /**
      * Insert newline character at the end of the file?
      */
@@ -688,6 +1068,41 @@ private:
      * For copying QBuffer -> QTemporaryFile while saving document in privileged mode
      */
     static const qint64 bufferLength = 4096;
+
+    /**
+     * Device written by a running background save, nullptr if none running
+     */
+    QScopedPointer<KCompressionDevice> m_asyncSaveFile;
+
+    /**
+     * File name of the running background save
+     */
+    QString m_asyncSaveFilename;
+
+    /**
+     * Revision of the snapshot written by the running background save
+     */
+    qint64 m_asyncSaveRevision;
+
+    /**
+     * Worker of the running background save
+     */
+    QFuture<bool> m_asyncSaveFuture;
+
+    /**
+     * Digest computed by the worker of the background save, only valid once it is done
+     */
+    QByteArray m_asyncSaveDigest;
+
+    /**
+     * Content hash computed by the worker of the background save, only valid once it is done
+     */
+    QByteArray m_asyncSaveContentHash;
+
+    /**
+     * Watcher to finish the background save in the event loop
+     */
+    QFutureWatcher<bool> m_asyncSaveWatcher;
 };
 
 }
@@ -66,7 +66,8 @@ TextCursor::~TextCursor()
 
 void TextCursor::setPosition(const TextCursor &position)
 {
-    if (m_block && m_block != position.m_block) {
+    // always remove, the block keeps its cursors sorted by line
+    if (m_block) {
         m_block->removeCursor(this);
     }
 
@@ -0,0 +1,221 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katetextdigest.h"
+
+#include <QFile>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace Kate
+{
+
+/**
+ * xxHash64 primes
+ */
+static const quint64 XXH_PRIME64_1 = 11400714785074694791ULL;
+static const quint64 XXH_PRIME64_2 = 14029467366897019727ULL;
+static const quint64 XXH_PRIME64_3 = 1609587929392839161ULL;
+static const quint64 XXH_PRIME64_4 = 9650029242287828579ULL;
+static const quint64 XXH_PRIME64_5 = 2870177450012600261ULL;
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 xxhRound(quint64 accumulator, quint64 input)
+{
+    accumulator += input * XXH_PRIME64_2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * XXH_PRIME64_1;
+}
+
+static inline quint64 xxhMergeRound(quint64 accumulator, quint64 value)
+{
+    accumulator ^= xxhRound(0, value);
+    return accumulator * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+TextDigest::TextDigest(Algorithm algorithm)
+    : m_algorithm(algorithm)
+    , m_sha1(QCryptographicHash::Sha1)
+    , m_totalLength(0)
+    , m_pendingSize(0)
+{
+    reset(0);
+}
+
+void TextDigest::reset(qint64 size)
+{
+    if (m_algorithm == GitSha1) {
+        // init the hash with the git header
+        const QString header = QStringLiteral("blob %1").arg(size);
+        m_sha1.reset();
+        m_sha1.addData(header.toLatin1() + '\0');
+        return;
+    }
+
+    // xxHash64 with seed 0
+    m_accumulators[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    m_accumulators[1] = XXH_PRIME64_2;
+    m_accumulators[2] = 0;
+    m_accumulators[3] = 0 - XXH_PRIME64_1;
+    m_totalLength = 0;
+    m_pendingSize = 0;
+}
+
+void TextDigest::processStripe(const uchar *data)
+{
+    for (int i = 0; i < 4; ++i) {
+        m_accumulators[i] = xxhRound(m_accumulators[i], qFromLittleEndian<quint64>(data + 8 * i));
+    }
+}
+
+void TextDigest::addData(const char *data, int length)
+{
+    if (m_algorithm == GitSha1) {
+        m_sha1.addData(data, length);
+        return;
+    }
+
+    const uchar *input = reinterpret_cast<const uchar *>(data);
+    m_totalLength += length;
+
+    // fill up pending bytes first
+    if (m_pendingSize > 0) {
+        const int missing = qMin(32 - m_pendingSize, length);
+        memcpy(m_pending + m_pendingSize, input, missing);
+        m_pendingSize += missing;
+        input += missing;
+        length -= missing;
+        if (m_pendingSize < 32) {
+            return;
+        }
+        processStripe(m_pending);
+        m_pendingSize = 0;
+    }
+
+    // full stripes directly from the input
+    while (length >= 32) {
+        processStripe(input);
+        input += 32;
+        length -= 32;
+    }
+
+    // remember the rest
+    memcpy(m_pending, input, length);
+    m_pendingSize = length;
+}
+
+QByteArray TextDigest::result() const
+{
+    if (m_algorithm == GitSha1) {
+        return m_sha1.result();
+    }
+
+    quint64 hash;
+    if (m_totalLength >= 32) {
+        hash = rotateLeft(m_accumulators[0], 1) + rotateLeft(m_accumulators[1], 7) + rotateLeft(m_accumulators[2], 12) + rotateLeft(m_accumulators[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            hash = xxhMergeRound(hash, m_accumulators[i]);
+        }
+    } else {
+        hash = XXH_PRIME64_5;
+    }
+    hash += m_totalLength;
+
+    // remaining bytes
+    const uchar *rest = m_pending;
+    int length = m_pendingSize;
+    while (length >= 8) {
+        hash ^= xxhRound(0, qFromLittleEndian<quint64>(rest));
+        hash = rotateLeft(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        rest += 8;
+        length -= 8;
+    }
+    if (length >= 4) {
+        hash ^= quint64(qFromLittleEndian<quint32>(rest)) * XXH_PRIME64_1;
+        hash = rotateLeft(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        rest += 4;
+        length -= 4;
+    }
+    while (length > 0) {
+        hash ^= (*rest) * XXH_PRIME64_5;
+        hash = rotateLeft(hash, 11) * XXH_PRIME64_1;
+        ++rest;
+        --length;
+    }
+
+    // avalanche
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    // canonical big endian representation
+    QByteArray digest(8, Qt::Uninitialized);
+    qToBigEndian(hash, digest.data());
+    return digest;
+}
+
+QByteArray TextDigest::digestForFile(const QString &filename, Algorithm algorithm)
+{
+    QFile f(filename);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    TextDigest digest(algorithm);
+    digest.reset(f.size());
+    while (!f.atEnd()) {
+        const QByteArray data = f.read(256 * 1024);
+        digest.addData(data.constData(), data.size());
+    }
+
+    return digest.result();
+}
+
+bool TextDigest::digestsForFile(const QString &filename, QByteArray &gitDigest, QByteArray &contentHash)
+{
+    gitDigest.clear();
+    contentHash.clear();
+    QFile f(filename);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    TextDigest git(GitSha1);
+    TextDigest fast(XXHash64);
+    git.reset(f.size());
+    while (!f.atEnd()) {
+        const QByteArray data = f.read(256 * 1024);
+        git.addData(data.constData(), data.size());
+        fast.addData(data.constData(), data.size());
+    }
+
+    gitDigest = git.result();
+    contentHash = fast.result();
+    return true;
+}
+
+}
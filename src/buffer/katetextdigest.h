@@ -0,0 +1,134 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_TEXTDIGEST_H
+#define KATE_TEXTDIGEST_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+
+#include <ktexteditor_export.h>
+
+namespace Kate
+{
+
+/**
+ * Digest of a file on disk, computed incrementally while loading/saving it.
+ * Either git compatible (sha1 over "blob <size>\0" + content) or a fast non-cryptographic xxHash64.
+ */
+class KTEXTEDITOR_EXPORT TextDigest
+{
+public:
+    /**
+     * Supported digest algorithms
+     */
+    enum Algorithm {
+        GitSha1 = 0,
+        XXHash64 = 1
+    };
+
+    /**
+     * Construct digest.
+     * @param algorithm algorithm to use
+     */
+    explicit TextDigest(Algorithm algorithm = GitSha1);
+
+    /**
+     * Used algorithm
+     * @return algorithm of this digest
+     */
+    Algorithm algorithm() const
+    {
+        return m_algorithm;
+    }
+
+    /**
+     * Does the algorithm need the size of the data before the data itself?
+     * True for the git compatible sha1, its header contains the size.
+     * @return size needed in advance
+     */
+    bool needsSizeInAdvance() const
+    {
+        return m_algorithm == GitSha1;
+    }
+
+    /**
+     * Start a new digest.
+     * @param size size of the complete data, only used for the git header
+     */
+    void reset(qint64 size);
+
+    /**
+     * Add data to the digest.
+     * @param data data to add
+     * @param length length of data
+     */
+    void addData(const char *data, int length);
+
+    /**
+     * Result of the digest over all added data.
+     * @return digest, 20 bytes for sha1, 8 bytes for xxHash64
+     */
+    QByteArray result() const;
+
+    /**
+     * Compute the digest of a file on disk.
+     * @param filename file to read
+     * @param algorithm algorithm to use
+     * @return digest or empty array if the file can't be read
+     */
+    static QByteArray digestForFile(const QString &filename, Algorithm algorithm);
+
+    /**
+     * Compute the git digest and the xxHash64 of a file on disk, reading it once.
+     * @param filename file to read
+     * @param gitDigest set to the git compatible sha1
+     * @param contentHash set to the xxHash64
+     * @return success, if false, both are empty
+     */
+    static bool digestsForFile(const QString &filename, QByteArray &gitDigest, QByteArray &contentHash);
+
+private:
+    /**
+     * Process one 32 byte stripe of xxHash64.
+     * @param data stripe
+     */
+    void processStripe(const uchar *data);
+
+private:
+    Algorithm m_algorithm;
+
+    /**
+     * git compatible sha1 state
+     */
+    QCryptographicHash m_sha1;
+
+    /**
+     * xxHash64 state: accumulators, total length and not yet processed bytes
+     */
+    quint64 m_accumulators[4];
+    quint64 m_totalLength;
+    uchar m_pending[32];
+    int m_pendingSize;
+};
+
+}
+
+#endif
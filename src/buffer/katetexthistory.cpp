@@ -20,6 +20,52 @@
 
 #include "katetexthistory.h"
 #include "katetextbuffer.h"
+#include "katepartdebug.h"
+
+#include <algorithm>
+
+namespace
+{
+
+/**
+ * Fenwick tree holding pending line deltas during a batch transformation.
+ * A delta added at some index applies to all cursors from that index on.
+ */
+class LineDeltas
+{
+public:
+    explicit LineDeltas(int size)
+        : m_tree(size + 1, 0)
+    {
+    }
+
+    /**
+     * add delta to all cursors starting with the given index
+     */
+    void addFrom(int index, int delta)
+    {
+        for (++index; index < int(m_tree.size()); index += index & -index) {
+            m_tree[index] += delta;
+        }
+    }
+
+    /**
+     * accumulated delta for the cursor with the given index
+     */
+    int at(int index) const
+    {
+        int delta = 0;
+        for (++index; index > 0; index -= index & -index) {
+            delta += m_tree[index];
+        }
+        return delta;
+    }
+
+private:
+    std::vector<int> m_tree;
+};
+
+}
 
 namespace Kate
 {
@@ -27,7 +73,12 @@ namespace Kate
 TextHistory::TextHistory(TextBuffer &buffer)
     : m_buffer(buffer)
     , m_lastSavedRevision(-1)
-    , m_firstHistoryEntryRevision(0)
+    , m_compactionEnabled(false)
+    , m_memoryLimit(0)
+    , m_expiredRevision(-1)
+    , m_expiredReferences(0)
+    , m_compactedReferences(0)
+    , m_discardedEntries(0)
 {
     // just call clear to init
     clear();
@@ -50,10 +101,14 @@ void TextHistory::clear()
 
     // remove all history entries and add no-change dummy for first revision
     m_historyEntries.clear();
+    // first entry will again belong to first revision
     m_historyEntries.push_back(Entry());
 
-    // first entry will again belong to first revision
-    m_firstHistoryEntryRevision = 0;
+    // nothing expired anymore
+    m_expiredRevision = -1;
+    m_expiredReferences = 0;
+    m_compactedReferences = 0;
+    m_discardedEntries = 0;
 }
 
 void TextHistory::setLastSavedRevision()
@@ -62,6 +117,13 @@ void TextHistory::setLastSavedRevision()
     m_lastSavedRevision = revision();
 }
 
+void TextHistory::setLastSavedRevision(qint64 revision)
+{
+    // given revision was successful saved
+    Q_ASSERT(revision <= this->revision());
+    m_lastSavedRevision = revision;
+}
+
 void TextHistory::wrapLine(const KTextEditor::Cursor &position)
 {
     // create and add new entry
@@ -114,31 +176,126 @@ void TextHistory::addEntry(const Entry &entry)
      */
     Q_ASSERT(!m_historyEntries.empty());
 
+    /**
+     * remember new revision for the entry, it is the revision we get after this change
+     */
+    Entry newEntry = entry;
+    newEntry.revision = revision() + 1;
+
+    /**
+     * the buffer must have moved on since the last entry, one revision per entry
+     */
+    Q_ASSERT(newEntry.revision > m_historyEntries.back().revision);
+
     /**
      * simple efficient check: if we only have one entry, and the entry is not referenced
-     * just replace it with the new one and adjust the revision
+     * just replace it with the new one
      */
     if ((m_historyEntries.size() == 1) && !m_historyEntries.front().referenceCounter) {
-        /**
-         * remember new revision for first element, it is the revision we get after this change
-         */
-        m_firstHistoryEntryRevision = revision() + 1;
+        m_historyEntries.front() = newEntry;
+        return;
+    }
 
-        /**
-         * remember edit
-         */
-        m_historyEntries.front() = entry;
+    /**
+     * ok, we have more than one entry or the entry is referenced, just add up new entries
+     */
+    m_historyEntries.push_back(newEntry);
 
-        /**
-         * be done...
-         */
+    /**
+     * keep the history in bounds
+     */
+    if (m_memoryLimit > 0 && qint64(m_historyEntries.size() * sizeof(Entry)) > m_memoryLimit) {
+        enforceMemoryLimit();
+    }
+}
+
+void TextHistory::enforceMemoryLimit()
+{
+    /**
+     * compact down to three quarters of the limit, to not do this again on the next edit
+     */
+    const qint64 targetEntries = qMax(qint64(1), m_memoryLimit / qint64(sizeof(Entry)) / 4 * 3);
+
+    /**
+     * first try to merge all unreferenced entries, this only loses unlocked revisions
+     */
+    const int entriesBefore = int(m_historyEntries.size());
+    if (m_historyEntries.size() > 2) {
+        compactEntries(1, int(m_historyEntries.size()) - 1, false);
+    }
+    m_discardedEntries += entriesBefore - int(m_historyEntries.size());
+
+    if (qint64(m_historyEntries.size()) <= targetEntries) {
         return;
     }
 
     /**
-     * ok, we have more than one entry or the entry is referenced, just add up new entries
+     * still too large: drop the oldest entries, their locks are moved to the expired ones
+     * transformations from or to expired revisions give invalid cursors and ranges from now on
      */
-    m_historyEntries.push_back(entry);
+    const int dropped = int(qint64(m_historyEntries.size()) - targetEntries);
+    for (int i = 0; i < dropped; ++i) {
+        m_expiredReferences += m_historyEntries[i].referenceCounter;
+    }
+    m_expiredRevision = m_historyEntries[dropped - 1].revision;
+    m_historyEntries.erase(m_historyEntries.begin(), m_historyEntries.begin() + dropped);
+    m_discardedEntries += dropped;
+
+    qCWarning(LOG_KTE) << "text history exceeds memory limit of" << m_memoryLimit << "bytes, dropped revisions up to" << m_expiredRevision
+                       << "with" << m_expiredReferences << "locks held";
+}
+
+TextHistory::Statistics TextHistory::statistics() const
+{
+    Statistics statistics;
+    statistics.entries = int(m_historyEntries.size());
+    statistics.memoryUsage = qint64(m_historyEntries.size() * sizeof(Entry));
+    statistics.locks = m_expiredReferences;
+    statistics.expiredRevision = m_expiredRevision;
+    statistics.discardedEntries = m_discardedEntries;
+
+    if (m_expiredReferences > 0) {
+        statistics.oldestLockedRevision = m_expiredRevision;
+    }
+
+    for (const Entry &entry : m_historyEntries) {
+        if (!entry.referenceCounter) {
+            continue;
+        }
+
+        statistics.locks += entry.referenceCounter;
+        if (statistics.oldestLockedRevision == -1) {
+            statistics.oldestLockedRevision = entry.revision;
+        }
+    }
+
+    return statistics;
+}
+
+int TextHistory::entryIndex(qint64 revision) const
+{
+    /**
+     * expired revisions miss the dropped entries, there is no state of the history for them any longer
+     */
+    Q_ASSERT(!m_historyEntries.empty());
+    if (revision <= m_expiredRevision) {
+        return -1;
+    }
+
+    /**
+     * entries are sorted by revision, but compaction might have left gaps
+     */
+    const auto it = std::lower_bound(m_historyEntries.begin(), m_historyEntries.end(), revision, [](const Entry &entry, qint64 value) {
+        return entry.revision < value;
+    });
+
+    /**
+     * revision merged into a later entry, there is no state of the history for it any longer
+     */
+    if (it == m_historyEntries.end() || it->revision != revision) {
+        return -1;
+    }
+    return int(it - m_historyEntries.begin());
 }
 
 void TextHistory::lockRevision(qint64 revision)
@@ -147,13 +304,28 @@ void TextHistory::lockRevision(qint64 revision)
      * some invariants must hold
      */
     Q_ASSERT(!m_historyEntries.empty());
-    Q_ASSERT(revision >= m_firstHistoryEntryRevision);
-    Q_ASSERT(revision < (m_firstHistoryEntryRevision + qint64(m_historyEntries.size())));
+
+    /**
+     * expired revisions only need to be counted
+     */
+    if (revision <= m_expiredRevision) {
+        ++m_expiredReferences;
+        return;
+    }
+
+    /**
+     * compacted revisions only need to be counted, too
+     */
+    const int index = entryIndex(revision);
+    if (index < 0) {
+        ++m_compactedReferences;
+        return;
+    }
 
     /**
      * increment revision reference counter
      */
-    Entry &entry = m_historyEntries[revision - m_firstHistoryEntryRevision];
+    Entry &entry = m_historyEntries[index];
     ++entry.referenceCounter;
 }
 
@@ -163,13 +335,30 @@ void TextHistory::unlockRevision(qint64 revision)
      * some invariants must hold
      */
     Q_ASSERT(!m_historyEntries.empty());
-    Q_ASSERT(revision >= m_firstHistoryEntryRevision);
-    Q_ASSERT(revision < (m_firstHistoryEntryRevision + qint64(m_historyEntries.size())));
+
+    /**
+     * expired revisions only need to be counted
+     */
+    if (revision <= m_expiredRevision) {
+        Q_ASSERT(m_expiredReferences > 0);
+        --m_expiredReferences;
+        return;
+    }
+
+    /**
+     * compacted revisions only need to be counted, too
+     */
+    int index = entryIndex(revision);
+    if (index < 0) {
+        Q_ASSERT(m_compactedReferences > 0);
+        --m_compactedReferences;
+        return;
+    }
 
     /**
      * decrement revision reference counter
      */
-    Entry &entry = m_historyEntries[revision - m_firstHistoryEntryRevision];
+    Entry &entry = m_historyEntries[index];
     Q_ASSERT(entry.referenceCounter);
     --entry.referenceCounter;
 
@@ -196,13 +385,121 @@ void TextHistory::unlockRevision(qint64 revision)
         if (unreferencedEdits > 0) {
             // remove stuff from history
             m_historyEntries.erase(m_historyEntries.begin(), m_historyEntries.begin() + unreferencedEdits);
+            index -= int(unreferencedEdits);
+        }
 
-            // patch first entry revision
-            m_firstHistoryEntryRevision += unreferencedEdits;
+        /**
+         * merge the entries around the released revision, up to the next locked ones
+         * the first entry is never merged, its transformation is never applied
+         */
+        if (m_compactionEnabled && index > 0) {
+            int begin = index;
+            while (begin > 1 && !m_historyEntries[begin - 1].referenceCounter) {
+                --begin;
+            }
+
+            int end = index;
+            while (end + 1 < int(m_historyEntries.size()) && !m_historyEntries[end].referenceCounter) {
+                ++end;
+            }
+
+            compactEntries(begin, end, true);
         }
     }
 }
 
+void TextHistory::compactEntries(int begin, int end, bool exact)
+{
+    Q_ASSERT(begin > 0);
+    Q_ASSERT(end < int(m_historyEntries.size()));
+
+    /**
+     * merge in place, only unreferenced entries may absorb their successor
+     */
+    int write = begin;
+    for (int read = begin + 1; read <= end; ++read) {
+        Entry &previous = m_historyEntries[write];
+        if (!previous.referenceCounter && previous.merge(m_historyEntries[read], exact)) {
+            continue;
+        }
+
+        m_historyEntries[++write] = m_historyEntries[read];
+    }
+
+    m_historyEntries.erase(m_historyEntries.begin() + write + 1, m_historyEntries.begin() + end + 1);
+}
+
+bool TextHistory::Entry::merge(const Entry &next, bool exact)
+{
+    /**
+     * no-ops vanish, this entry becomes the next one if it is a no-op itself
+     */
+    if (next.type == NoChange) {
+        revision = next.revision;
+        referenceCounter = next.referenceCounter;
+        return true;
+    }
+
+    if (type == NoChange) {
+        *this = next;
+        return true;
+    }
+
+    /**
+     * all other merges work on one line only
+     */
+    if (next.line != line) {
+        return false;
+    }
+
+    /**
+     * typing: text inserted directly behind the text this entry inserted
+     * for appends at the line end, cursors behind the line end would be treated differently by the merged entry
+     */
+    if (type == InsertText && next.type == InsertText && (!exact || column < oldLineLength)
+        && next.column == column + length && next.oldLineLength == oldLineLength + length) {
+        length += next.length;
+    }
+
+    /**
+     * the remaining merges change cursors behind the line end, e.g. on reverse transformation
+     */
+    else if (exact) {
+        return false;
+    }
+
+    /**
+     * backspace or delete: the next removal contains the position of this one
+     */
+    else if (type == RemoveText && next.type == RemoveText && next.column <= column && column <= next.column + next.length
+             && next.oldLineLength == oldLineLength - length) {
+        column = next.column;
+        length += next.length;
+    }
+
+    /**
+     * correction: removal of text this entry inserted
+     */
+    else if (type == InsertText && next.type == RemoveText && next.column >= column && next.column + next.length <= column + length
+             && next.oldLineLength == oldLineLength + length) {
+        length -= next.length;
+        if (!length) {
+            type = NoChange;
+        }
+    }
+
+    else {
+        return false;
+    }
+
+    /**
+     * the merged entry ends at the revision of next
+     */
+    revision = next.revision;
+    referenceCounter = next.referenceCounter;
+    return true;
+}
+
 void TextHistory::Entry::transformCursor(int &cursorLine, int &cursorColumn, bool moveOnInsert) const
 {
     /**
@@ -480,10 +777,17 @@ void TextHistory::transformCursor(int &line, int &column, KTextEditor::MovingCur
      */
     Q_ASSERT(!m_historyEntries.empty());
     Q_ASSERT(fromRevision != toRevision);
-    Q_ASSERT(fromRevision >= m_firstHistoryEntryRevision);
-    Q_ASSERT(fromRevision < (m_firstHistoryEntryRevision + qint64(m_historyEntries.size())));
-    Q_ASSERT(toRevision >= m_firstHistoryEntryRevision);
-    Q_ASSERT(toRevision < (m_firstHistoryEntryRevision + qint64(m_historyEntries.size())));
+    const int fromIndex = entryIndex(fromRevision);
+    const int toIndex = entryIndex(toRevision);
+
+    /**
+     * a revision expired or got compacted away, there is no right position, better none than a wrong one
+     */
+    if (fromIndex < 0 || toIndex < 0) {
+        line = -1;
+        column = -1;
+        return;
+    }
 
     /**
      * transform cursor
@@ -494,18 +798,166 @@ void TextHistory::transformCursor(int &line, int &column, KTextEditor::MovingCur
      * forward or reverse transform?
      */
     if (toRevision > fromRevision) {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision + 1; rev <= (toRevision - m_firstHistoryEntryRevision); ++rev) {
+        for (int rev = fromIndex + 1; rev <= toIndex; ++rev) {
             const Entry &entry = m_historyEntries.at(rev);
             entry.transformCursor(line, column, moveOnInsert);
         }
     } else {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision; rev >= (toRevision - m_firstHistoryEntryRevision + 1); --rev) {
+        for (int rev = fromIndex; rev >= toIndex + 1; --rev) {
             const Entry &entry = m_historyEntries.at(rev);
             entry.reverseTransformCursor(line, column, moveOnInsert);
         }
     }
 }
 
+void TextHistory::transformCursors(QVector<KTextEditor::Cursor> &cursors, KTextEditor::MovingCursor::InsertBehavior insertBehavior, qint64 fromRevision, qint64 toRevision)
+{
+    /**
+     * -1 special meaning for from/toRevision
+     */
+    if (fromRevision == -1) {
+        fromRevision = revision();
+    }
+
+    if (toRevision == -1) {
+        toRevision = revision();
+    }
+
+    /**
+     * shortcut, same revision or nothing to do
+     */
+    if (fromRevision == toRevision || cursors.isEmpty()) {
+        return;
+    }
+
+    /**
+     * some invariants must hold
+     */
+    Q_ASSERT(!m_historyEntries.empty());
+    Q_ASSERT(std::is_sorted(cursors.cbegin(), cursors.cend()));
+    const int fromIndex = entryIndex(fromRevision);
+    const int toIndex = entryIndex(toRevision);
+
+    /**
+     * a revision expired or got compacted away, there are no right positions, better none than wrong ones
+     */
+    if (fromIndex < 0 || toIndex < 0) {
+        std::fill(cursors.begin(), cursors.end(), KTextEditor::Cursor::invalid());
+        return;
+    }
+    const bool moveOnInsert = insertBehavior == KTextEditor::MovingCursor::MoveOnInsert;
+    const bool forward = toRevision > fromRevision;
+
+    /**
+     * lines stay sorted for all transformations, as long as the columns on each line are sorted, too
+     * line shifts for all cursors behind a changed line are accumulated lazily in the deltas,
+     * the stored line of a cursor plus its delta is its real line
+     */
+    const int count = cursors.size();
+    LineDeltas deltas(count);
+    bool sorted = true;
+
+    const int step = forward ? 1 : -1;
+    for (int rev = forward ? fromIndex + 1 : fromIndex; rev != (forward ? toIndex + 1 : toIndex); rev += step) {
+        const Entry &entry = m_historyEntries.at(rev);
+
+        /**
+         * cursors behind the line end can break the order on unwrap, fall back to transform one by one
+         */
+        if (!sorted) {
+            for (KTextEditor::Cursor &cursor : cursors) {
+                int line = cursor.line(), column = cursor.column();
+                forward ? entry.transformCursor(line, column, moveOnInsert) : entry.reverseTransformCursor(line, column, moveOnInsert);
+                cursor.setPosition(line, column);
+            }
+            continue;
+        }
+
+        /**
+         * which line is touched, how are the lines behind it shifted?
+         */
+        int changedLine = entry.line;
+        int lineDelta = 0;
+        switch (entry.type) {
+        case Entry::WrapLine:
+            changedLine = forward ? entry.line : entry.line + 1;
+            lineDelta = forward ? 1 : -1;
+            break;
+
+        case Entry::UnwrapLine:
+            changedLine = forward ? entry.line : entry.line - 1;
+            lineDelta = forward ? -1 : 1;
+            break;
+
+        case Entry::InsertText:
+        case Entry::RemoveText:
+            break;
+
+        default:
+            continue;
+        }
+
+        /**
+         * binary search first cursor on the changed line
+         */
+        int first = 0;
+        int last = count;
+        while (first < last) {
+            const int middle = first + (last - first) / 2;
+            if (cursors.at(middle).line() + deltas.at(middle) < changedLine) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+
+        /**
+         * transform all cursors on the changed line
+         */
+        int end = first;
+        int previousLine = -1;
+        for (; end < count; ++end) {
+            const int delta = deltas.at(end);
+            int line = cursors.at(end).line() + delta;
+            if (line != changedLine) {
+                break;
+            }
+
+            int column = cursors.at(end).column();
+            forward ? entry.transformCursor(line, column, moveOnInsert) : entry.reverseTransformCursor(line, column, moveOnInsert);
+            cursors[end].setPosition(line - delta, column);
+
+            sorted = sorted && (line >= previousLine);
+            previousLine = line;
+        }
+
+        /**
+         * shift all lines behind
+         */
+        if (lineDelta) {
+            deltas.addFrom(end, lineDelta);
+        }
+
+        /**
+         * order broken? apply the pending deltas and transform the rest one by one
+         */
+        if (!sorted) {
+            for (int i = 0; i < count; ++i) {
+                cursors[i].setLine(cursors.at(i).line() + deltas.at(i));
+            }
+        }
+    }
+
+    /**
+     * apply the pending deltas
+     */
+    if (sorted) {
+        for (int i = 0; i < count; ++i) {
+            cursors[i].setLine(cursors.at(i).line() + deltas.at(i));
+        }
+    }
+}
+
 void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingRange::InsertBehaviors insertBehaviors, KTextEditor::MovingRange::EmptyBehavior emptyBehavior, qint64 fromRevision, qint64 toRevision)
 {
     /**
@@ -540,10 +992,16 @@ void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingR
      */
     Q_ASSERT(!m_historyEntries.empty());
     Q_ASSERT(fromRevision != toRevision);
-    Q_ASSERT(fromRevision >= m_firstHistoryEntryRevision);
-    Q_ASSERT(fromRevision < (m_firstHistoryEntryRevision + qint64(m_historyEntries.size())));
-    Q_ASSERT(toRevision >= m_firstHistoryEntryRevision);
-    Q_ASSERT(toRevision < (m_firstHistoryEntryRevision + qint64(m_historyEntries.size())));
+    const int fromIndex = entryIndex(fromRevision);
+    const int toIndex = entryIndex(toRevision);
+
+    /**
+     * a revision expired or got compacted away, there is no right range, better none than a wrong one
+     */
+    if (fromIndex < 0 || toIndex < 0) {
+        range = KTextEditor::Range::invalid();
+        return;
+    }
 
     /**
      * transform cursors
@@ -559,7 +1017,7 @@ void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingR
      * forward or reverse transform?
      */
     if (toRevision > fromRevision) {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision + 1; rev <= (toRevision - m_firstHistoryEntryRevision); ++rev) {
+        for (int rev = fromIndex + 1; rev <= toIndex; ++rev) {
             const Entry &entry = m_historyEntries.at(rev);
 
             entry.transformCursor(startLine, startColumn, moveOnInsertStart);
@@ -579,7 +1037,7 @@ void TextHistory::transformRange(KTextEditor::Range &range, KTextEditor::MovingR
             }
         }
     } else {
-        for (int rev = fromRevision - m_firstHistoryEntryRevision; rev >= (toRevision - m_firstHistoryEntryRevision + 1); --rev) {
+        for (int rev = fromIndex; rev >= toIndex + 1; --rev) {
             const Entry &entry = m_historyEntries.at(rev);
 
             entry.reverseTransformCursor(startLine, startColumn, moveOnInsertStart);
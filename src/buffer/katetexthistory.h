@@ -23,6 +23,8 @@
 
 #include <vector>
 
+#include <QVector>
+
 #include <ktexteditor/range.h>
 
 #include <ktexteditor_export.h>
@@ -80,6 +82,17 @@ public:
      */
     void transformCursor(int &line, int &column, KTextEditor::MovingCursor::InsertBehavior insertBehavior, qint64 fromRevision, qint64 toRevision = -1);
 
+    /**
+     * Transform a sorted list of cursors from one revision to an other.
+     * Other than calling transformCursor() for each cursor, this walks the history entries only once
+     * and per entry only touches the cursors on the line the change occurred.
+     * @param cursors cursors to transform, must be sorted ascending, will be transformed in place
+     * @param insertBehavior behavior of the cursors on insert of text at their position
+     * @param fromRevision from this revision we want to transform
+     * @param toRevision to this revision we want to transform, default of -1 is current revision
+     */
+    void transformCursors(QVector<KTextEditor::Cursor> &cursors, KTextEditor::MovingCursor::InsertBehavior insertBehavior, qint64 fromRevision, qint64 toRevision = -1);
+
     /**
      * Transform a range from one revision to an other.
      * @param range range to transform
@@ -90,6 +103,90 @@ public:
      */
     void transformRange(KTextEditor::Range &range, KTextEditor::MovingRange::InsertBehaviors insertBehaviors, KTextEditor::MovingRange::EmptyBehavior emptyBehavior, qint64 fromRevision, qint64 toRevision = -1);
 
+    /**
+     * Enable or disable compaction of the history.
+     * If enabled, consecutive entries between locked revisions are merged on unlockRevision() where possible.
+     * The revisions in between are dropped, only locked revisions and the current one stay usable.
+     * Transforming from or to a dropped revision gives an invalid cursor or range.
+     * @param enabled compact unreferenced history entries?
+     */
+    void setCompactionEnabled(bool enabled)
+    {
+        m_compactionEnabled = enabled;
+    }
+
+    /**
+     * Is compaction of the history enabled?
+     * @return compaction enabled?
+     */
+    bool compactionEnabled() const
+    {
+        return m_compactionEnabled;
+    }
+
+    /**
+     * Limit the memory used by the history entries.
+     * If the history grows beyond the limit, all unreferenced entries are compacted,
+     * including merges that are only exact for cursors inside the lines.
+     * If this is not enough, the oldest entries are dropped, even if their revisions are locked.
+     * Transforming from or to such an expired revision gives an invalid cursor or range.
+     * @param bytes memory limit in bytes, 0 for no limit
+     */
+    void setMemoryLimit(qint64 bytes)
+    {
+        m_memoryLimit = qMax(qint64(0), bytes);
+    }
+
+    /**
+     * Memory limit of the history entries.
+     * @return memory limit in bytes, 0 if unlimited
+     */
+    qint64 memoryLimit() const
+    {
+        return m_memoryLimit;
+    }
+
+    /**
+     * Statistics about the history, to find plugins keeping old revisions locked.
+     */
+    struct Statistics {
+        /**
+         * number of history entries
+         */
+        int entries = 0;
+
+        /**
+         * memory used by the history entries in bytes
+         */
+        qint64 memoryUsage = 0;
+
+        /**
+         * number of locks on revisions, including expired ones
+         */
+        int locks = 0;
+
+        /**
+         * oldest locked revision, -1 if none
+         */
+        qint64 oldestLockedRevision = -1;
+
+        /**
+         * newest revision dropped because of the memory limit, -1 if none
+         */
+        qint64 expiredRevision = -1;
+
+        /**
+         * number of entries merged or dropped to respect the memory limit
+         */
+        qint64 discardedEntries = 0;
+    };
+
+    /**
+     * Get statistics about the size of the history.
+     * @return history statistics
+     */
+    Statistics statistics() const;
+
 private:
     /**
      * Class representing one entry in the editing history.
@@ -113,6 +210,15 @@ private:
          */
         void reverseTransformCursor(int &line, int &column, bool moveOnInsert) const;
 
+        /**
+         * Try to merge the following entry into this one.
+         * @param next entry following this one
+         * @param exact only merge if the merged entry transforms all cursors exactly like both entries in sequence,
+         *        else cursors behind the line end may be transformed differently
+         * @return true if merged, this entry then ends at the revision of next
+         */
+        bool merge(const Entry &next, bool exact);
+
         /**
          * Types of entries, matching editing primitives of buffer and placeholder
          */
@@ -136,6 +242,11 @@ private:
          */
         unsigned int referenceCounter = 0;
 
+        /**
+         * Revision of the buffer after this change
+         */
+        qint64 revision = 0;
+
         /**
          * Type of change
          */
@@ -183,6 +294,12 @@ private:
      */
     void setLastSavedRevision();
 
+    /**
+     * Set given revision as last saved revision, used by background saves
+     * @param revision revision which was saved
+     */
+    void setLastSavedRevision(qint64 revision);
+
     /**
      * Notify about wrap line at given cursor position.
      * @param position line/column as cursor where to wrap
@@ -217,6 +334,26 @@ private:
      */
     void addEntry(const Entry &entry);
 
+    /**
+     * Index of the history entry for the given revision.
+     * @param revision revision to search
+     * @return index into m_historyEntries, -1 if the revision expired or was merged into a later entry by compaction
+     */
+    int entryIndex(qint64 revision) const;
+
+    /**
+     * Merge consecutive entries in the given index range where possible.
+     * @param begin index of first entry that may be merged with its successors, must be > 0
+     * @param end index of the last entry to consider
+     * @param exact only do merges that transform all cursors exactly like the original entries
+     */
+    void compactEntries(int begin, int end, bool exact);
+
+    /**
+     * Compact or drop entries if the history uses more memory than allowed.
+     */
+    void enforceMemoryLimit();
+
 private:
     /**
      * TextBuffer this history belongs to
@@ -235,9 +372,34 @@ private:
     std::vector<Entry> m_historyEntries;
 
     /**
-     * offset for the first entry in m_history, to which revision it really belongs?
+     * merge unreferenced entries on unlock?
+     */
+    bool m_compactionEnabled;
+
+    /**
+     * memory limit for the entries in bytes, 0 if unlimited
+     */
+    qint64 m_memoryLimit;
+
+    /**
+     * newest revision dropped because of the memory limit, -1 if none
+     */
+    qint64 m_expiredRevision;
+
+    /**
+     * locks still held on expired revisions
+     */
+    int m_expiredReferences;
+
+    /**
+     * locks taken on revisions after they were compacted away
+     */
+    int m_compactedReferences;
+
+    /**
+     * entries merged or dropped because of the memory limit
      */
-    qint64 m_firstHistoryEntryRevision;
+    qint64 m_discardedEntries;
 };
 
 }
@@ -20,6 +20,11 @@
 
 #include "katetextline.h"
 
+/**
+ * Each this many attribute runs a checkpoint is stored, attribute() decodes at most this many runs
+ */
+static const int KATE_ATTRIBUTE_CHECKPOINT_INTERVAL = 16;
+
 namespace Kate
 {
 
@@ -191,28 +196,164 @@ int TextLineData::virtualLength(int tabWidth) const
     return x;
 }
 
-void TextLineData::addAttribute(const Attribute &attribute)
+int TextLineData::memoryUsage() const
 {
-    // try to append to previous range, if same attribute value
-    if (!m_attributesList.isEmpty() && (m_attributesList.back().attributeValue == attribute.attributeValue)
-        && ((m_attributesList.back().offset + m_attributesList.back().length) == attribute.offset)) {
-        m_attributesList.back().length += attribute.length;
+    // the arrays cost their header and capacity, shared empty ones nothing
+    int usage = sizeof(TextLineData);
+    if (m_text.capacity() > 0) {
+        usage += sizeof(QArrayData) + (m_text.capacity() + 1) * int(sizeof(QChar));
+    }
+    if (m_highlighting.capacity() > 0) {
+        usage += sizeof(QArrayData) + m_highlighting.capacity() + 1;
+    }
+    return usage;
+}
+
+void TextLineData::setAttributesList(const QVector<Attribute> &attributes)
+{
+    // the foldings stay behind the new runs
+    const QByteArray foldings = m_highlighting.mid(runsEnd());
+
+    // runs and the checkpoints into them, byte offsets relative to the first run
+    QByteArray runs;
+    runs.reserve(3 * attributes.size());
+    QVector<qint32> checkpoints;
+    int runCount = 0;
+
+    // the last run is only written once the next one can't be merged into it
+    int end = 0;
+    Attribute pending;
+    auto appendRun = [&]() {
+        if (runCount > 0 && runCount % KATE_ATTRIBUTE_CHECKPOINT_INTERVAL == 0) {
+            checkpoints << qint32(end) << qint32(runs.size());
+        }
+        appendPackedInt(runs, quint32(pending.offset - end));
+        appendPackedInt(runs, quint32(pending.length));
+        appendPackedInt(runs, quint16(pending.attributeValue));
+        end = pending.offset + pending.length;
+        ++runCount;
+    };
+
+    for (const Attribute &attribute : attributes) {
+        // cut overlaps, runs must be ascending
+        Q_ASSERT(attribute.offset >= pending.offset + pending.length);
+        const int offset = qMax(attribute.offset, pending.offset + pending.length);
+        const int length = attribute.offset + attribute.length - offset;
+        if (length <= 0) {
+            continue;
+        }
+
+        // try to append to previous run, if same attribute value
+        if (pending.length > 0 && pending.attributeValue == attribute.attributeValue && pending.offset + pending.length == offset) {
+            pending.length += length;
+            continue;
+        }
+
+        if (pending.length > 0) {
+            appendRun();
+        }
+        pending = Attribute(offset, length, attribute.attributeValue);
+    }
+
+    if (pending.length > 0) {
+        appendRun();
+    }
+
+    // neither runs nor foldings: nothing to store
+    if (runs.isEmpty() && foldings.isEmpty()) {
+        m_highlighting = QByteArray();
         return;
     }
 
-    m_attributesList.append(attribute);
+    // header, checkpoints with absolute byte offsets, runs, foldings
+    const int checkpointCount = checkpoints.size() / 2;
+    const int runsStart = int(sizeof(qint32)) + (checkpointCount > 0 ? int(sizeof(qint32)) * (1 + 2 * checkpointCount) : 0);
+    const qint32 runsEnd = runsStart + runs.size();
+    QByteArray packed;
+    packed.reserve(runsEnd + foldings.size());
+    const qint32 header = (checkpointCount > 0) ? -runsEnd : runsEnd;
+    packed.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (checkpointCount > 0) {
+        const qint32 count = checkpointCount;
+        packed.append(reinterpret_cast<const char *>(&count), sizeof(count));
+        for (int i = 0; i < checkpoints.size(); i += 2) {
+            const qint32 checkpoint[2] = {checkpoints.at(i), qint32(runsStart + checkpoints.at(i + 1))};
+            packed.append(reinterpret_cast<const char *>(checkpoint), sizeof(checkpoint));
+        }
+    }
+    packed.append(runs);
+    packed.append(foldings);
+    m_highlighting = packed;
+}
+
+QVector<TextLineData::Attribute> TextLineData::attributesList() const
+{
+    QVector<Attribute> attributes;
+    forEachAttribute([&attributes](const Attribute &attribute) {
+        attributes.append(attribute);
+    });
+    return attributes;
 }
 
 short TextLineData::attribute(int pos) const
 {
-    auto found = std::upper_bound(m_attributesList.cbegin(), m_attributesList.cend(), pos,
-                                  [](const int &p, const Attribute &x) {
-                                      return p < x.offset + x.length;
-                                  });
-    if (found != m_attributesList.cend() && found->offset <= pos && pos < (found->offset + found->length)) {
-        return found->attributeValue;
+    // binary search the last checkpoint with all runs in front of it ending before pos
+    const char *data = m_highlighting.constData();
+    const int size = runsEnd();
+    int i = runsStart();
+    int end = 0;
+    int low = 0;
+    int high = checkpointCount();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        const int checkpoint = int(sizeof(qint32)) * (2 + 2 * middle);
+        if (readFixedInt(checkpoint) <= pos) {
+            end = readFixedInt(checkpoint);
+            i = readFixedInt(checkpoint + int(sizeof(qint32)));
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    // decode the runs from there up to the first one not ending before pos
+    while (i < size) {
+        const int offset = end + int(readPackedInt(data, i));
+        const int length = int(readPackedInt(data, i));
+        const short value = short(readPackedInt(data, i));
+        end = offset + length;
+        if (pos < end) {
+            return (offset <= pos) ? value : 0;
+        }
     }
     return 0;
 }
 
+QVector<TextLineData::Folding> TextLineData::foldings() const
+{
+    QVector<Folding> foldings;
+    const char *data = m_highlighting.constData();
+    const int size = m_highlighting.size();
+    for (int i = runsEnd(); i < size;) {
+        const int offset = int(readPackedInt(data, i));
+        const quint32 value = readPackedInt(data, i);
+        foldings.append(Folding(offset, int(value >> 1) ^ -int(value & 1)));
+    }
+    return foldings;
+}
+
+void TextLineData::addFolding(int offset, int folding)
+{
+    // foldings come last, appending keeps the runs as they are
+    if (m_highlighting.isEmpty()) {
+        const qint32 runsEnd = sizeof(qint32);
+        m_highlighting.resize(sizeof(runsEnd));
+        std::memcpy(m_highlighting.data(), &runsEnd, sizeof(runsEnd));
+    }
+
+    // zigzag encoding, the folding value is negative for folding ends
+    appendPackedInt(m_highlighting, quint32(qMax(offset, 0)));
+    appendPackedInt(m_highlighting, (quint32(folding) << 1) ^ quint32(folding >> 31));
+}
+
 }
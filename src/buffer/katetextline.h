@@ -21,14 +21,15 @@
 #ifndef KATE_TEXTLINE_H
 #define KATE_TEXTLINE_H
 
+#include <QByteArray>
 #include <QVector>
 #include <QString>
+
+#include <cstring>
 #include <QSharedPointer>
 
 #include <ktexteditor_export.h>
 
-#include <KSyntaxHighlighting/State>
-
 namespace Kate
 {
 
@@ -91,7 +92,7 @@ public:
          * @param _offset offset of the folding start
          * @param _foldingValue positive ones start foldings, negative ones end them
          */
-        Folding(int _offset, int _foldingValue)
+        Folding(int _offset = 0, int _foldingValue = 0)
             : offset(_offset)
             , foldingValue(_foldingValue)
         {
@@ -108,6 +109,129 @@ public:
         int foldingValue = 0;
     };
 
+    /**
+     * Sequential attribute lookup for consumers walking the columns of a line in order.
+     * Steps through the packed attribute runs instead of decoding them from the start for each column,
+     * a walk over the complete line is linear in the number of runs.
+     * The line must stay alive and unchanged while the iterator is used.
+     */
+    class AttributeIterator
+    {
+    public:
+        /**
+         * Construct iterator for the given line, starting at column 0.
+         * @param line line to iterate over
+         */
+        explicit AttributeIterator(const TextLineData &line)
+            : m_data(line.m_highlighting.constData())
+            , m_size(line.runsEnd())
+            , m_first(line.runsStart())
+            , m_start(m_first)
+        {
+            readRun();
+        }
+
+        /**
+         * Gets the attribute at the given position, same as TextLineData::attribute().
+         * Cheap if the position is near the one of the last call, in both directions.
+         * @param pos position of attribute requested
+         * @return value of attribute
+         */
+        short attribute(int pos)
+        {
+            // step back over runs starting behind pos, then forward over runs ending before it
+            while (m_start > m_first && pos < m_previousEnd) {
+                previousRun();
+            }
+            while (m_start < m_size && pos >= m_offset + m_length) {
+                m_previousEnd = m_offset + m_length;
+                m_start = m_end;
+                readRun();
+            }
+
+            // pos might be in the gap in front of the run
+            if (m_start < m_size && m_offset <= pos) {
+                return m_value;
+            }
+            return 0;
+        }
+
+    private:
+        /**
+         * Decode the run starting at m_start, behind the run ending at m_previousEnd.
+         */
+        void readRun()
+        {
+            m_end = m_start;
+            if (m_end >= m_size) {
+                m_offset = m_previousEnd;
+                m_length = 0;
+                return;
+            }
+            m_offset = m_previousEnd + int(readPackedInt(m_data, m_end));
+            m_length = int(readPackedInt(m_data, m_end));
+            m_value = short(readPackedInt(m_data, m_end));
+        }
+
+        /**
+         * Step back to the run in front of the current one, it ends at m_previousEnd.
+         */
+        void previousRun()
+        {
+            // each run are three numbers, their last bytes have no continuation bit
+            int start = m_start;
+            for (int i = 0; i < 3; ++i) {
+                start = packedIntStart(m_data, start, m_first);
+            }
+
+            m_end = m_start;
+            m_start = start;
+            int pos = start;
+            const int gap = int(readPackedInt(m_data, pos));
+            m_length = int(readPackedInt(m_data, pos));
+            m_value = short(readPackedInt(m_data, pos));
+            m_offset = m_previousEnd - m_length;
+            m_previousEnd = m_offset - gap;
+        }
+
+        /**
+         * packed attributes of the line
+         */
+        const char *m_data;
+
+        /**
+         * end of the packed attribute runs
+         */
+        int m_size;
+
+        /**
+         * first byte of the first run
+         */
+        int m_first;
+
+        /**
+         * first byte of the current run, the first one not ending before the last requested position
+         */
+        int m_start;
+
+        /**
+         * first byte behind the current run
+         */
+        int m_end = 0;
+
+        /**
+         * end column of the run in front of the current one
+         */
+        int m_previousEnd = 0;
+
+        /**
+         * decoded current run, length 0 behind the last one
+         */
+        int m_offset = 0;
+        int m_length = 0;
+        short m_value = 0;
+    };
+
     /**
      * Flags of TextLineData
      */
@@ -116,7 +240,8 @@ public:
         flagFoldingStartAttribute = 2,
         flagFoldingStartIndentation = 4,
         flagLineModified = 8,
-        flagLineSavedOnDisk = 16
+        flagLineSavedOnDisk = 16,
+        flagHighlightingIncomplete = 32
     };
 
     /**
@@ -144,6 +269,15 @@ public:
         return m_text;
     }
 
+    /**
+     * Append the text of this line to the given string.
+     * @param text string to append to
+     */
+    void appendText(QString &text) const
+    {
+        text.append(m_text);
+    }
+
     /**
      * Returns the position of the first non-whitespace character
      * @return position of first non-whitespace char or -1 if there is none
@@ -194,11 +328,7 @@ public:
      */
     inline QChar operator[](int column) const
     {
-        if (column >= 0 && column < m_text.length()) {
-            return m_text[column];
-        }
-
-        return QChar();
+        return at(column);
     }
 
     inline void markAsModified(bool modified)
@@ -322,6 +452,12 @@ public:
         return m_text.mid(column, length);
     }
 
+    /**
+     * Approximate heap memory used by this line, including the line object itself.
+     * @return used bytes
+     */
+    int memoryUsage() const;
+
     /**
      * Leading whitespace of this line
      * @return leading whitespace of this line
@@ -360,7 +496,7 @@ public:
      */
     bool startsWith(const QString &match) const
     {
-        return m_text.startsWith(match);
+        return matchesAt(0, match);
     }
 
     /**
@@ -368,73 +504,133 @@ public:
      */
     bool endsWith(const QString &match) const
     {
-        return m_text.endsWith(match);
+        return matchesAt(length() - match.length(), match);
     }
 
     /**
-     * context stack
-     * @return context stack
+     * Did the highlighting of this line stop early, because the line is too long for its time budget?
+     * The attributes cover the highlighted part, the state is the one behind it.
+     * @return highlighting incomplete
      */
-    const KSyntaxHighlighting::State &highlightingState() const
+    bool isHighlightingIncomplete() const
     {
-        return m_highlightingState;
+        return m_flags & flagHighlightingIncomplete;
     }
 
     /**
-     * Sets the syntax highlight context number
-     * @param val new context array
+     * Mark the highlighting of this line as incomplete or complete.
+     * @param incomplete highlighting incomplete
      */
-    void setHighlightingState(const KSyntaxHighlighting::State &val)
+    void setHighlightingIncomplete(bool incomplete)
     {
-        m_highlightingState = val;
+        if (incomplete) {
+            m_flags |= flagHighlightingIncomplete;
+        } else {
+            m_flags &= ~flagHighlightingIncomplete;
+        }
     }
 
     /**
-     * Add attribute to this line.
-     * @param attribute new attribute to append
+     * Highlighting state at the end of this line, interned in the KateHighlightingStates of the buffer.
+     * @return state id, 0 for the initial state
      */
-    void addAttribute(const Attribute &attribute);
+    int highlightingStateId() const
+    {
+        return m_highlightingStateId;
+    }
+
+    /**
+     * Sets the highlighting state at the end of this line.
+     * @param id state id from the KateHighlightingStates of the buffer
+     */
+    void setHighlightingStateId(int id)
+    {
+        m_highlightingStateId = id;
+    }
+
+    /**
+     * Set the attributes of this line.
+     * They are stored packed, adjacent runs with the same value are merged.
+     * @param attributes attributes in ascending, non-overlapping order
+     */
+    void setAttributesList(const QVector<Attribute> &attributes);
 
     /**
      * Clear attributes and foldings of this line
      */
     void clearAttributesAndFoldings()
     {
-        m_attributesList.clear();
-        m_foldings.clear();
+        m_highlighting.clear();
     }
 
     /**
-     * Accessor to attributes
-     * @return attributes of this line
+     * Does this line have any attributes?
+     * @return attributes set
      */
-    const QVector<Attribute> &attributesList() const
+    bool hasAttributes() const
     {
-        return m_attributesList;
+        return runsEnd() > runsStart();
     }
 
     /**
-     * Accessor to foldings
-     * @return foldings of this line
+     * Value of the last attribute run, e.g. the context still active at the end of the line.
+     * Decodes only that run.
+     * @return value of the last attribute, 0 without attributes
      */
-    const std::vector<Folding> &foldings() const
+    short lastAttribute() const
     {
-        return m_foldings;
+        const int start = runsStart();
+        const int end = runsEnd();
+        if (end <= start) {
+            return 0;
+        }
+        int pos = packedIntStart(m_highlighting.constData(), end, start);
+        return short(readPackedInt(m_highlighting.constData(), pos));
     }
 
+    /**
+     * Accessor to attributes, decodes the packed storage.
+     * Use forEachAttribute() or AttributeIterator to walk them without a copy.
+     * @return attributes of this line
+     */
+    QVector<Attribute> attributesList() const;
+
+    /**
+     * Call the visitor for each attribute run of this line, in ascending order.
+     * @param visitor functor called with each const Attribute &
+     */
+    template<typename Visitor>
+    void forEachAttribute(Visitor visitor) const
+    {
+        const char *data = m_highlighting.constData();
+        const int size = runsEnd();
+        int end = 0;
+        for (int pos = runsStart(); pos < size;) {
+            const int offset = end + int(readPackedInt(data, pos));
+            const int length = int(readPackedInt(data, pos));
+            const short value = short(readPackedInt(data, pos));
+            visitor(Attribute(offset, length, value));
+            end = offset + length;
+        }
+    }
+
+    /**
+     * Accessor to foldings, decodes the packed storage.
+     * @return foldings of this line
+     */
+    QVector<Folding> foldings() const;
+
     /**
      * Add new folding at end of foldings stored in this line
      * @param offset offset of folding start
      * @param folding folding to add, positive to open, negative to close
      */
-    void addFolding(int offset, int folding)
-    {
-        m_foldings.emplace_back(offset,folding);
-    }
+    void addFolding(int offset, int folding);
 
     /**
      * Gets the attribute at the given position
      * use KRenderer::attributes  to get the KTextAttribute for this.
+     * Logarithmic in the number of runs, the checkpoints of long lines are searched first.
      *
      * @param pos position of attribute requested
      * @return value of attribute
@@ -455,6 +651,98 @@ public:
     }
 
 private:
+    /**
+     * Read one number of the packed attributes, 7 bits per byte, the high bit marks more bytes.
+     * @param data packed attributes
+     * @param pos position to read at, moved behind the number
+     * @return number
+     */
+    static quint32 readPackedInt(const char *data, int &pos)
+    {
+        quint32 value = 0;
+        int shift = 0;
+        uchar byte;
+        do {
+            byte = uchar(data[pos++]);
+            value |= quint32(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return value;
+    }
+
+    /**
+     * Find the start of the packed number ending right in front of the given position.
+     * @param data packed attributes
+     * @param pos position behind the number
+     * @param first first byte of the first number
+     * @return first byte of the number
+     */
+    static int packedIntStart(const char *data, int pos, int first)
+    {
+        --pos;
+        while (pos > first && (uchar(data[pos - 1]) & 0x80)) {
+            --pos;
+        }
+        return pos;
+    }
+
+    /**
+     * Append one number to the packed attributes.
+     * @param data packed attributes
+     * @param value number to append
+     */
+    static void appendPackedInt(QByteArray &data, quint32 value)
+    {
+        while (value >= 0x80) {
+            data.append(char((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        data.append(char(value));
+    }
+
+    /**
+     * Read one fixed size number of the packed highlighting.
+     * @param pos byte offset of the number
+     * @return number
+     */
+    qint32 readFixedInt(int pos) const
+    {
+        qint32 value;
+        std::memcpy(&value, m_highlighting.constData() + pos, sizeof(value));
+        return value;
+    }
+
+    /**
+     * Number of checkpoints in front of the attribute runs, only lines with many runs have them.
+     * @return checkpoint count
+     */
+    int checkpointCount() const
+    {
+        return (!m_highlighting.isEmpty() && readFixedInt(0) < 0) ? readFixedInt(sizeof(qint32)) : 0;
+    }
+
+    /**
+     * Start of the attribute runs in the packed highlighting, behind the header and the checkpoints.
+     * @return byte offset of the first run, 0 if there is no highlighting
+     */
+    int runsStart() const
+    {
+        if (m_highlighting.isEmpty()) {
+            return 0;
+        }
+        const int checkpoints = checkpointCount();
+        return int(sizeof(qint32)) + (checkpoints > 0 ? int(sizeof(qint32)) * (1 + 2 * checkpoints) : 0);
+    }
+
+    /**
+     * End of the attribute runs in the packed highlighting, the foldings follow them.
+     * @return byte offset behind the runs, 0 if there is no highlighting
+     */
+    int runsEnd() const
+    {
+        return m_highlighting.isEmpty() ? 0 : qAbs(readFixedInt(0));
+    }
+
     /**
      * Accessor to the text contained in this line.
      * This accessor is private, only the friend class text buffer/block is allowed to access the text read/write.
@@ -472,19 +760,19 @@ private:
     QString m_text;
 
     /**
-     * attributes of this line
-     */
-    QVector<Attribute> m_attributesList;
-
-    /**
-     * foldings of this line
+     * attributes and foldings of this line in one packed allocation, empty without any:
+     * the end of the runs as qint32, negated if checkpoints follow,
+     * then for lines with many runs the checkpoint count and per checkpoint the end column of the runs in front of it
+     * and the byte offset of its run, both as qint32, for each 16th run,
+     * then per run the gap to the end of the previous run, the length and the value,
+     * then per folding the offset and the zigzag encoded folding value
      */
-    std::vector<Folding> m_foldings;
+    QByteArray m_highlighting;
 
     /**
-     * current highlighting state
+     * id of the highlighting state at the end of this line, see KateHighlightingStates
      */
-    KSyntaxHighlighting::State m_highlightingState;
+    int m_highlightingStateId = 0;
 
     /**
      * flags of this line
@@ -23,12 +23,25 @@
 
 #include <QString>
 #include <QFile>
-#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QMimeDatabase>
+#include <QThread>
+#include <QFuture>
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // on the fly compression
 #include <KFilterDev>
 
+#include "katetextdigest.h"
+
 namespace Kate
 {
 
@@ -39,6 +52,133 @@ namespace Kate
  */
 static const qint64 KATE_FILE_LOADER_BS  = 256 * 1024;
 
+/**
+ * files modified within the last seconds are not memory mapped, they might still be written to
+ * a mapped file that is truncated while we read it would crash us with SIGBUS
+ */
+static const qint64 KATE_FILE_LOADER_MAP_MIN_AGE = 10;
+
+/**
+ * Find the next line terminator ('\r', '\n' or the Unicode line separator).
+ * Checks 16 code units at once with SSE2/AVX2, if the compiler targets them.
+ * @param text text to search in
+ * @param from first position to check
+ * @param to end of range to check
+ * @return position of first line terminator or @p to if none found
+ */
+static inline int findLineTerminator(const QChar *text, int from, int to)
+{
+    const ushort *data = reinterpret_cast<const ushort *>(text);
+    int i = from;
+
+#if defined(__AVX2__)
+    const __m256i lf = _mm256_set1_epi16('\n');
+    const __m256i cr = _mm256_set1_epi16('\r');
+    const __m256i ls = _mm256_set1_epi16(short(QChar::LineSeparator));
+    for (; i + 16 <= to; i += 16) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(chunk, lf), _mm256_cmpeq_epi16(chunk, cr)),
+                                              _mm256_cmpeq_epi16(chunk, ls));
+        const quint32 mask = quint32(_mm256_movemask_epi8(found));
+        if (mask) {
+            // two mask bits per code unit
+            return i + int(qCountTrailingZeroBits(mask) / 2);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i lf = _mm_set1_epi16('\n');
+    const __m128i cr = _mm_set1_epi16('\r');
+    const __m128i ls = _mm_set1_epi16(short(QChar::LineSeparator));
+    for (; i + 16 <= to; i += 16) {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 8));
+        const __m128i foundFirst = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(first, lf), _mm_cmpeq_epi16(first, cr)),
+                                                _mm_cmpeq_epi16(first, ls));
+        const __m128i foundSecond = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(second, lf), _mm_cmpeq_epi16(second, cr)),
+                                                 _mm_cmpeq_epi16(second, ls));
+        const quint32 mask = quint32(_mm_movemask_epi8(foundFirst)) | (quint32(_mm_movemask_epi8(foundSecond)) << 16);
+        if (mask) {
+            // two mask bits per code unit
+            return i + int(qCountTrailingZeroBits(mask) / 2);
+        }
+    }
+#endif
+
+    // scalar fallback, handles the tail, too
+    for (; i < to; ++i) {
+        const ushort c = data[i];
+        if (c == '\n' || c == '\r' || c == QChar::LineSeparator) {
+            return i;
+        }
+    }
+
+    return to;
+}
+
+/**
+ * Result of decoding one chunk of a file in a worker thread.
+ */
+class TextLoaderDecodedChunk
+{
+public:
+    /**
+     * decoded text of the chunk
+     */
+    QString text;
+
+    /**
+     * did the decoding produce invalid characters?
+     */
+    bool encodingError = false;
+};
+
+/**
+ * Functor to decode chunks of a file with a stateless codec.
+ * Used with QtConcurrent::mapped, each chunk must end at a character boundary,
+ * the loader cuts them behind newlines where possible.
+ */
+class TextLoaderChunkDecoder
+{
+public:
+    typedef TextLoaderDecodedChunk result_type;
+
+    /**
+     * Construct decoder for given codec.
+     * @param codec codec to use, must be stateless
+     */
+    explicit TextLoaderChunkDecoder(QTextCodec *codec)
+        : m_codec(codec)
+    {
+    }
+
+    /**
+     * Decode one chunk.
+     * @param data raw data of the chunk
+     * @return decoded chunk
+     */
+    TextLoaderDecodedChunk operator()(const QByteArray &data) const
+    {
+        // each worker needs an own state, byte order marks are already handled by the first read
+        QTextCodec::ConverterState state(QTextCodec::ConvertInvalidToNull | QTextCodec::IgnoreHeader);
+
+        TextLoaderDecodedChunk chunk;
+        chunk.text = m_codec->toUnicode(data.constData(), data.size(), &state);
+
+        // detect broken encoding
+        for (int i = 0; i < chunk.text.size(); ++i) {
+            if (chunk.text.at(i).isNull()) {
+                chunk.encodingError = true;
+                break;
+            }
+        }
+
+        return chunk;
+    }
+
+private:
+    QTextCodec *m_codec;
+};
+
 /**
  * File Loader, will handle reading of files + detecting encoding
  */
@@ -58,13 +198,21 @@ public:
         , m_position(0)
         , m_lastLineStart(0)
         , m_eol(TextBuffer::eolUnknown)  // no eol type detected atm
+        , m_foundEols(0)
         , m_buffer(KATE_FILE_LOADER_BS, 0)
-        , m_digest(QCryptographicHash::Sha1)
+        , m_digest(TextDigest::GitSha1)
+        , m_contentHash(TextDigest::XXHash64)
         , m_converterState(nullptr)
         , m_bomFound(false)
         , m_firstRead(true)
         , m_proberType(proberType)
         , m_fileSize(0)
+        , m_mappableFile(nullptr)
+        , m_mappedData(nullptr)
+        , m_mappedSize(0)
+        , m_mappedPosition(0)
+        , m_parallelDecoding(false)
+        , m_decodingBatchRunning(false)
     {
         // try to get mimetype for on the fly decompression, don't rely on filename!
         QFile testMime(filename);
@@ -72,8 +220,14 @@ public:
         m_fileSize = testMime.size();
 
         // construct filter device
+        // uncompressed files are read via a plain QFile, that allows us to memory map them
         KCompressionDevice::CompressionType compressionType = KFilterDev::compressionTypeForMimeType(m_mimeType);
-        m_file = new KCompressionDevice(filename, compressionType);
+        if (compressionType == KCompressionDevice::None) {
+            m_mappableFile = new QFile(filename);
+            m_file = m_mappableFile;
+        } else {
+            m_file = new KCompressionDevice(filename, compressionType);
+        }
     }
 
     /**
@@ -81,6 +235,9 @@ public:
      */
     ~TextLoader()
     {
+        // workers might still access the memory mapping
+        stopDecoding();
+
         delete m_file;
         delete m_converterState;
     }
@@ -99,23 +256,63 @@ public:
         m_position = 0;
         m_lastLineStart = 0;
         m_eol = TextBuffer::eolUnknown;
+        m_foundEols = 0;
         m_text.clear();
         delete m_converterState;
         m_converterState = new QTextCodec::ConverterState(QTextCodec::ConvertInvalidToNull);
         m_bomFound = false;
         m_firstRead = true;
 
-        // init the hash with the git header
-        const QString header = QStringLiteral("blob %1").arg(m_fileSize);
-        m_digest.reset();
-        m_digest.addData(header.toLatin1() + '\0');
+        // init the digest, the git header needs the size
+        m_digest.reset(m_fileSize);
+        m_contentHash.reset(m_fileSize);
+
+        // workers of a previous round might still access the memory mapping
+        stopDecoding();
 
-        // if already opened, close the file...
+        // if already opened, close the file, this will drop the memory mapping, too
         if (m_file->isOpen()) {
             m_file->close();
         }
+        m_mappedData = nullptr;
+        m_mappedSize = 0;
+        m_mappedPosition = 0;
 
-        return m_file->open(QIODevice::ReadOnly);
+        if (!m_file->open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        /**
+         * try to memory map uncompressed files, this avoids to copy all data through our read buffer
+         * if that fails, e.g. for too large files on 32-bit systems, we just fall back to read()
+         * only stable regular files are mapped, see canMapFile()
+         */
+        if (m_mappableFile && canMapFile()) {
+            m_mappedSize = m_mappableFile->size();
+            m_mappedData = m_mappableFile->map(0, m_mappedSize);
+            if (!m_mappedData) {
+                m_mappedSize = 0;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Can the opened uncompressed file be memory mapped safely?
+     * Pipes, devices and other special files can't be mapped at all.
+     * Files that change while we load them, like growing log files or files being rotated,
+     * would crash us with SIGBUS on truncation, these are read() instead.
+     * @return file is a regular file, unchanged since the loader was created and not modified recently
+     */
+    bool canMapFile() const
+    {
+        const QFileInfo info(*m_mappableFile);
+        if (!info.isFile() || (info.size() <= 0) || (quint64(info.size()) != m_fileSize)) {
+            return false;
+        }
+
+        return info.lastModified().secsTo(QDateTime::currentDateTime()) >= KATE_FILE_LOADER_MAP_MIN_AGE;
     }
 
     /**
@@ -137,6 +334,16 @@ public:
         return m_eol;
     }
 
+    /**
+     * Did the file use more than one kind of end of line?
+     * Detected during reading, is valid after complete file is read.
+     * @return mixed end of lines found
+     */
+    bool mixedEndOfLines() const
+    {
+        return qPopulationCount(m_foundEols) > 1;
+    }
+
     /**
      * BOM found?
      * @return byte order mark found?
@@ -205,99 +412,116 @@ public:
                     // kill the old lines...
                     m_text.remove(0, m_lastLineStart);
 
-                    // try to read new data
-                    const int c = m_file->read(m_buffer.data(), m_buffer.size());
-
-                    // if any text is there, append it....
-                    if (c > 0) {
-                        // update hash sum
-                        m_digest.addData(m_buffer.data(), c);
-
-                        // detect byte order marks & codec for byte order marks on first read
-                        int bomBytes = 0;
-                        if (m_firstRead) {
-                            // use first 16 bytes max to allow BOM detection of codec
-                            QByteArray bom(m_buffer.data(), qMin(16, c));
-                            QTextCodec *codecForByteOrderMark = QTextCodec::codecForUtfText(bom, nullptr);
-
-                            // if codec != null, we found a BOM!
-                            if (codecForByteOrderMark) {
-                                m_bomFound = true;
-
-                                // eat away the different boms!
-                                int mib = codecForByteOrderMark->mibEnum();
-                                if (mib == 106) { // utf8
-                                    bomBytes = 3;
-                                }
-                                if (mib == 1013 || mib == 1014 || mib == 1015) { // utf16
-                                    bomBytes = 2;
-                                }
-                                if (mib == 1017 || mib == 1018 || mib == 1019) { // utf32
-                                    bomBytes = 4;
-                                }
-                            }
+                    /**
+                     * after the first read did the encoding detection, stateless codecs on memory mapped files
+                     * are decoded in parallel, the worker threads handle batches of chunks cut behind newlines
+                     */
+                    if (!m_parallelDecoding && !m_firstRead && m_mappedData && isStatelessCodec(m_codec)
+                        && (m_converterState->remainingChars == 0)) {
+                        m_parallelDecoding = true;
+                        startDecodingBatch();
+                    }
 
-                            /**
-                             * if no codec given, do autodetection
-                             */
-                            if (!m_codec) {
-                                /**
-                                 * byte order said something about encoding?
-                                 */
+                    if (m_parallelDecoding) {
+                        // is file completely read ?
+                        m_eof = !readDecodingBatch(encodingError);
+                    } else {
+                        // try to read new data
+                        const char *data = nullptr;
+                        const int c = readData(data);
+
+                        // if any text is there, append it....
+                        if (c > 0) {
+                            // update hash sum
+                            m_digest.addData(data, c);
+                            m_contentHash.addData(data, c);
+
+                            // detect byte order marks & codec for byte order marks on first read
+                            int bomBytes = 0;
+                            if (m_firstRead) {
+                                // use first 16 bytes max to allow BOM detection of codec
+                                QByteArray bom(data, qMin(16, c));
+                                QTextCodec *codecForByteOrderMark = QTextCodec::codecForUtfText(bom, nullptr);
+
+                                // if codec != null, we found a BOM!
                                 if (codecForByteOrderMark) {
-                                    m_codec = codecForByteOrderMark;
-                                } else {
-                                    /**
-                                     * no Unicode BOM found, trigger prober
-                                     */
+                                    m_bomFound = true;
 
-                                    /**
-                                     * first: try to get HTML header encoding
-                                     */
-                                    if (QTextCodec *codecForHtml = QTextCodec::codecForHtml (m_buffer, nullptr)) {
-                                        m_codec = codecForHtml;
+                                    // eat away the different boms!
+                                    int mib = codecForByteOrderMark->mibEnum();
+                                    if (mib == 106) { // utf8
+                                        bomBytes = 3;
+                                    }
+                                    if (mib == 1013 || mib == 1014 || mib == 1015) { // utf16
+                                        bomBytes = 2;
                                     }
+                                    if (mib == 1017 || mib == 1018 || mib == 1019) { // utf32
+                                        bomBytes = 4;
+                                    }
+                                }
 
+                                /**
+                                 * if no codec given, do autodetection
+                                 */
+                                if (!m_codec) {
                                     /**
-                                     * else: use KEncodingProber
+                                     * byte order said something about encoding?
                                      */
-                                    else {
-                                        KEncodingProber prober(m_proberType);
-                                        prober.feed(m_buffer.constData(), c);
+                                    if (codecForByteOrderMark) {
+                                        m_codec = codecForByteOrderMark;
+                                    } else {
+                                        /**
+                                         * no Unicode BOM found, trigger prober
+                                         */
+
+                                        /**
+                                         * first: try to get HTML header encoding
+                                         */
+                                        if (QTextCodec *codecForHtml = QTextCodec::codecForHtml (QByteArray::fromRawData(data, c), nullptr)) {
+                                            m_codec = codecForHtml;
+                                        }
 
-                                        // we found codec with some confidence?
-                                        if (prober.confidence() > 0.5) {
-                                            m_codec = QTextCodec::codecForName(prober.encoding());
+                                        /**
+                                         * else: use KEncodingProber
+                                         */
+                                        else {
+                                            KEncodingProber prober(m_proberType);
+                                            prober.feed(data, c);
+
+                                            // we found codec with some confidence?
+                                            if (prober.confidence() > 0.5) {
+                                                m_codec = QTextCodec::codecForName(prober.encoding());
+                                            }
                                         }
-                                    }
 
-                                    // no codec, no chance, encoding error
-                                    if (!m_codec) {
-                                        return false;
+                                        // no codec, no chance, encoding error
+                                        if (!m_codec) {
+                                            return false;
+                                        }
                                     }
                                 }
-                            }
 
-                            m_firstRead = false;
-                        }
+                                m_firstRead = false;
+                            }
 
-                        Q_ASSERT(m_codec);
-                        QString unicode = m_codec->toUnicode(m_buffer.constData() + bomBytes, c - bomBytes, m_converterState);
+                            Q_ASSERT(m_codec);
+                            QString unicode = m_codec->toUnicode(data + bomBytes, c - bomBytes, m_converterState);
 
-                        // detect broken encoding
-                        for (int i = 0; i < unicode.size(); ++i) {
-                            if (unicode.at(i).isNull()) {
-                                encodingError = true;
-                                break;
+                            // detect broken encoding
+                            for (int i = 0; i < unicode.size(); ++i) {
+                                if (unicode.at(i).isNull()) {
+                                    encodingError = true;
+                                    break;
+                                }
                             }
+
+                            m_text.append(unicode);
                         }
 
-                        m_text.append(unicode);
+                        // is file completely read ?
+                        m_eof = (c == -1) || (c == 0);
                     }
 
-                    // is file completely read ?
-                    m_eof = (c == -1) || (c == 0);
-
                     // recalc current pos and last pos
                     m_position -= m_lastLineStart;
                     m_lastLineStart = 0;
@@ -307,6 +531,12 @@ public:
                 if (m_eof && (m_position == m_text.length())) {
                     m_lastWasEndOfLine = false;
 
+                    // a \r at the very end is a mac line end
+                    if (m_lastWasR) {
+                        foundEndOfLine(TextBuffer::eolMac);
+                        m_lastWasR = false;
+                    }
+
                     // line data
                     offset = m_lastLineStart;
                     length = m_position - m_lastLineStart;
@@ -323,13 +553,15 @@ public:
                 }
             }
 
-            if (m_text.at(m_position) == lf) {
+            const QChar c = m_text.at(m_position);
+            if (c == lf) {
                 m_lastWasEndOfLine = true;
 
                 if (m_lastWasR) {
                     m_lastLineStart++;
                     m_lastWasR = false;
                     m_eol = TextBuffer::eolDos;
+                    foundEndOfLine(TextBuffer::eolDos);
                 } else {
                     // line data
                     offset = m_lastLineStart;
@@ -342,10 +574,16 @@ public:
                     if (m_eol != TextBuffer::eolDos) {
                         m_eol = TextBuffer::eolUnix;
                     }
+                    foundEndOfLine(TextBuffer::eolUnix);
 
                     return !encodingError;
                 }
-            } else if (m_text.at(m_position) == cr) {
+            } else if (c == cr) {
+                // the previous \r was not followed by \n
+                if (m_lastWasR) {
+                    foundEndOfLine(TextBuffer::eolMac);
+                }
+
                 m_lastWasEndOfLine = true;
                 m_lastWasR = true;
 
@@ -362,7 +600,11 @@ public:
                 }
 
                 return !encodingError;
-            } else if (m_text.at(m_position) == QChar::LineSeparator) {
+            } else if (c == QChar::LineSeparator) {
+                if (m_lastWasR) {
+                    foundEndOfLine(TextBuffer::eolMac);
+                }
+
                 m_lastWasEndOfLine = true;
 
                 // line data
@@ -374,8 +616,16 @@ public:
 
                 return !encodingError;
             } else {
+                if (m_lastWasR) {
+                    foundEndOfLine(TextBuffer::eolMac);
+                }
+
                 m_lastWasEndOfLine = false;
                 m_lastWasR = false;
+
+                // skip all other characters at once
+                m_position = findLineTerminator(m_text.unicode(), m_position + 1, m_text.length());
+                continue;
             }
 
             m_position++;
@@ -389,6 +639,140 @@ public:
         return m_digest.result();
     }
 
+    QByteArray contentHash()
+    {
+        return m_contentHash.result();
+    }
+
+private:
+    /**
+     * Remember that the given kind of end of line was used in the file.
+     * @param eol found end of line
+     */
+    void foundEndOfLine(TextBuffer::EndOfLineMode eol)
+    {
+        m_foundEols |= (1u << eol);
+    }
+
+    /**
+     * Fetch the next chunk of raw data.
+     * For memory mapped files this just hands out the next part of the mapping,
+     * else the data is read into our internal buffer.
+     * @param data will point to the read data afterwards
+     * @return number of bytes read, 0 on end of file, -1 on error
+     */
+    int readData(const char *&data)
+    {
+        if (m_mappedData) {
+            int c = int(qMin(m_mappedSize - m_mappedPosition, KATE_FILE_LOADER_BS));
+            data = reinterpret_cast<const char *>(m_mappedData) + m_mappedPosition;
+
+            // for stateless codecs, end the chunk behind the last newline, then it can be decoded on its own
+            if (isStatelessCodec(m_codec) && (m_mappedPosition + c < m_mappedSize)) {
+                bool foundNewLine = false;
+                for (int i = c - 1; i > 0; --i) {
+                    if (data[i] == '\n') {
+                        c = i + 1;
+                        foundNewLine = true;
+                        break;
+                    }
+                }
+
+                // very long line, at least don't split an utf8 sequence
+                if (!foundNewLine && m_codec->mibEnum() == 106) {
+                    while (c > 1 && (uchar(data[c]) & 0xC0) == 0x80) {
+                        --c;
+                    }
+                }
+            }
+
+            m_mappedPosition += c;
+            return c;
+        }
+
+        data = m_buffer.constData();
+        return m_file->read(m_buffer.data(), m_buffer.size());
+    }
+
+    /**
+     * Can the given codec decode any chunk ending behind a newline without knowing the previous chunks?
+     * @param codec codec to check
+     * @return codec is stateless
+     */
+    static bool isStatelessCodec(QTextCodec *codec)
+    {
+        if (!codec) {
+            return false;
+        }
+
+        // utf8, iso-8859-1, iso-8859-15, us-ascii
+        const int mib = codec->mibEnum();
+        return mib == 106 || mib == 4 || mib == 111 || mib == 3;
+    }
+
+    /**
+     * Hand the next chunks of the memory mapping to the worker threads for decoding.
+     * The digest is updated here, in file order.
+     */
+    void startDecodingBatch()
+    {
+        QVector<QByteArray> chunks;
+        const int maxChunks = qMax(1, QThread::idealThreadCount());
+        const char *data = nullptr;
+        int c = 0;
+        while (chunks.size() < maxChunks && (c = readData(data)) > 0) {
+            m_digest.addData(data, c);
+            m_contentHash.addData(data, c);
+            chunks.append(QByteArray::fromRawData(data, c));
+        }
+
+        if (chunks.isEmpty()) {
+            return;
+        }
+
+        m_decodingBatch = QtConcurrent::mapped(chunks, TextLoaderChunkDecoder(m_codec));
+        m_decodingBatchRunning = true;
+    }
+
+    /**
+     * Wait for the running batch, append its text and start the next one.
+     * @param encodingError will be set to true if any chunk had encoding errors
+     * @return false if nothing was left to decode
+     */
+    bool readDecodingBatch(bool &encodingError)
+    {
+        if (!m_decodingBatchRunning) {
+            return false;
+        }
+
+        const QList<TextLoaderDecodedChunk> chunks = m_decodingBatch.results();
+        m_decodingBatchRunning = false;
+
+        // keep the workers busy while we split this batch into lines
+        startDecodingBatch();
+
+        for (const TextLoaderDecodedChunk &chunk : chunks) {
+            m_text.append(chunk.text);
+            encodingError = encodingError || chunk.encodingError;
+        }
+
+        return true;
+    }
+
+    /**
+     * Cancel and wait for any running decoding batch.
+     */
+    void stopDecoding()
+    {
+        if (m_decodingBatchRunning) {
+            m_decodingBatch.cancel();
+            m_decodingBatch.waitForFinished();
+            m_decodingBatchRunning = false;
+        }
+
+        m_parallelDecoding = false;
+    }
+
 private:
     QTextCodec *m_codec;
     bool m_eof;
@@ -397,16 +781,25 @@ private:
     int m_position;
     int m_lastLineStart;
     TextBuffer::EndOfLineMode m_eol;
+    quint32 m_foundEols;
     QString m_mimeType;
     QIODevice *m_file;
     QByteArray m_buffer;
-    QCryptographicHash m_digest;
+    TextDigest m_digest;
+    TextDigest m_contentHash;
     QString m_text;
     QTextCodec::ConverterState *m_converterState;
     bool m_bomFound;
     bool m_firstRead;
     KEncodingProber::ProberType m_proberType;
     quint64 m_fileSize;
+    QFile *m_mappableFile;
+    uchar *m_mappedData;
+    qint64 m_mappedSize;
+    qint64 m_mappedPosition;
+    bool m_parallelDecoding;
+    bool m_decodingBatchRunning;
+    QFuture<TextLoaderDecodedChunk> m_decodingBatch;
 };
 
 }
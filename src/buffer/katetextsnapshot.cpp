@@ -0,0 +1,76 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+#include "katetextsnapshot.h"
+
+#include <algorithm>
+
+namespace Kate
+{
+
+TextSnapshot::TextSnapshot()
+    : m_revision(-1)
+    , m_lines(0)
+{
+}
+
+const QString &TextSnapshot::lineText(int line) const
+{
+    // last block starting at or before the line
+    const int block = std::upper_bound(m_blockStartLines.cbegin(), m_blockStartLines.cend(), line) - m_blockStartLines.cbegin() - 1;
+    Q_ASSERT(block >= 0 && block < m_blocks.size());
+    return m_blocks.at(block)->at(line - m_blockStartLines.at(block));
+}
+
+QString TextSnapshot::line(int line) const
+{
+    if (line < 0 || line >= m_lines) {
+        return QString();
+    }
+
+    return lineText(line);
+}
+
+int TextSnapshot::lineLength(int line) const
+{
+    if (line < 0 || line >= m_lines) {
+        return -1;
+    }
+
+    return lineText(line).size();
+}
+
+QString TextSnapshot::text() const
+{
+    QString text;
+    bool firstLine = true;
+    for (const BlockLines &block : m_blocks) {
+        for (const QString &line : *block) {
+            if (!firstLine) {
+                text.append(QLatin1Char('\n'));
+            }
+            text.append(line);
+            firstLine = false;
+        }
+    }
+
+    return text;
+}
+
+}
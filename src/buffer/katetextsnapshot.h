@@ -0,0 +1,123 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+#ifndef KATE_TEXTSNAPSHOT_H
+#define KATE_TEXTSNAPSHOT_H
+
+#include <QString>
+#include <QVector>
+#include <QSharedPointer>
+
+#include <ktexteditor_export.h>
+
+namespace Kate
+{
+
+/**
+ * Immutable snapshot of the text of a TextBuffer at one revision, see TextBuffer::snapshot().
+ * The lines are shared with the buffer per block, a block is only copied once it is edited.
+ * Copies are cheap and a snapshot can be read from any thread, e.g. for analysis in a thread pool.
+ * Highlighting and other line data is not part of the snapshot.
+ */
+class KTEXTEDITOR_EXPORT TextSnapshot
+{
+    friend class TextBuffer;
+
+public:
+    /**
+     * Texts of the lines of one block.
+     */
+    typedef QSharedPointer<const QVector<QString> > BlockLines;
+
+    /**
+     * Construct empty snapshot without any line.
+     */
+    TextSnapshot();
+
+    /**
+     * Revision of the buffer this snapshot was taken at.
+     * @return revision, -1 for empty snapshots
+     */
+    qint64 revision() const
+    {
+        return m_revision;
+    }
+
+    /**
+     * Lines in this snapshot.
+     * @return number of lines
+     */
+    int lines() const
+    {
+        return m_lines;
+    }
+
+    /**
+     * Retrieve text of a line.
+     * @param line line to get the text of
+     * @return text of the line, empty for invalid lines
+     */
+    QString line(int line) const;
+
+    /**
+     * Retrieve length of a line.
+     * @param line line to get the length of
+     * @return length of the line, -1 for invalid lines
+     */
+    int lineLength(int line) const;
+
+    /**
+     * Retrieve text of the complete snapshot.
+     * @return text, lines separated by '\n'
+     */
+    QString text() const;
+
+private:
+    /**
+     * Find the text of a line.
+     * @param line valid line
+     * @return text of the line
+     */
+    const QString &lineText(int line) const;
+
+private:
+    /**
+     * revision of the buffer
+     */
+    qint64 m_revision;
+
+    /**
+     * number of lines
+     */
+    int m_lines;
+
+    /**
+     * shared lines per block
+     */
+    QVector<BlockLines> m_blocks;
+
+    /**
+     * start line of each block, for the lookup of lines
+     */
+    QVector<int> m_blockStartLines;
+};
+
+}
+
+#endif
@@ -25,6 +25,7 @@
 #include "katerenderer.h"
 #include "katetextline.h"
 #include "katedocument.h"
+#include "katebuffer.h"
 #include "kateview.h"
 #include "katehighlight.h"
 #include "katerenderrange.h"
@@ -150,7 +151,7 @@ QVector<QTextLayout::FormatRange> KateCompletionDelegate::createHighlighting(con
         }
 
         bool ctxChanged = false;
-        document()->highlight()->doHighlight(previousLine.data(), thisLine.data(), nextLine.data(), ctxChanged);
+        document()->highlight()->doHighlight(document()->buffer().highlightingStates(), previousLine.data(), thisLine.data(), nextLine.data(), ctxChanged);
     }
 
     m_currentColumnStart = m_cachedColumnStarts[index.column()];
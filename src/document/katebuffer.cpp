@@ -22,6 +22,7 @@
 #include "katebuffer.h"
 #include "katedocument.h"
 #include "katehighlight.h"
+#include "katehighlightingcache.h"
 #include "kateconfig.h"
 #include "kateglobal.h"
 #include "kateautoindent.h"
@@ -32,17 +33,46 @@
 #include <KFilterDev>
 
 #include <QDate>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QTextCodec>
 #include <QTextStream>
 #include <QTimer>
 
+#include <algorithm>
+
 /**
  * Initial value for m_maxDynamicContexts
  */
 static const int KATE_MAX_DYNAMIC_CONTEXTS = 512;
 
+/**
+ * Viewport highlighting: lines highlighted in front of the requested line to get the context right
+ */
+static const int KATE_VIEWPORT_HL_LOOK_BACK = 256;
+
+/**
+ * Display: lines further behind the highlighted ones are highlighted in the background
+ */
+static const int KATE_DISPLAY_HL_MAX_DISTANCE = 1024;
+
+/**
+ * Background highlighting: time slice in milliseconds and lines highlighted per step
+ */
+static const int KATE_BACKGROUND_HL_SLICE = 10;
+static const int KATE_BACKGROUND_HL_CHUNK = 64;
+
+/**
+ * Edits: lines re-highlighted at most behind the changed ones while the highlighting state keeps changing
+ */
+static const int KATE_EDIT_HL_LOOK_AHEAD = 256;
+
+/**
+ * Highlighting cache: only files with at least this many lines are cached
+ */
+static const int KATE_HL_CACHE_MIN_LINES = 10000;
+
 /**
  * Create an empty buffer. (with one block with one empty line)
  */
@@ -55,8 +85,23 @@ KateBuffer::KateBuffer(KTextEditor::DocumentPrivate *doc)
       m_highlight(nullptr),
       m_tabWidth(8),
       m_lineHighlighted(0),
-      m_maxDynamicContexts(KATE_MAX_DYNAMIC_CONTEXTS)
+      m_viewportHighlighting(false),
+      m_viewportHighlightStart(0),
+      m_viewportHighlightEnd(0),
+      m_viewportHighlightedLines(0),
+      m_maxDynamicContexts(KATE_MAX_DYNAMIC_CONTEXTS),
+      m_backgroundHighlightTarget(-1),
+      m_highlightingCacheLoaded(false),
+      m_lastEditHighlightedLines(0),
+      m_validStatesStart(0)
 {
+    setBlockCompressionDelay(KateGlobalConfig::global()->blockCompressionDelay());
+    history().setMemoryLimit(qint64(KateGlobalConfig::global()->historyMemoryLimit()) * 1024 * 1024);
+
+    // highlight far away lines in time slices, other events are handled in between
+    m_backgroundHighlightTimer.setSingleShot(true);
+    m_backgroundHighlightTimer.setInterval(0);
+    connect(&m_backgroundHighlightTimer, &QTimer::timeout, this, &KateBuffer::highlightInBackground);
 }
 
 /**
@@ -89,6 +134,11 @@ void KateBuffer::editEnd()
         return;
     }
 
+    /**
+     * cached highlighting might be wrong behind the changed lines
+     */
+    m_highlightingCacheLoaded = false;
+
     /**
      * if we arrive here, line changed should be OK
      */
@@ -124,6 +174,14 @@ void KateBuffer::editEnd()
     if ((editTagLineStart > 0) && m_highlight->foldingIndentationSensitive())
         --editTagLineStart;
 
+    /**
+     * the state to continue from is stale, start from scratch
+     */
+    if (editTagLineStart > 0 && editTagLineStart <= m_validStatesStart) {
+        restartHighlighting();
+        return;
+    }
+
     /**
      * really update highlighting
      */
@@ -135,6 +193,12 @@ void KateBuffer::editEnd()
 
 void KateBuffer::clear()
 {
+    // remember the highlighting of large files, if complete and still matching the file on disk
+    const QString cacheDirectory = KateGlobalConfig::global()->highlightingCacheDirectory();
+    if (!cacheDirectory.isEmpty() && m_highlight && lines() >= KATE_HL_CACHE_MIN_LINES && m_lineHighlighted >= lines() && m_incompleteHighlightLines.isEmpty() && !m_doc->isModified()) {
+        KateHighlightingCache::save(cacheDirectory, *this);
+    }
+
     // call original clear function
     Kate::TextBuffer::clear();
 
@@ -144,13 +208,15 @@ void KateBuffer::clear()
     m_longestLineLoaded = 0;
 
     // back to line 0 with hl
-    m_lineHighlighted = 0;
+    invalidateHighlighting();
 }
 
 bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
 {
     // first: setup fallback and normal encoding
     setEncodingProberType(KateGlobalConfig::global()->proberType());
+    setBlockCompressionDelay(KateGlobalConfig::global()->blockCompressionDelay());
+    history().setMemoryLimit(qint64(KateGlobalConfig::global()->historyMemoryLimit()) * 1024 * 1024);
     setFallbackTextCodec(KateGlobalConfig::global()->fallbackCodec());
     setTextCodec(m_doc->config()->codec());
 
@@ -204,6 +270,11 @@ bool KateBuffer::openFile(const QString &m_file, bool enforceTextCodec)
         return false;
     }
 
+    // large files opened unchanged again get their highlighting from the cache, the highlighting is known pre-load
+    if (lines() >= KATE_HL_CACHE_MIN_LINES) {
+        m_highlightingCacheLoaded = KateHighlightingCache::load(KateGlobalConfig::global()->highlightingCacheDirectory(), *this);
+    }
+
     // save back encoding
     m_doc->config()->setEncoding(QString::fromLatin1(textCodec()->name()));
 
@@ -231,9 +302,9 @@ bool KateBuffer::canEncode()
     }
 
     for (int i = 0; i < lines(); i++) {
-        if (!codec->canEncode(line(i)->string())) {
+        if (!codec->canEncode(lineData(i)->string())) {
             qCDebug(LOG_KTE) << QLatin1String("ENC NAME: ") << codec->name();
-            qCDebug(LOG_KTE) << QLatin1String("STRING LINE: ") << line(i)->string();
+            qCDebug(LOG_KTE) << QLatin1String("STRING LINE: ") << lineData(i)->string();
             qCDebug(LOG_KTE) << QLatin1String("ENC WORKING: FALSE");
 
             return false;
@@ -243,7 +314,7 @@ bool KateBuffer::canEncode()
     return true;
 }
 
-bool KateBuffer::saveFile(const QString &m_file)
+bool KateBuffer::saveFile(const QString &m_file, bool background)
 {
     // first: setup fallback and normal encoding
     setEncodingProberType(KateGlobalConfig::global()->proberType());
@@ -259,8 +330,11 @@ bool KateBuffer::saveFile(const QString &m_file)
     // append a newline character at the end of the file (eof) ?
     setNewLineAtEof(m_doc->config()->newLineAtEof());
 
-    // try to save
-    if (!save(m_file)) {
+    // try to save, large buffers in the background if allowed
+    // if the background save can't be started, e.g. missing permissions, do a normal save
+    const int backgroundThreshold = KateGlobalConfig::global()->backgroundSaveThreshold();
+    const bool saveInBackground = background && backgroundThreshold > 0 && lines() >= backgroundThreshold;
+    if (!(saveInBackground && saveAsync(m_file)) && !save(m_file)) {
         return false;
     }
 
@@ -285,13 +359,151 @@ void KateBuffer::ensureHighlighted(int line, int lookAhead)
         return;
     }
 
+    // cached attributes of an unchanged file count as highlighted until the first edit
+    if (m_highlightingCacheLoaded) {
+        return;
+    }
+
     // update hl until this line + max lookAhead
     int end = qMin(line + lookAhead, lines() - 1);
 
+    // viewport highlighting: don't highlight all lines up to this one, jump there
+    if (m_viewportHighlighting && line > m_lineHighlighted + KATE_VIEWPORT_HL_LOOK_BACK) {
+        // already done in the current window?
+        if (line >= m_viewportHighlightStart && line < m_viewportHighlightEnd) {
+            return;
+        }
+
+        // scrolling down near the current window continues it, else start a new window with some look back
+        int start = line - KATE_VIEWPORT_HL_LOOK_BACK;
+        if (m_viewportHighlightStart < m_viewportHighlightEnd && line >= m_viewportHighlightEnd && start <= m_viewportHighlightEnd) {
+            start = m_viewportHighlightEnd;
+        } else {
+            m_viewportHighlightStart = start;
+        }
+
+        m_viewportHighlightEnd = doHighlight(start, end, false);
+        m_viewportHighlightedLines += m_viewportHighlightEnd - start;
+        return;
+    }
+
     // ensure we have enough highlighted
     doHighlight(m_lineHighlighted, end, false);
 }
 
+void KateBuffer::ensureHighlightedForDisplay(int line)
+{
+    // valid line at all, anything to highlight?
+    if (line < 0 || line >= lines() || !m_highlight || m_highlight->noHighlighting()) {
+        return;
+    }
+
+    // cached highlighting of an unchanged file, nothing to do until the first edit
+    if (m_highlightingCacheLoaded && line >= m_lineHighlighted) {
+        return;
+    }
+
+    // near the highlighted lines or only highlighting around the viewport: do it now
+    if (m_viewportHighlighting || line < m_lineHighlighted + KATE_DISPLAY_HL_MAX_DISTANCE) {
+        ensureHighlighted(line);
+        return;
+    }
+
+    // else continue in the background, until the requested line and some look ahead are done
+    m_backgroundHighlightTarget = qMax(m_backgroundHighlightTarget, qMin(line + 64, lines() - 1));
+    if (!m_backgroundHighlightTimer.isActive()) {
+        m_backgroundHighlightTimer.start();
+    }
+}
+
+void KateBuffer::addIncompleteHighlightLine(int line)
+{
+    const auto it = std::lower_bound(m_incompleteHighlightLines.begin(), m_incompleteHighlightLines.end(), line);
+    if (it == m_incompleteHighlightLines.end() || *it != line) {
+        m_incompleteHighlightLines.insert(it, line);
+    }
+
+    if (!m_backgroundHighlightTimer.isActive()) {
+        m_backgroundHighlightTimer.start();
+    }
+}
+
+void KateBuffer::highlightInBackground()
+{
+    if (!m_highlight || m_highlight->noHighlighting()) {
+        m_backgroundHighlightTarget = -1;
+        m_incompleteHighlightLines.clear();
+        return;
+    }
+
+    // first continue long lines shown with partial highlighting
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_incompleteHighlightLines.isEmpty() && !timer.hasExpired(KATE_BACKGROUND_HL_SLICE)) {
+        const int line = m_incompleteHighlightLines.first();
+        Kate::TextLineData *textLine = (line < lines()) ? plainLineData(line) : nullptr;
+        if (!textLine || !textLine->isHighlightingIncomplete()) {
+            m_incompleteHighlightLines.removeFirst();
+            continue;
+        }
+
+        // the state stored in the line is stale, the restart finds the line again
+        if (line < m_validStatesStart) {
+            restartHighlighting();
+            break;
+        }
+
+        bool ctxChanged = false;
+        m_highlight->continueHighlight(m_highlightingStates, textLine, ctxChanged, KATE_BACKGROUND_HL_SLICE);
+        emit tagLines(line, line);
+        if (!textLine->isHighlightingIncomplete()) {
+            m_incompleteHighlightLines.removeFirst();
+
+            // the following lines were highlighted with the intermediate state
+            if (ctxChanged && line + 1 < m_lineHighlighted) {
+                doHighlight(line + 1, line + 1, true);
+            }
+        }
+    }
+
+    // then the lines up to the target, it might be gone by edits
+    m_backgroundHighlightTarget = qMin(m_backgroundHighlightTarget, lines() - 1);
+    const int startLine = m_lineHighlighted;
+    while (m_lineHighlighted <= m_backgroundHighlightTarget && !timer.hasExpired(KATE_BACKGROUND_HL_SLICE)) {
+        const int highlighted = m_lineHighlighted;
+        doHighlight(m_lineHighlighted, qMin(m_lineHighlighted + KATE_BACKGROUND_HL_CHUNK - 1, m_backgroundHighlightTarget), false);
+        if (m_lineHighlighted <= highlighted) {
+            break;
+        }
+    }
+
+    // lines shown as plain text until now need a repaint
+    if (m_lineHighlighted > startLine) {
+        emit tagLines(startLine, m_lineHighlighted - 1);
+    }
+
+    // next slice, edits in between just move the highlighted lines back
+    if (m_lineHighlighted > m_backgroundHighlightTarget) {
+        m_backgroundHighlightTarget = -1;
+    }
+    if (m_backgroundHighlightTarget >= 0 || !m_incompleteHighlightLines.isEmpty()) {
+        m_backgroundHighlightTimer.start();
+    }
+}
+
+void KateBuffer::setViewportHighlighting(bool enabled)
+{
+    m_viewportHighlighting = enabled;
+    m_viewportHighlightStart = 0;
+    m_viewportHighlightEnd = 0;
+    m_viewportHighlightedLines = 0;
+}
+
+int KateBuffer::highlightedLines() const
+{
+    return qMin(lines(), m_lineHighlighted + m_viewportHighlightedLines);
+}
+
 void KateBuffer::wrapLine(const KTextEditor::Cursor &position)
 {
     // call original
@@ -300,6 +512,13 @@ void KateBuffer::wrapLine(const KTextEditor::Cursor &position)
     if (m_lineHighlighted > position.line() + 1) {
         m_lineHighlighted++;
     }
+
+    // the edited lines get highlighted again anyway
+    for (int &line : m_incompleteHighlightLines) {
+        if (line > position.line()) {
+            ++line;
+        }
+    }
 }
 
 void KateBuffer::unwrapLine(int line)
@@ -310,6 +529,12 @@ void KateBuffer::unwrapLine(int line)
     if (m_lineHighlighted > line) {
         --m_lineHighlighted;
     }
+
+    for (int &incompleteLine : m_incompleteHighlightLines) {
+        if (incompleteLine >= line) {
+            --incompleteLine;
+        }
+    }
 }
 
 void KateBuffer::setTabWidth(int w)
@@ -355,13 +580,39 @@ void KateBuffer::setHighlight(int hlMode)
 void KateBuffer::invalidateHighlighting()
 {
     m_lineHighlighted = 0;
+    m_viewportHighlightStart = 0;
+    m_viewportHighlightEnd = 0;
+    m_viewportHighlightedLines = 0;
+
+    // displayed lines request background highlighting again, incomplete lines are found again
+    m_backgroundHighlightTimer.stop();
+    m_backgroundHighlightTarget = -1;
+    m_incompleteHighlightLines.clear();
+
+    // cached attributes don't match another highlighting
+    m_highlightingCacheLoaded = false;
+
+    // all lines get highlighted again, drop the states of the old highlighting
+    m_highlightingStates.clear();
+    m_validStatesStart = 0;
+}
+
+void KateBuffer::restartHighlighting()
+{
+    const int highlighted = m_lineHighlighted;
+    invalidateHighlighting();
+
+    m_backgroundHighlightTarget = qMin(highlighted, lines()) - 1;
+    if (m_backgroundHighlightTarget >= 0) {
+        m_backgroundHighlightTimer.start();
+    }
 }
 
-void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
+int KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
 {
     // no hl around, no stuff to do
     if (!m_highlight || m_highlight->noHighlighting()) {
-        return;
+        return startLine;
     }
 
 #ifdef BUFFER_DEBUGGING
@@ -372,27 +623,48 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
 #endif
 
     // if possible get previous line, otherwise create 0 line.
-    Kate::TextLine prevLine = (startLine >= 1) ? plainLine(startLine - 1) : Kate::TextLine();
+    // lines are only borrowed, highlighting doesn't change the line structure
+    Kate::TextLineData *prevLine = (startLine >= 1) ? plainLineData(startLine - 1) : nullptr;
+
+    // lines behind this one are not highlighted yet
+    const int oldHighlighted = m_lineHighlighted;
 
     // here we are atm, start at start line in the block
     int current_line = startLine;
     int start_spellchecking = -1;
     int last_line_spellchecking = -1;
     bool ctxChanged = false;
-    Kate::TextLine textLine = plainLine(current_line);
-    Kate::TextLine nextLine;
-    // loop over the lines of the block, from startline to endline or end of block
-    // if stillcontinue forces us to do so
-    for (; current_line < qMin(endLine + 1, lines()); ++current_line) {
+    Kate::TextLineData *textLine = plainLineData(current_line);
+    Kate::TextLineData *nextLine = nullptr;
+    Kate::TextLineData emptyLine;
+    const int statesGeneration = m_highlightingStates.generation();
+    int lineStatesGeneration = statesGeneration;
+    // loop over the lines of the block, from startline to endline
+    // for edits continue behind it as long as the state changes, the lines behind stay valid once it converges
+    for (; current_line < lines(); ++current_line) {
+        if (current_line > endLine
+                && (!invalidate || !ctxChanged || current_line >= qMin(oldHighlighted, endLine + 1 + KATE_EDIT_HL_LOOK_AHEAD))) {
+            break;
+        }
+
         // get next line, if any
         if ((current_line + 1) < lines()) {
-            nextLine = plainLine(current_line + 1);
+            nextLine = plainLineData(current_line + 1);
         } else {
-            nextLine = Kate::TextLine(new Kate::TextLineData());
+            nextLine = &emptyLine;
         }
 
         ctxChanged = false;
-        m_highlight->doHighlight(prevLine.data(), textLine.data(), nextLine.data(), ctxChanged, tabWidth());
+        m_highlight->doHighlight(m_highlightingStates, prevLine, textLine, nextLine, ctxChanged, tabWidth());
+
+        // the state table started again, only the states from here on are valid
+        if (m_highlightingStates.generation() != lineStatesGeneration) {
+            lineStatesGeneration = m_highlightingStates.generation();
+            m_validStatesStart = current_line;
+        }
+        if (textLine->isHighlightingIncomplete()) {
+            addIncompleteHighlightLine(current_line);
+        }
 
 #ifdef BUFFER_DEBUGGING
         // debug stuff
@@ -421,14 +693,25 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
 
     /**
      * perhaps we need to adjust the maximal highlighted line
+     * not for viewport windows behind it, the lines in between are not highlighted
      */
-    int oldHighlighted = m_lineHighlighted;
-    if (ctxChanged || current_line > m_lineHighlighted) {
+    if (startLine <= m_lineHighlighted && (ctxChanged || current_line > m_lineHighlighted)) {
+        m_lineHighlighted = current_line;
+    }
+
+    /**
+     * the lines behind have state ids of before the state table started again, they can't be trusted
+     */
+    if (m_highlightingStates.generation() != statesGeneration && startLine <= m_lineHighlighted) {
         m_lineHighlighted = current_line;
     }
 
     // tag the changed lines !
     if (invalidate) {
+        // remember how far the edit had to re-highlight, grammars that never converge defeat the early stop
+        m_lastEditHighlightedLines = current_line - startLine;
+        m_highlight->addEditStatistics(m_lastEditHighlightedLines, !ctxChanged || current_line >= qMin(oldHighlighted, lines()));
+
 #ifdef BUFFER_DEBUGGING
         qCDebug(LOG_KTE) << "HIGHLIGHTED TAG LINES: " << startLine <<  current_line;
 #endif
@@ -447,6 +730,8 @@ void KateBuffer::doHighlight(int startLine, int endLine, bool invalidate)
     qCDebug(LOG_KTE) << "HL DYN COUNT: " << KateHlManager::self()->countDynamicCtxs() << " MAX: " << m_maxDynamicContexts;
     qCDebug(LOG_KTE) << "TIME TAKEN: " << t.elapsed();
 #endif
+
+    return current_line;
 }
 
 KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
@@ -494,7 +779,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
             /**
              * get line
              */
-            Kate::TextLine textLine = plainLine(lastLine);
+            const Kate::TextLineData *textLine = plainLineData(lastLine);
 
             /**
              * indentation higher than our start line? continue
@@ -506,7 +791,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
             /**
              * empty line? continue
              */
-            if (m_highlight->isEmptyLine(textLine.data())) {
+            if (m_highlight->isEmptyLine(textLine)) {
                 continue;
             }
 
@@ -525,7 +810,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
          * backtrack all empty lines, we don't want to add them to the fold!
          */
         while (lastLine > startLine) {
-            if (m_highlight->isEmptyLine(plainLine(lastLine).data())) {
+            if (m_highlight->isEmptyLine(plainLineData(lastLine))) {
                 --lastLine;
             } else {
                 break;
@@ -564,7 +849,7 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
          * walk over all attributes of the line and compute the matchings
          */
         const auto &startLineAttributes = startTextLine->foldings();
-        for (size_t i = 0; i < startLineAttributes.size(); ++i) {
+        for (int i = 0; i < startLineAttributes.size(); ++i) {
             /**
              * folding close?
              */
@@ -627,13 +912,13 @@ KTextEditor::Range KateBuffer::computeFoldingRangeForStartLine(int startLine)
          * ensure line is highlighted
          */
         ensureHighlighted(line);
-        Kate::TextLine textLine = plainLine(line);
+        const Kate::TextLineData *textLine = plainLineData(line);
 
         /**
          * search for matching end marker
          */
         const auto &lineAttributes = textLine->foldings();
-        for (size_t i = 0; i < lineAttributes.size(); ++i) {
+        for (int i = 0; i < lineAttributes.size(); ++i) {
             /**
              * matching folding close?
              */
@@ -22,10 +22,12 @@
 #define KATE_BUFFER_H
 
 #include "katetextbuffer.h"
+#include "katehighlightingstates.h"
 
 #include <ktexteditor_export.h>
 
 #include <QObject>
+#include <QTimer>
 
 class KateLineInfo;
 namespace KTextEditor { class DocumentPrivate; }
@@ -147,9 +149,10 @@ public:
     /**
      * Save the buffer to a file, use the given filename + codec + end of line chars (internal use of qtextstream)
      * @param m_file filename to save to
-     * @return success
+     * @param background allow to save large buffers in the background, see TextBuffer::saveAsync()
+     * @return success, if isSavingAsync() afterwards, the save was started and is not yet done
      */
-    bool saveFile(const QString &m_file);
+    bool saveFile(const QString &m_file, bool background = false);
 
 public:
     /**
@@ -168,15 +171,91 @@ public:
         return line(lineno);
     }
 
+    /**
+     * Return line @p lineno without touching its reference count, for internal read paths.
+     * The returned pointer is only valid until the next edit, use plainLine() to keep the line.
+     * @return line data or nullptr for invalid line number
+     */
+    inline Kate::TextLineData *plainLineData(int lineno)
+    {
+        if (lineno < 0 || lineno >= lines()) {
+            return nullptr;
+        }
+
+        return lineData(lineno);
+    }
+
     /**
      * Update highlighting of given line @p line, if needed.
      * If @p line is already highlighted, this function does nothing.
      * If @p line is not highlighted, all lines up to line + lookAhead
      * are highlighted.
+     * Lines with attributes from the highlighting cache count as highlighted.
      * @param lookAhead also highlight these following lines
      */
     void ensureHighlighted(int line, int lookAhead = 64);
 
+    /**
+     * Update highlighting of given line @p line for display.
+     * Lines near the highlighted area are highlighted at once, like ensureHighlighted() does.
+     * Lines far behind it are highlighted in the background in small time slices instead,
+     * the lines are tagged once done and show their current attributes until then.
+     * @param line line to display
+     */
+    void ensureHighlightedForDisplay(int line);
+
+    /**
+     * Only highlight around the requested lines instead of all lines from the start of the buffer.
+     * Used by the read-only viewer mode for huge files, constructs spanning more lines
+     * than the look back might be highlighted wrongly.
+     * @param enabled highlight only around requested lines
+     */
+    void setViewportHighlighting(bool enabled);
+
+    /**
+     * Only highlight around the requested lines?
+     * @return viewport highlighting enabled
+     */
+    bool viewportHighlighting() const
+    {
+        return m_viewportHighlighting;
+    }
+
+    /**
+     * Estimated number of lines with valid highlighting.
+     * @return highlighted lines
+     */
+    int highlightedLines() const;
+
+    /**
+     * Did the lines get their attributes from the highlighting cache on load?
+     * Reset on the first edit or highlighting change.
+     * @return highlighting cache used
+     */
+    bool highlightingCacheLoaded() const
+    {
+        return m_highlightingCacheLoaded;
+    }
+
+    /**
+     * Highlighting states of the lines, reset with the highlighting.
+     * @return state table
+     */
+    KateHighlightingStates &highlightingStates()
+    {
+        return m_highlightingStates;
+    }
+
+    /**
+     * Number of lines re-highlighted for the last edit.
+     * Per highlighting totals are in KateHighlighting::editStatistics().
+     * @return re-highlighted lines
+     */
+    int lastEditHighlightedLines() const
+    {
+        return m_lastEditHighlightedLines;
+    }
+
     /**
      * Return the total number of lines in the buffer.
      */
@@ -239,8 +318,28 @@ private:
      * @param from first line in range
      * @param to last line in range
      * @param invalidate should the rehighlighted lines be tagged?
+     * @return first line after the highlighted ones
      */
-    void doHighlight(int from, int to, bool invalidate);
+    int doHighlight(int from, int to, bool invalidate);
+
+    /**
+     * Remember a line with incomplete highlighting, to continue it in the background.
+     * @param line line left incomplete by the highlighting
+     */
+    void addIncompleteHighlightLine(int line);
+
+    /**
+     * Highlight again from the first line in the background, up to the lines highlighted so far.
+     * Needed once the lines to continue from have stale state ids, see m_validStatesStart.
+     */
+    void restartHighlighting();
+
+private Q_SLOTS:
+    /**
+     * Continue lines with incomplete highlighting and highlight the next lines up to the
+     * background highlighting target, for one time slice.
+     */
+    void highlightInBackground();
 
 Q_SIGNALS:
     /**
@@ -284,10 +383,63 @@ private:
      */
     int m_lineHighlighted;
 
+    /**
+     * only highlight around the requested lines?
+     */
+    bool m_viewportHighlighting;
+
+    /**
+     * lines of the current highlighted viewport window, if viewport highlighting is enabled
+     */
+    int m_viewportHighlightStart;
+    int m_viewportHighlightEnd;
+
+    /**
+     * lines highlighted in viewport windows, overlapping windows are counted twice
+     */
+    int m_viewportHighlightedLines;
+
     /**
      * number of dynamic contexts causing a full invalidation
      */
     int m_maxDynamicContexts;
+
+    /**
+     * last line requested for display the background highlighting shall reach, -1 if none
+     */
+    int m_backgroundHighlightTarget;
+
+    /**
+     * timer triggering highlightInBackground() for the next time slice
+     */
+    QTimer m_backgroundHighlightTimer;
+
+    /**
+     * lines with incomplete highlighting, continued in the background, ascending
+     * entries are only hints, edits might have moved or completed them
+     */
+    QVector<int> m_incompleteHighlightLines;
+
+    /**
+     * lines got their attributes from the highlighting cache and the buffer is unchanged since?
+     */
+    bool m_highlightingCacheLoaded;
+
+    /**
+     * lines re-highlighted for the last edit
+     */
+    int m_lastEditHighlightedLines;
+
+    /**
+     * interned highlighting states, the lines store ids into it
+     */
+    KateHighlightingStates m_highlightingStates;
+
+    /**
+     * the state table got full and started again while highlighting this line,
+     * the state ids of the lines before are stale
+     */
+    int m_validStatesStart;
 };
 
 #endif
@@ -72,7 +72,6 @@
 #include <KConfigGroup>
 #include <KMountPoint>
 
-#include <QCryptographicHash>
 #include <QFile>
 #include <QMap>
 #include <QTextCodec>
@@ -84,6 +83,7 @@
 #include <QMimeDatabase>
 #include <QTemporaryFile>
 #include <QRegularExpression>
+#include <QLocale>
 
 #include <cmath>
 
@@ -200,7 +200,7 @@ KTextEditor::DocumentPrivate::DocumentPrivate(bool bSingleViewMode,
       m_bSingleViewMode(bSingleViewMode),
       m_bReadOnly(bReadOnly),
 
-      m_undoManager(new KateUndoManager(this)),
+      m_undoManager(nullptr),
 
       m_buffer(new KateBuffer(this)),
       m_indenter(new KateAutoIndent(this)),
@@ -231,17 +231,22 @@ KTextEditor::DocumentPrivate::DocumentPrivate(bool bSingleViewMode,
     // register doc at factory
     KTextEditor::EditorPrivate::self()->registerDocument(this);
 
+    // undo manager, not around in the viewer mode for huge files
+    createUndoManager();
+
     // normal hl
     m_buffer->setHighlight(0);
 
     // swap file
-    m_swapfile = (config()->swapFileMode() == KateDocumentConfig::DisableSwapFile) ? nullptr : new Kate::SwapFile(this);
+    createSwapFile();
 
     // important, fill in the config into the indenter we use...
     m_indenter->updateConfig();
 
     // some nice signals from the buffer
     connect(m_buffer, SIGNAL(tagLines(int,int)), this, SLOT(tagLines(int,int)));
+    connect(m_buffer, &Kate::TextBuffer::saveProgress, this, &KTextEditor::DocumentPrivate::slotBackgroundSaveProgress);
+    connect(m_buffer, &Kate::TextBuffer::asyncSaveFinished, this, &KTextEditor::DocumentPrivate::slotBackgroundSaveFinished);
 
     // if the user changes the highlight with the dialog, notify the doc
     connect(KateHlManager::self(), SIGNAL(changed()), SLOT(internalHlChanged()));
@@ -287,11 +292,6 @@ KTextEditor::DocumentPrivate::DocumentPrivate(bool bSingleViewMode,
         setWidget(view);
     }
 
-    connect(m_undoManager, SIGNAL(undoChanged()), this, SIGNAL(undoChanged()));
-    connect(m_undoManager, SIGNAL(undoStart(KTextEditor::Document*)),   this, SIGNAL(editingStarted(KTextEditor::Document*)));
-    connect(m_undoManager, SIGNAL(undoEnd(KTextEditor::Document*)),     this, SIGNAL(editingFinished(KTextEditor::Document*)));
-    connect(m_undoManager, SIGNAL(redoStart(KTextEditor::Document*)),   this, SIGNAL(editingStarted(KTextEditor::Document*)));
-    connect(m_undoManager, SIGNAL(redoEnd(KTextEditor::Document*)),     this, SIGNAL(editingFinished(KTextEditor::Document*)));
 
     connect(this, SIGNAL(sigQueryClose(bool*,bool*)), this, SLOT(slotQueryClose_save(bool*,bool*)));
 
@@ -550,10 +550,11 @@ KTextEditor::Range KTextEditor::DocumentPrivate::wordRangeAt(const KTextEditor::
     int start = cursor.column();
     int end = start;
 
-    while (start > 0 && highlight()->isInWord(textLine->at(start - 1), textLine->attribute(start - 1))) {
+    Kate::TextLineData::AttributeIterator attributes(*textLine);
+    while (start > 0 && highlight()->isInWord(textLine->at(start - 1), attributes.attribute(start - 1))) {
         start--;
     }
-    while (end < lineLenth && highlight()->isInWord(textLine->at(end), textLine->attribute(end))) {
+    while (end < lineLenth && highlight()->isInWord(textLine->at(end), attributes.attribute(end))) {
         end++;
     }
 
@@ -759,14 +760,25 @@ bool KTextEditor::DocumentPrivate::insertText(const KTextEditor::Cursor &positio
         const QChar &ch = text.at(pos);
 
         if (ch == QLatin1Char('\n')) {
-            // Only perform the text insert if there is text to insert
-            if (currentLineStart < pos) {
-                editInsertText(currentLine, insertColumn, text.mid(currentLineStart, pos - currentLineStart));
-            }
+            if (!block && currentLine > position.line()) {
+                // rest of the wrapped line is already behind us, open a new empty line in front of it
+                // this avoids to move the rest of a long line again for each inserted line
+                editWrapLine(currentLine - 1, lineLength(currentLine - 1));
+
+                // Only perform the text insert if there is text to insert
+                if (currentLineStart < pos) {
+                    editInsertText(currentLine, 0, text.mid(currentLineStart, pos - currentLineStart));
+                }
+            } else {
+                // Only perform the text insert if there is text to insert
+                if (currentLineStart < pos) {
+                    editInsertText(currentLine, insertColumn, text.mid(currentLineStart, pos - currentLineStart));
+                }
 
-            if (!block) {
-                editWrapLine(currentLine, insertColumn + pos - currentLineStart);
-                insertColumn = 0;
+                if (!block) {
+                    editWrapLine(currentLine, insertColumn + pos - currentLineStart);
+                    insertColumn = 0;
+                }
             }
 
             currentLine++;
@@ -1005,7 +1017,9 @@ bool KTextEditor::DocumentPrivate::editStart()
     // no last change cursor at start
     m_editLastChangeStartCursor = KTextEditor::Cursor::invalid();
 
-    m_undoManager->editStart();
+    if (m_undoManager) {
+        m_undoManager->editStart();
+    }
 
     foreach (KTextEditor::ViewPrivate *view, m_views) {
         view->editStart();
@@ -1027,7 +1041,7 @@ bool KTextEditor::DocumentPrivate::editEnd()
 
     // wrap the new/changed text, if something really changed!
     if (m_buffer->editChanged() && (editSessionNumber == 1))
-        if (m_undoManager->isActive() && config()->wordWrap()) {
+        if ((!m_undoManager || m_undoManager->isActive()) && config()->wordWrap()) {
             wrapText(m_buffer->editTagStart(), m_buffer->editTagEnd());
         }
 
@@ -1041,7 +1055,9 @@ bool KTextEditor::DocumentPrivate::editEnd()
     // this will cause some possible adjustment of tagline start/end
     m_buffer->editEnd();
 
-    m_undoManager->editEnd();
+    if (m_undoManager) {
+        m_undoManager->editEnd();
+    }
 
     // edit end for all views !!!!!!!!!
     foreach (KTextEditor::ViewPrivate *view, m_views) {
@@ -1087,12 +1103,16 @@ void KTextEditor::DocumentPrivate::popEditState()
 
 void KTextEditor::DocumentPrivate::inputMethodStart()
 {
-    m_undoManager->inputMethodStart();
+    if (m_undoManager) {
+        m_undoManager->inputMethodStart();
+    }
 }
 
 void KTextEditor::DocumentPrivate::inputMethodEnd()
 {
-    m_undoManager->inputMethodEnd();
+    if (m_undoManager) {
+        m_undoManager->inputMethodEnd();
+    }
 }
 
 bool KTextEditor::DocumentPrivate::wrapText(int startLine, int endLine)
@@ -1163,11 +1183,12 @@ bool KTextEditor::DocumentPrivate::wrapText(int startLine, int endLine)
             // This could be a priority (setting) in the hl/filetype/document
             int z = -1;
             int nw = -1; // alternative position, a non word character
+            Kate::TextLineData::AttributeIterator attributes(*l);
             for (z = searchStart; z >= 0; z--) {
                 if (t.at(z).isSpace()) {
                     break;
                 }
-                if ((nw < 0) && highlight()->canBreakAt(t.at(z), l->attribute(z))) {
+                if ((nw < 0) && highlight()->canBreakAt(t.at(z), attributes.attribute(z))) {
                     nw = z;
                 }
             }
@@ -1308,7 +1329,9 @@ bool KTextEditor::DocumentPrivate::editInsertText(int line, int col, const QStri
         col2 = l->length();
     }
 
-    m_undoManager->slotTextInserted(line, col2, s2);
+    if (m_undoManager) {
+        m_undoManager->slotTextInserted(line, col2, s2);
+    }
 
     // remember last change cursor
     m_editLastChangeStartCursor = KTextEditor::Cursor(line, col2);
@@ -1316,7 +1339,9 @@ bool KTextEditor::DocumentPrivate::editInsertText(int line, int col, const QStri
     // insert text into line
     m_buffer->insertText(m_editLastChangeStartCursor, s2);
 
-    emit textInserted(this, KTextEditor::Range(line, col2, line, col2 + s2.length()));
+    if (!m_applyingEdits) {
+        emit textInserted(this, KTextEditor::Range(line, col2, line, col2 + s2.length()));
+    }
 
     editEnd();
 
@@ -1359,7 +1384,9 @@ bool KTextEditor::DocumentPrivate::editRemoveText(int line, int col, int len)
 
     QString oldText = l->string().mid(col, len);
 
-    m_undoManager->slotTextRemoved(line, col, oldText);
+    if (m_undoManager) {
+        m_undoManager->slotTextRemoved(line, col, oldText);
+    }
 
     // remember last change cursor
     m_editLastChangeStartCursor = KTextEditor::Cursor(line, col);
@@ -1367,7 +1394,9 @@ bool KTextEditor::DocumentPrivate::editRemoveText(int line, int col, int len)
     // remove text from line
     m_buffer->removeText(KTextEditor::Range(m_editLastChangeStartCursor, KTextEditor::Cursor(line, col + len)));
 
-    emit textRemoved(this, KTextEditor::Range(line, col, line, col + len), oldText);
+    if (!m_applyingEdits) {
+        emit textRemoved(this, KTextEditor::Range(line, col, line, col + len), oldText);
+    }
 
     editEnd();
 
@@ -1395,7 +1424,9 @@ bool KTextEditor::DocumentPrivate::editMarkLineAutoWrapped(int line, bool autowr
 
     editStart();
 
-    m_undoManager->slotMarkLineAutoWrapped(line, autowrapped);
+    if (m_undoManager) {
+        m_undoManager->slotMarkLineAutoWrapped(line, autowrapped);
+    }
 
     l->setAutoWrapped(autowrapped);
 
@@ -1428,7 +1459,9 @@ bool KTextEditor::DocumentPrivate::editWrapLine(int line, int col, bool newLine,
     Kate::TextLine nextLine = kateTextLine(line + 1);
 
     const int length = l->length();
-    m_undoManager->slotLineWrapped(line, col, length - col, (!nextLine || newLine));
+    if (m_undoManager) {
+        m_undoManager->slotLineWrapped(line, col, length - col, (!nextLine || newLine));
+    }
 
     if (!nextLine || newLine) {
         m_buffer->wrapLine(KTextEditor::Cursor(line, col));
@@ -1472,7 +1505,9 @@ bool KTextEditor::DocumentPrivate::editWrapLine(int line, int col, bool newLine,
     // remember last change cursor
     m_editLastChangeStartCursor = KTextEditor::Cursor(line, col);
 
-    emit textInserted(this, KTextEditor::Range(line, col, line + 1, 0));
+    if (!m_applyingEdits) {
+        emit textInserted(this, KTextEditor::Range(line, col, line + 1, 0));
+    }
 
     editEnd();
 
@@ -1503,7 +1538,9 @@ bool KTextEditor::DocumentPrivate::editUnWrapLine(int line, bool removeLine, int
 
     int col = l->length();
 
-    m_undoManager->slotLineUnWrapped(line, col, length, removeLine);
+    if (m_undoManager) {
+        m_undoManager->slotLineUnWrapped(line, col, length, removeLine);
+    }
 
     if (removeLine) {
         m_buffer->unwrapLine(line + 1);
@@ -1543,7 +1580,9 @@ bool KTextEditor::DocumentPrivate::editUnWrapLine(int line, bool removeLine, int
     // remember last change cursor
     m_editLastChangeStartCursor = KTextEditor::Cursor(line, col);
 
-    emit textRemoved(this, KTextEditor::Range(line, col, line + 1, 0), QStringLiteral("\n"));
+    if (!m_applyingEdits) {
+        emit textRemoved(this, KTextEditor::Range(line, col, line + 1, 0), QStringLiteral("\n"));
+    }
 
     editEnd();
 
@@ -1569,7 +1608,9 @@ bool KTextEditor::DocumentPrivate::editInsertLine(int line, const QString &s)
 
     editStart();
 
-    m_undoManager->slotLineInserted(line, s);
+    if (m_undoManager) {
+        m_undoManager->slotLineInserted(line, s);
+    }
 
     // wrap line
     if (line > 0) {
@@ -1616,7 +1657,9 @@ bool KTextEditor::DocumentPrivate::editInsertLine(int line, const QString &s)
     // remember last change cursor
     m_editLastChangeStartCursor = rangeInserted.start();
 
-    emit textInserted(this, rangeInserted);
+    if (!m_applyingEdits) {
+        emit textInserted(this, rangeInserted);
+    }
 
     editEnd();
 
@@ -1654,7 +1697,9 @@ bool KTextEditor::DocumentPrivate::editRemoveLines(int from, int to)
     for (int line = to; line >= from; --line) {
         Kate::TextLine tl = m_buffer->line(line);
         oldText.prepend(this->line(line));
-        m_undoManager->slotLineRemoved(line, this->line(line));
+        if (m_undoManager) {
+            m_undoManager->slotLineRemoved(line, this->line(line));
+        }
 
         m_buffer->removeText(KTextEditor::Range(KTextEditor::Cursor(line, 0), KTextEditor::Cursor(line, tl->text().size())));
     }
@@ -1712,7 +1757,9 @@ bool KTextEditor::DocumentPrivate::editRemoveLines(int from, int to)
     // remember last change cursor
     m_editLastChangeStartCursor = rangeRemoved.start();
 
-    emit textRemoved(this, rangeRemoved, oldText.join(QStringLiteral("\n")) + QLatin1Char('\n'));
+    if (!m_applyingEdits) {
+        emit textRemoved(this, rangeRemoved, oldText.join(QStringLiteral("\n")) + QLatin1Char('\n'));
+    }
 
     editEnd();
 
@@ -1723,22 +1770,26 @@ bool KTextEditor::DocumentPrivate::editRemoveLines(int from, int to)
 //BEGIN KTextEditor::UndoInterface stuff
 uint KTextEditor::DocumentPrivate::undoCount() const
 {
-    return m_undoManager->undoCount();
+    return m_undoManager ? m_undoManager->undoCount() : 0;
 }
 
 uint KTextEditor::DocumentPrivate::redoCount() const
 {
-    return m_undoManager->redoCount();
+    return m_undoManager ? m_undoManager->redoCount() : 0;
 }
 
 void KTextEditor::DocumentPrivate::undo()
 {
-    m_undoManager->undo();
+    if (m_undoManager) {
+        m_undoManager->undo();
+    }
 }
 
 void KTextEditor::DocumentPrivate::redo()
 {
-    m_undoManager->redo();
+    if (m_undoManager) {
+        m_undoManager->redo();
+    }
 }
 //END
 
@@ -2300,6 +2351,76 @@ int KTextEditor::DocumentPrivate::lineLengthLimit() const
     return config()->lineLengthLimit();
 }
 
+void KTextEditor::DocumentPrivate::setHugeFileMode(bool enabled)
+{
+    m_hugeFileModeRequested = enabled;
+    updateHugeFileMode(enabled);
+
+    // viewer mode is read-only
+    if (enabled) {
+        setReadWrite(false);
+    }
+}
+
+void KTextEditor::DocumentPrivate::updateHugeFileMode(bool enabled)
+{
+    if (m_hugeFileMode == enabled) {
+        return;
+    }
+
+    m_hugeFileMode = enabled;
+
+    m_hugeFileModeSavedMemory = 0;
+    if (enabled) {
+        // nothing can be edited, no undo manager with its history and no swap file
+        // remember what they used, that is released now
+        if (m_undoManager) {
+            m_hugeFileModeSavedMemory += m_undoManager->memoryUsage();
+        }
+        if (m_swapfile) {
+            m_hugeFileModeSavedMemory += m_swapfile->memoryUsage();
+        }
+        qCDebug(LOG_KTE) << "huge file viewer mode released" << m_hugeFileModeSavedMemory << "bytes of undo history and swap file";
+        delete m_undoManager;
+        m_undoManager = nullptr;
+        delete m_swapfile;
+        m_swapfile = nullptr;
+
+        // spell checking would touch all lines
+        onTheFlySpellCheckingEnabled(false);
+    } else {
+        createUndoManager();
+        createSwapFile();
+        onTheFlySpellCheckingEnabled(config()->onTheFlySpellCheck());
+    }
+
+    // highlight only the viewed lines, leaving this mode continues with normal highlighting
+    m_buffer->setViewportHighlighting(enabled);
+    foreach (KTextEditor::ViewPrivate *view, m_views) {
+        view->tagAll();
+        view->updateView(true);
+    }
+
+    emit hugeFileModeChanged(this);
+}
+
+void KTextEditor::DocumentPrivate::createUndoManager()
+{
+    Q_ASSERT(!m_undoManager);
+    m_undoManager = new KateUndoManager(this);
+    connect(m_undoManager, SIGNAL(undoChanged()), this, SIGNAL(undoChanged()));
+    connect(m_undoManager, SIGNAL(undoStart(KTextEditor::Document*)),   this, SIGNAL(editingStarted(KTextEditor::Document*)));
+    connect(m_undoManager, SIGNAL(undoEnd(KTextEditor::Document*)),     this, SIGNAL(editingFinished(KTextEditor::Document*)));
+    connect(m_undoManager, SIGNAL(redoStart(KTextEditor::Document*)),   this, SIGNAL(editingStarted(KTextEditor::Document*)));
+    connect(m_undoManager, SIGNAL(redoEnd(KTextEditor::Document*)),     this, SIGNAL(editingFinished(KTextEditor::Document*)));
+}
+
+void KTextEditor::DocumentPrivate::createSwapFile()
+{
+    Q_ASSERT(!m_swapfile);
+    m_swapfile = (config()->swapFileMode() == KateDocumentConfig::DisableSwapFile) ? nullptr : new Kate::SwapFile(this);
+}
+
 //BEGIN KParts::ReadWrite stuff
 bool KTextEditor::DocumentPrivate::openFile()
 {
@@ -2339,6 +2460,11 @@ bool KTextEditor::DocumentPrivate::openFile()
         setEncoding(currentEncoding);
     }
 
+    // huge files are opened in the read-only viewer mode, decide before loading
+    const qint64 hugeFileThreshold = qint64(KateGlobalConfig::global()->hugeFileThreshold()) * 1024 * 1024;
+    const qint64 fileSize = QFileInfo(localFilePath()).size();
+    updateHugeFileMode(m_hugeFileModeRequested || (hugeFileThreshold > 0 && fileSize >= hugeFileThreshold));
+
     bool success = m_buffer->openFile(localFilePath(), (m_reloading && m_userSetEncodingForNextReload));
 
     //
@@ -2425,6 +2551,20 @@ bool KTextEditor::DocumentPrivate::openFile()
                                      "Those lines were wrapped and the document is set to read-only mode, as saving will modify its content.", this->url().toDisplayString(QUrl::PreferLocalFile), config()->lineLengthLimit(),m_buffer->longestLineLoaded());
     }
 
+    // info: huge file viewer mode
+    if (success && m_hugeFileMode) {
+        setReadWrite(false);
+        m_readWriteStateBeforeLoading = false;
+        QPointer<KTextEditor::Message> message
+            = new KTextEditor::Message(i18n("The file %1 was opened in the read-only viewer mode for huge files.<br />"
+                                            "Undo, swap file, spell checking and word counting are disabled and only the viewed lines are highlighted.<br />"
+                                            "Enable the read-write mode again in the tools menu to edit it.",
+                                            this->url().toDisplayString(QUrl::PreferLocalFile)),
+                                       KTextEditor::Message::Information);
+        message->setWordWrap(true);
+        postMessage(message);
+    }
+
     //
     // return the success
     //
@@ -2496,17 +2636,36 @@ bool KTextEditor::DocumentPrivate::saveFile()
     removeTrailingSpaces();
 
     //
-    // try to save
+    // try to save, large local files in the background
     //
-    if (!m_buffer->saveFile(localFilePath())) {
+    if (!m_buffer->saveFile(localFilePath(), url().isLocalFile())) {
         // add m_file again to dirwatch
         activateDirWatch(oldPath);
         KMessageBox::error(dialogParent(), i18n("The document could not be saved, as it was not possible to write to %1.\nCheck that you have write access to this file or that enough disk space is available.\nThe original file may be lost or damaged. Don't quit the application until the file is successfully written.", this->url().toDisplayString(QUrl::PreferLocalFile)));
         return false;
     }
 
-    // update the checksum
-    createDigest();
+    // file is written in the background, the document stays editable, the rest is done in slotBackgroundSaveFinished()
+    if (m_buffer->isSavingAsync()) {
+        m_savingInBackground = true;
+        if (m_swapfile) {
+            m_swapfile->backgroundSaveStarted();
+        }
+
+        // the undo state of the saved revision
+        if (m_undoManager) {
+            m_undoManager->undoSafePoint();
+        }
+
+        // perhaps some message about saving in one second
+        QTimer::singleShot(1000, this, SLOT(slotTriggerSavingMessage()));
+        return true;
+    }
+
+    // update the checksum, if it was not already computed while writing the file
+    if (checksum().isEmpty()) {
+        createDigest();
+    }
 
     // add m_file again to dirwatch
     activateDirWatch();
@@ -2523,8 +2682,10 @@ bool KTextEditor::DocumentPrivate::saveFile()
 
     // (dominik) mark last undo group as not mergeable, otherwise the next
     // edit action might be merged and undo will never stop at the saved state
-    m_undoManager->undoSafePoint();
-    m_undoManager->updateLineModifications();
+    if (m_undoManager) {
+        m_undoManager->undoSafePoint();
+        m_undoManager->updateLineModifications();
+    }
 
     //
     // return success
@@ -2740,6 +2901,9 @@ bool KTextEditor::DocumentPrivate::openUrl(const QUrl &url)
 
 bool KTextEditor::DocumentPrivate::closeUrl()
 {
+    // finish a running background save first, while we still know our url
+    m_buffer->waitForAsyncSave();
+
     //
     // file mod on hd
     //
@@ -2818,8 +2982,10 @@ bool KTextEditor::DocumentPrivate::closeUrl()
     m_buffer->clear();
 
     // clear undo/redo history
-    m_undoManager->clearUndo();
-    m_undoManager->clearRedo();
+    if (m_undoManager) {
+        m_undoManager->clearUndo();
+        m_undoManager->clearRedo();
+    }
 
     // no, we are no longer modified
     setModified(false);
@@ -2867,6 +3033,11 @@ void KTextEditor::DocumentPrivate::setReadWrite(bool rw)
         return;
     }
 
+    // editing leaves the read-only viewer mode for huge files
+    if (rw && m_hugeFileMode) {
+        setHugeFileMode(false);
+    }
+
     KParts::ReadWritePart::setReadWrite(rw);
 
     foreach (KTextEditor::ViewPrivate *view, m_views) {
@@ -2889,7 +3060,9 @@ void KTextEditor::DocumentPrivate::setModified(bool m)
         emit modifiedChanged(this);
     }
 
-    m_undoManager->setModified(m);
+    if (m_undoManager) {
+        m_undoManager->setModified(m);
+    }
 }
 //END
 
@@ -3364,7 +3537,9 @@ void KTextEditor::DocumentPrivate::paste(KTextEditor::ViewPrivate *view, const Q
 
     int lines = s.count(newLineChar);
 
-    m_undoManager->undoSafePoint();
+    if (m_undoManager) {
+        m_undoManager->undoSafePoint();
+    }
 
     editStart();
 
@@ -3421,7 +3596,9 @@ void KTextEditor::DocumentPrivate::paste(KTextEditor::ViewPrivate *view, const Q
     if (!view->blockSelection()) {
         emit charactersSemiInteractivelyInserted(pos, s);
     }
-    m_undoManager->undoSafePoint();
+    if (m_undoManager) {
+        m_undoManager->undoSafePoint();
+    }
 }
 
 void KTextEditor::DocumentPrivate::indent(KTextEditor::Range range, int change)
@@ -3869,8 +4046,8 @@ void KTextEditor::DocumentPrivate::comment(KTextEditor::ViewPrivate *v, uint lin
 
     if (c < ln->length()) {
         startAttrib = ln->attribute(c);
-    } else if (!ln->attributesList().isEmpty()) {
-        startAttrib = ln->attributesList().back().attributeValue;
+    } else if (ln->hasAttributes()) {
+        startAttrib = ln->lastAttribute();
     }
 
     bool hasStartLineCommentMark = !(highlight()->getCommentSingleLineStart(startAttrib).isEmpty());
@@ -4140,7 +4317,12 @@ KTextEditor::Range KTextEditor::DocumentPrivate::findMatchingBracket(const KText
     range.setEnd(range.start());
     KTextEditor::DocumentCursor cursor(this);
     cursor.setPosition(range.start());
-    int validAttr = kateTextLine(cursor.line())->attribute(cursor.column());
+
+    // the search walks char by char, look up the attributes sequentially
+    int textLineNumber = cursor.line();
+    Kate::TextLine textLine = kateTextLine(textLineNumber);
+    Kate::TextLineData::AttributeIterator attributes(*textLine);
+    int validAttr = attributes.attribute(cursor.column());
 
     while (cursor.line() >= minLine && cursor.line() <= maxLine) {
 
@@ -4148,8 +4330,12 @@ KTextEditor::Range KTextEditor::DocumentPrivate::findMatchingBracket(const KText
             return KTextEditor::Range::invalid();
         }
 
-        Kate::TextLine textLine = kateTextLine(cursor.line());
-        if (textLine->attribute(cursor.column()) == validAttr) {
+        if (cursor.line() != textLineNumber) {
+            textLineNumber = cursor.line();
+            textLine = kateTextLine(textLineNumber);
+            attributes = Kate::TextLineData::AttributeIterator(*textLine);
+        }
+        if (attributes.attribute(cursor.column()) == validAttr) {
             // Check for match
             QChar c = textLine->at(cursor.column());
             if (c == opposite) {
@@ -4411,7 +4597,13 @@ bool KTextEditor::DocumentPrivate::documentSaveCopyAs()
         return false;
     }
 
-    if (!m_buffer->saveFile(file.fileName())) {
+    // the checksum is the one of our file, not of the copy
+    const QByteArray digest = checksum();
+    const QByteArray contentHash = m_buffer->contentHash();
+    const bool saved = m_buffer->saveFile(file.fileName());
+    m_buffer->setDigest(digest);
+    m_buffer->setContentHash(contentHash);
+    if (!saved) {
         KMessageBox::error(dialogParent(), i18n("The document could not be saved, as it was not possible to write to %1.\n\nCheck that you have write access to this file or that enough disk space is available.", this->url().toDisplayString(QUrl::PreferLocalFile)));
         return false;
     }
@@ -4473,7 +4665,9 @@ QString KTextEditor::DocumentPrivate::encoding() const
 
 void KTextEditor::DocumentPrivate::updateConfig()
 {
-    m_undoManager->updateConfig();
+    if (m_undoManager) {
+        m_undoManager->updateConfig();
+    }
 
     // switch indenter if needed and update config....
     m_indenter->setMode(m_config->indentationMode());
@@ -4891,13 +5085,17 @@ void KTextEditor::DocumentPrivate::slotModOnHdDeleted(const QString &path)
 
 void KTextEditor::DocumentPrivate::slotDelayedHandleModOnHd()
 {
-    // compare git hash with the one we have (if we have one)
+    // compare digest with the one we have (if we have one)
     const QByteArray oldDigest = checksum();
     if (!oldDigest.isEmpty() && !url().isEmpty() && url().isLocalFile()) {
         /**
          * if current checksum == checksum of new file => unmodified
+         * check the fast content hash first, if it matches, the sha1 would match, too
          */
-        if (m_modOnHdReason != OnDiskDeleted && createDigest() && oldDigest == checksum()) {
+        const QByteArray oldContentHash = m_buffer->contentHash();
+        const bool contentUnchanged = m_modOnHdReason != OnDiskDeleted && !oldContentHash.isEmpty()
+                                      && Kate::TextDigest::digestForFile(url().toLocalFile(), Kate::TextDigest::XXHash64) == oldContentHash;
+        if (contentUnchanged || (m_modOnHdReason != OnDiskDeleted && createDigest() && oldDigest == checksum())) {
             m_modOnHd = false;
             m_modOnHdReason = OnDiskUnmodified;
             m_prevModOnHdReason = OnDiskUnmodified;
@@ -4906,6 +5104,7 @@ void KTextEditor::DocumentPrivate::slotDelayedHandleModOnHd()
 #if LIBGIT2_FOUND
         /**
          * if still modified, try to take a look at git
+         * only possible with the git compatible digest
          * skip that, if document is modified!
          * only do that, if the file is still there, else reload makes no sense!
          */
@@ -4959,27 +5158,17 @@ QByteArray KTextEditor::DocumentPrivate::checksum() const
 bool KTextEditor::DocumentPrivate::createDigest()
 {
     QByteArray digest;
+    QByteArray contentHash;
 
     if (url().isLocalFile()) {
-        QFile f(url().toLocalFile());
-        if (f.open(QIODevice::ReadOnly)) {
-            // init the hash with the git header
-            QCryptographicHash crypto(QCryptographicHash::Sha1);
-            const QString header = QStringLiteral("blob %1").arg(f.size());
-            crypto.addData(header.toLatin1() + '\0');
-
-            while (!f.atEnd()) {
-                crypto.addData(f.read(256 * 1024));
-            }
-
-            digest = crypto.result();
-        }
+        Kate::TextDigest::digestsForFile(url().toLocalFile(), digest, contentHash);
     }
 
     /**
      * set new digest
      */
     m_buffer->setDigest(digest);
+    m_buffer->setContentHash(contentHash);
     return !digest.isEmpty();
 }
 
@@ -5180,6 +5369,89 @@ bool KTextEditor::DocumentPrivate::replaceText(const KTextEditor::Range &range,
     return changed;
 }
 
+bool KTextEditor::DocumentPrivate::applyEdits(const QVector<QPair<KTextEditor::Range, QString> > &edits)
+{
+    if (!isReadWrite()) {
+        return false;
+    }
+
+    // validate + sort back to front, then the positions of the not yet applied edits stay valid
+    QVector<Kate::TextBuffer::Edit> sortedEdits;
+    sortedEdits.reserve(edits.size());
+    for (const auto &edit : edits) {
+        sortedEdits.append({edit.first, edit.second});
+    }
+    if (!m_buffer->prepareEdits(sortedEdits)) {
+        return false;
+    }
+    if (sortedEdits.isEmpty()) {
+        return true;
+    }
+
+    // the coalesced change spans from the first to the last edit
+    // the text behind it is untouched, remember its extent to find the new end
+    const KTextEditor::Range changedRange(sortedEdits.last().range.start(), sortedEdits.first().range.end());
+    const QString oldText = text(changedRange);
+    const int linesBehind = lines() - changedRange.end().line();
+    const int columnsBehind = lineLength(changedRange.end().line()) - changedRange.end().column();
+
+    // apply all edits in one transaction, without signals for each of them
+    // edits inside one line are handed to the buffer in batches, it applies them line by line in one go
+    editStart();
+    m_applyingEdits = true;
+    QVector<Kate::TextBuffer::Edit> lineEdits;
+    for (const Kate::TextBuffer::Edit &edit : qAsConst(sortedEdits)) {
+        const int line = edit.range.start().line();
+        if (line == edit.range.end().line() && !edit.text.contains(QLatin1Char('\n'))) {
+            // record the undo items like editRemoveText() + editInsertText() do
+            // the buffer marks the line as modified with the first change, the following items must see that
+            if (m_undoManager) {
+                if (!edit.range.isEmpty()) {
+                    m_undoManager->slotTextRemoved(line, edit.range.start().column(), text(edit.range));
+                    m_buffer->plainLineData(line)->markAsModified(true);
+                }
+                if (!edit.text.isEmpty()) {
+                    m_undoManager->slotTextInserted(line, edit.range.start().column(), edit.text);
+                    m_buffer->plainLineData(line)->markAsModified(true);
+                }
+            }
+            m_editLastChangeStartCursor = edit.range.start();
+            lineEdits.append(edit);
+            continue;
+        }
+
+        // keep the order, the batch lies behind this edit
+        if (!lineEdits.isEmpty()) {
+            m_buffer->applyPreparedEdits(lineEdits);
+            lineEdits.clear();
+        }
+
+        if (!edit.range.isEmpty()) {
+            removeText(edit.range);
+        }
+        if (!edit.text.isEmpty()) {
+            insertText(edit.range.start(), edit.text);
+        }
+    }
+    if (!lineEdits.isEmpty()) {
+        m_buffer->applyPreparedEdits(lineEdits);
+    }
+    m_applyingEdits = false;
+
+    // one notification for the complete change
+    const int endLine = lines() - linesBehind;
+    const KTextEditor::Range insertedRange(changedRange.start(), KTextEditor::Cursor(endLine, lineLength(endLine) - columnsBehind));
+    if (!changedRange.isEmpty()) {
+        emit textRemoved(this, changedRange, oldText);
+    }
+    if (!insertedRange.isEmpty()) {
+        emit textInserted(this, insertedRange);
+    }
+    editEnd();
+
+    return true;
+}
+
 KateHighlighting *KTextEditor::DocumentPrivate::highlight() const
 {
     return m_buffer->highlight();
@@ -5208,8 +5480,10 @@ void KTextEditor::DocumentPrivate::setUndoMergeAllEdits(bool merge)
         // meaning we'll need two undo's to get back there - which defeats the object!
         return;
     }
-    m_undoManager->undoSafePoint();
-    m_undoManager->setAllowComplexMerge(merge);
+    if (m_undoManager) {
+        m_undoManager->undoSafePoint();
+        m_undoManager->setAllowComplexMerge(merge);
+    }
     m_undoMergeAllEdits = merge;
 }
 
@@ -5257,6 +5531,11 @@ void KTextEditor::DocumentPrivate::transformCursor(KTextEditor::Cursor &cursor,
     cursor.setColumn(column);
 }
 
+void KTextEditor::DocumentPrivate::transformCursors(QVector<KTextEditor::Cursor> &cursors, KTextEditor::MovingCursor::InsertBehavior insertBehavior, qint64 fromRevision, qint64 toRevision)
+{
+    m_buffer->history().transformCursors(cursors, insertBehavior, fromRevision, toRevision);
+}
+
 void KTextEditor::DocumentPrivate::transformRange(KTextEditor::Range &range, KTextEditor::MovingRange::InsertBehaviors insertBehaviors, KTextEditor::MovingRange::EmptyBehavior emptyBehavior, qint64 fromRevision, qint64 toRevision)
 {
     m_buffer->history().transformRange(range, insertBehaviors, emptyBehavior, fromRevision, toRevision);
@@ -5376,6 +5655,13 @@ void KTextEditor::DocumentPrivate::slotCompleted()
      * Emit signal that we saved  the document, if needed
      */
     if (m_documentState == DocumentSaving || m_documentState == DocumentSavingAs) {
+        /**
+         * background save still running, slotBackgroundSaveFinished() will finish it
+         */
+        if (m_savingInBackground) {
+            return;
+        }
+
         emit documentSavedOrUploaded(this, m_documentState == DocumentSavingAs);
     }
 
@@ -5386,6 +5672,88 @@ void KTextEditor::DocumentPrivate::slotCompleted()
     m_reloading = false;
 }
 
+void KTextEditor::DocumentPrivate::slotBackgroundSaveFinished(const QString &, bool success)
+{
+    /**
+     * only interesting for saves started by saveFile()
+     */
+    if (!m_savingInBackground) {
+        return;
+    }
+    m_savingInBackground = false;
+    delete m_savingMessage;
+
+    if (success) {
+        // update the checksum, if it was not already computed while writing the file
+        if (checksum().isEmpty()) {
+            createDigest();
+        }
+
+        // edits done during the save go to the new swap file
+        if (m_swapfile) {
+            m_swapfile->backgroundSaveFinished(true);
+        }
+
+        // add file again to dirwatch, after we are done with writing
+        activateDirWatch();
+
+        if (m_modOnHd) {
+            m_modOnHd = false;
+            m_modOnHdReason = OnDiskUnmodified;
+            m_prevModOnHdReason = OnDiskUnmodified;
+            emit modifiedOnDisk(this, m_modOnHd, m_modOnHdReason);
+        }
+
+        // without edits meanwhile, all lines are on disk now, else the document stays modified
+        if (!isModified() && m_undoManager) {
+            m_undoManager->updateLineModifications();
+        }
+
+        if (m_documentState == DocumentSaving || m_documentState == DocumentSavingAs) {
+            emit documentSavedOrUploaded(this, m_documentState == DocumentSavingAs);
+        }
+    } else {
+        if (m_swapfile) {
+            m_swapfile->backgroundSaveFinished(false);
+        }
+        activateDirWatch();
+
+        // nothing got saved
+        setModified(true);
+        KMessageBox::error(dialogParent(), i18n("The document could not be saved, as it was not possible to write to %1.\nCheck that you have write access to this file or that enough disk space is available.\nThe original file may be lost or damaged. Don't quit the application until the file is successfully written.", this->url().toDisplayString(QUrl::PreferLocalFile)));
+    }
+
+    /**
+     * back to idle mode
+     */
+    m_documentState = DocumentIdle;
+}
+
+void KTextEditor::DocumentPrivate::slotBackgroundSaveProgress(int savedLines, int totalLines)
+{
+    if (!m_savingMessage || totalLines <= 0) {
+        return;
+    }
+
+    m_savingMessage->setText(i18n("The file <a href=\"%1\">%2</a> is being saved, %3% done.", url().toDisplayString(QUrl::PreferLocalFile), url().fileName(), qint64(savedLines) * 100 / totalLines));
+}
+
+void KTextEditor::DocumentPrivate::slotTriggerSavingMessage()
+{
+    /**
+     * no longer saving?
+     * no message needed!
+     */
+    if (!m_savingInBackground) {
+        return;
+    }
+
+    delete m_savingMessage;
+    m_savingMessage = new KTextEditor::Message(i18n("The file <a href=\"%1\">%2</a> is being saved.", url().toDisplayString(QUrl::PreferLocalFile), url().fileName()));
+    m_savingMessage->setPosition(KTextEditor::Message::TopInView);
+    postMessage(m_savingMessage);
+}
+
 void KTextEditor::DocumentPrivate::slotCanceled()
 {
     /**
@@ -5637,6 +6005,11 @@ void KTextEditor::DocumentPrivate::setDefaultDictionary(const QString &dict)
 
 void KTextEditor::DocumentPrivate::onTheFlySpellCheckingEnabled(bool enable)
 {
+    // no spell checking in the viewer mode for huge files
+    if (enable && m_hugeFileMode) {
+        return;
+    }
+
     if (isOnTheFlySpellCheckingEnabled() == enable) {
         return;
     }
@@ -5724,8 +6097,9 @@ bool KTextEditor::DocumentPrivate::containsCharacterEncoding(const KTextEditor::
         textLine = kateTextLine(line);
         int startColumn = (line == rangeStartLine) ? rangeStartColumn : 0;
         int endColumn = (line == rangeEndLine) ? rangeEndColumn : textLine->length();
+        Kate::TextLineData::AttributeIterator attributes(*textLine);
         for (int col = startColumn; col < endColumn; ++col) {
-            int attr = textLine->attribute(col);
+            int attr = attributes.attribute(col);
             const KatePrefixStore &prefixStore = highlighting->getCharacterEncodingsPrefixStore(attr);
             if (!prefixStore.findPrefix(textLine, col).isEmpty()) {
                 return true;
@@ -5769,8 +6143,9 @@ QString KTextEditor::DocumentPrivate::decodeCharacters(const KTextEditor::Range
         textLine = kateTextLine(line);
         int startColumn = (line == rangeStartLine) ? rangeStartColumn : 0;
         int endColumn = (line == rangeEndLine) ? rangeEndColumn : textLine->length();
+        Kate::TextLineData::AttributeIterator attributes(*textLine);
         for (int col = startColumn; col < endColumn;) {
-            int attr = textLine->attribute(col);
+            int attr = attributes.attribute(col);
             const KatePrefixStore &prefixStore = highlighting->getCharacterEncodingsPrefixStore(attr);
             const QHash<QString, QChar> &characterEncodingsHash = highlighting->getCharacterEncodings(attr);
             QString matchingPrefix = prefixStore.findPrefix(textLine, col);
@@ -5897,8 +6272,8 @@ int KTextEditor::DocumentPrivate::defStyleNum(int line, int column)
     if (column < tl->length()) {
         attribute = tl->attribute(column);
     } else if (column == tl->length()) {
-        if (!tl->attributesList().isEmpty()) {
-            attribute = tl->attributesList().back().attributeValue;
+        if (tl->hasAttributes()) {
+            attribute = tl->lastAttribute();
         } else {
             return -1;
         }
@@ -81,7 +81,7 @@ class KTEXTEDITOR_EXPORT KTextEditor::DocumentPrivate : public KTextEditor::Docu
     public KTextEditor::ModificationInterface,
     public KTextEditor::ConfigInterface,
     public KTextEditor::AnnotationInterface,
-    public KTextEditor::MovingInterface,
+    public KTextEditor::MovingInterfaceV2,
     private KTextEditor::MovingRangeFeedback
 {
     Q_OBJECT
@@ -90,6 +90,7 @@ class KTEXTEDITOR_EXPORT KTextEditor::DocumentPrivate : public KTextEditor::Docu
     Q_INTERFACES(KTextEditor::AnnotationInterface)
     Q_INTERFACES(KTextEditor::ConfigInterface)
     Q_INTERFACES(KTextEditor::MovingInterface)
+    Q_INTERFACES(KTextEditor::MovingInterfaceV2)
 
     friend class KTextEditor::Document;
     friend class ::KateDocumentTest;
@@ -172,6 +173,13 @@ public Q_SLOTS:
 
     bool replaceText(const KTextEditor::Range &range, const QString &s, bool block = false) override;
 
+    /**
+     * Apply a batch of edits, see KTextEditor::Document::applyEdits().
+     * @param edits pairs of range to replace and the text to replace it with
+     * @return success
+     */
+    bool applyEdits(const QVector<QPair<KTextEditor::Range, QString> > &edits);
+
     // unhide method...
     bool replaceText(const KTextEditor::Range &r, const QStringList &l, bool b) override
     {
@@ -377,6 +385,11 @@ private:
     bool editIsRunning = false;
     bool m_undoMergeAllEdits = false;
     KTextEditor::Cursor m_editLastChangeStartCursor = KTextEditor::Cursor::invalid();
+
+    /**
+     * applyEdits() running, it emits coalesced textInserted/textRemoved signals
+     */
+    bool m_applyingEdits = false;
     QStack<QSharedPointer<KTextEditor::MovingCursor>> m_editingStack;
     int m_editingStackPosition = -1;
 
@@ -403,13 +416,17 @@ public:
     uint undoCount() const;
     uint redoCount() const;
 
+    /**
+     * Undo manager of this document.
+     * @return undo manager, nullptr in the read-only viewer mode for huge files
+     */
     KateUndoManager *undoManager()
     {
         return m_undoManager;
     }
 
 protected:
-    KateUndoManager *const m_undoManager;
+    KateUndoManager *m_undoManager;
 
 Q_SIGNALS:
     void undoChanged();
@@ -697,6 +714,16 @@ public:
      */
     void transformCursor(int &line, int &column, KTextEditor::MovingCursor::InsertBehavior insertBehavior, qint64 fromRevision, qint64 toRevision = -1) override;
 
+    /**
+     * Transform a sorted list of cursors from one revision to an other.
+     * Much faster than transforming each cursor on its own for many cursors.
+     * @param cursors cursors to transform, must be sorted ascending, transformed in place
+     * @param insertBehavior behavior of the cursors on insert of text at their position
+     * @param fromRevision from this revision we want to transform
+     * @param toRevision to this revision we want to transform, default of -1 is current revision
+     */
+    void transformCursors(QVector<KTextEditor::Cursor> &cursors, KTextEditor::MovingCursor::InsertBehavior insertBehavior, qint64 fromRevision, qint64 toRevision = -1) override;
+
     /**
      * Transform a range from one revision to an other.
      * @param range range to transform
@@ -1272,7 +1299,7 @@ protected:
     void deleteDictionaryRange(KTextEditor::MovingRange *movingRange);
 
 private:
-    Kate::SwapFile *m_swapfile;
+    Kate::SwapFile *m_swapfile = nullptr;
 
 public:
     Kate::SwapFile *swapFile();
@@ -1303,6 +1330,21 @@ private Q_SLOTS:
      */
     void slotTriggerLoadingMessage();
 
+    /**
+     * trigger display of saving message for background saves, after 1000 ms
+     */
+    void slotTriggerSavingMessage();
+
+    /**
+     * update the saving message with the progress of a background save
+     */
+    void slotBackgroundSaveProgress(int savedLines, int totalLines);
+
+    /**
+     * background save started by saveFile() is done
+     */
+    void slotBackgroundSaveFinished(const QString &filename, bool success);
+
     /**
      * Abort loading
      */
@@ -1365,6 +1407,16 @@ private:
      */
     QPointer<KTextEditor::Message> m_loadingMessage;
 
+    /**
+     * message to show during background saves
+     */
+    QPointer<KTextEditor::Message> m_savingMessage;
+
+    /**
+     * is a background save started by saveFile() running?
+     */
+    bool m_savingInBackground = false;
+
     /**
      * Was there any open error on last file loading?
      */
@@ -1384,6 +1436,80 @@ public:
 public Q_SLOTS:
     void openWithLineLengthLimitOverride();
 
+    //
+    // huge file viewer mode
+    //
+public:
+    /**
+     * Read-only viewer mode for huge files, entered automatically for files larger than
+     * the configured "Huge File Threshold" or explicitly with this function.
+     * Undo history, swap file recovery, on-the-fly spell checking and word counting are
+     * disabled, highlighting is only done around the viewed lines.
+     * Enabling the read-write mode again leaves the viewer mode.
+     * @param enabled enter or leave the viewer mode
+     */
+    void setHugeFileMode(bool enabled);
+
+    /**
+     * Is the document in the read-only viewer mode for huge files?
+     * @return viewer mode active
+     */
+    bool isHugeFileMode() const
+    {
+        return m_hugeFileMode;
+    }
+
+    /**
+     * Memory released on entering the read-only viewer mode for huge files.
+     * Measured on entering the mode: the undo manager with its undo and redo history
+     * and the swap file with its buffered edits.
+     * @return released memory in bytes, 0 if not in the viewer mode
+     */
+    qint64 hugeFileModeSavedMemory() const
+    {
+        return m_hugeFileModeSavedMemory;
+    }
+
+
+Q_SIGNALS:
+    /**
+     * The read-only viewer mode for huge files was entered or left.
+     * @param document document
+     */
+    void hugeFileModeChanged(KTextEditor::DocumentPrivate *document);
+
+private:
+    /**
+     * Enter or leave the viewer mode, without changing the explicit request.
+     * @param enabled enter or leave the viewer mode
+     */
+    void updateHugeFileMode(bool enabled);
+
+    /**
+     * Create the undo manager, done on construction and on leaving the viewer mode for huge files.
+     */
+    void createUndoManager();
+
+    /**
+     * Create the swap file if enabled, done on construction and on leaving the viewer mode for huge files.
+     */
+    void createSwapFile();
+
+    /**
+     * in the read-only viewer mode for huge files?
+     */
+    bool m_hugeFileMode = false;
+
+    /**
+     * viewer mode explicitly requested via setHugeFileMode(), kept on reload
+     */
+    bool m_hugeFileModeRequested = false;
+
+    /**
+     * memory released on entering the viewer mode, see hugeFileModeSavedMemory()
+     */
+    qint64 m_hugeFileModeSavedMemory = 0;
+
 private:
     /**
      * timer for delayed handling of mod on hd
@@ -33,6 +33,8 @@
 // the list of views
 #include <QList>
 #include <QMetaType>
+#include <QPair>
+#include <QVector>
 
 class KConfigGroup;
 
@@ -783,6 +785,20 @@ public:
      */
     virtual bool replaceText(const Range &range, const QStringList &text, bool block = false);
 
+    /**
+     * Replace several ranges at once, e.g. for formatters or workspace edits.
+     * All ranges refer to the document before any of the edits is applied
+     * and must not overlap, insertions at the same position end up in the given order.
+     * The edits are applied in one editing transaction and undone as one step.
+     * Instead of signals for each edit, textRemoved() and textInserted() are
+     * emitted once for the range spanning all edits.
+     * \param edits pairs of range to replace and the text to replace it with
+     * \return \e true on success, otherwise \e false and nothing is changed
+     * \see replaceText()
+     * \since 5.57
+     */
+    bool applyEdits(const QVector<QPair<KTextEditor::Range, QString> > &edits);
+
     /**
      * Remove the text specified in \p range.
      * \param range range of text to remove
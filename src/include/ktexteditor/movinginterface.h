@@ -29,6 +29,8 @@
 #include <ktexteditor/movingrange.h>
 #include <ktexteditor/movingrangefeedback.h>
 
+#include <QVector>
+
 namespace KTextEditor
 {
 
@@ -176,9 +178,51 @@ private:
     class MovingInterfacePrivate *const d = nullptr;
 };
 
+/**
+ * \brief Extension of the MovingInterface to transform many cursors at once.
+ *
+ * \ingroup kte_group_doc_extensions
+ * \ingroup kte_group_moving_classes
+ *
+ * The MovingInterfaceV2 is an extension interface for a Document, use qobject_cast to access it:
+ * \code
+ * // document is of type KTextEditor::Document*
+ * auto iface = qobject_cast<KTextEditor::MovingInterfaceV2*>(document);
+ *
+ * if (iface) {
+ *     // the implementation supports the interface
+ *     iface->transformCursors(cursors, KTextEditor::MovingCursor::MoveOnInsert, revision);
+ * }
+ * \endcode
+ *
+ * \since 5.57
+ */
+class KTEXTEDITOR_EXPORT MovingInterfaceV2 : public MovingInterface
+{
+    // KF6: Merge KTextEditor::MovingInterfaceV2 into KTextEditor::MovingInterface
+public:
+    virtual ~MovingInterfaceV2() {}
+
+    /**
+     * Transform a sorted list of cursors from one revision to an other.
+     * Gives the same result as transformCursor() for each of them, but walks the history only once,
+     * e.g. for the diagnostics or symbol positions of a whole document.
+     * If a revision is no longer part of the history, all cursors are set invalid.
+     * @param cursors cursors to transform, must be sorted ascending, transformed in place
+     * @param insertBehavior behavior of the cursors on insert of text at their position
+     * @param fromRevision from this revision we want to transform
+     * @param toRevision to this revision we want to transform, default of -1 is current revision
+     */
+    virtual void transformCursors(QVector<KTextEditor::Cursor> &cursors,
+                                  KTextEditor::MovingCursor::InsertBehavior insertBehavior,
+                                  qint64 fromRevision,
+                                  qint64 toRevision = -1) = 0;
+};
+
 }
 
 Q_DECLARE_INTERFACE(KTextEditor::MovingInterface, "org.kde.KTextEditor.MovingInterface")
+Q_DECLARE_INTERFACE(KTextEditor::MovingInterfaceV2, "org.kde.KTextEditor.MovingInterfaceV2")
 
 #endif
 
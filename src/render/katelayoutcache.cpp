@@ -134,6 +134,19 @@ void KateLineLayoutMap::slotEditDone(int fromLine, int toLine, int shiftAmount)
     }
 }
 
+void KateLineLayoutMap::releaseTextLines(int startRealLine, int endRealLine)
+{
+    LineLayoutMap::iterator start =
+        std::lower_bound(m_lineLayouts.begin(), m_lineLayouts.end(), LineLayoutPair(startRealLine, KateLineLayoutPtr()), lessThan);
+    LineLayoutMap::iterator end =
+        std::upper_bound(start, m_lineLayouts.end(), LineLayoutPair(endRealLine, KateLineLayoutPtr()), lessThan);
+
+    while (start != end) {
+        (*start).second->releaseTextLine();
+        ++start;
+    }
+}
+
 KateLineLayoutPtr &KateLineLayoutMap::operator[](int i)
 {
     LineLayoutMap::iterator it =
@@ -159,6 +172,11 @@ KateLayoutCache::KateLayoutCache(KateRenderer *renderer, QObject *parent)
     connect(&m_renderer->doc()->buffer(), SIGNAL(lineUnwrapped(int)), this, SLOT(unwrapLine(int)));
     connect(&m_renderer->doc()->buffer(), SIGNAL(textInserted(KTextEditor::Cursor,QString)), this, SLOT(insertText(KTextEditor::Cursor,QString)));
     connect(&m_renderer->doc()->buffer(), SIGNAL(textRemoved(KTextEditor::Range,QString)), this, SLOT(removeText(KTextEditor::Range)));
+
+    /**
+     * compressed lines are recreated on their next access, don't keep the old ones
+     */
+    connect(&m_renderer->doc()->buffer(), SIGNAL(linesCompressed(int,int)), this, SLOT(linesCompressed(int,int)));
 }
 
 void KateLayoutCache::updateViewCache(const KTextEditor::Cursor &startPos, int newViewLineCount, int viewLinesScrolled)
@@ -538,6 +556,11 @@ void KateLayoutCache::removeText(const KTextEditor::Range &range)
     m_lineLayouts.slotEditDone(range.start().line(), range.start().line(), 0);
 }
 
+void KateLayoutCache::linesCompressed(int fromLine, int toLine)
+{
+    m_lineLayouts.releaseTextLines(fromLine, toLine);
+}
+
 void KateLayoutCache::clear()
 {
     m_textLayouts.clear();
@@ -49,6 +49,8 @@ public:
 
     inline void slotEditDone(int fromLine, int toLine, int shiftAmount);
 
+    inline void releaseTextLines(int startRealLine, int endRealLine);
+
     KateLineLayoutPtr &operator[](int i);
 
     typedef QPair<int, KateLineLayoutPtr> LineLayoutPair;
@@ -144,6 +146,7 @@ private Q_SLOTS:
     void unwrapLine(int line);
     void insertText(const KTextEditor::Cursor &position, const QString &text);
     void removeText(const KTextEditor::Range &range);
+    void linesCompressed(int fromLine, int toLine);
 
 private:
     KateRenderer *m_renderer;
@@ -27,6 +27,7 @@
 #include "katepartdebug.h"
 
 #include "katedocument.h"
+#include "katebuffer.h"
 #include "katerenderer.h"
 
 KateLineLayout::KateLineLayout(KateRenderer &renderer)
@@ -66,7 +67,11 @@ bool KateLineLayout::includesCursor(const KTextEditor::Cursor &realCursor) const
 const Kate::TextLine &KateLineLayout::textLine(bool reloadForce) const
 {
     if (reloadForce || !m_textLine) {
-        m_textLine = usePlainTextLine() ? m_renderer.doc()->plainKateTextLine(line()) : m_renderer.doc()->kateTextLine(line());
+        // far away lines are highlighted in the background, they get tagged once done
+        if (!usePlainTextLine()) {
+            m_renderer.doc()->buffer().ensureHighlightedForDisplay(line());
+        }
+        m_textLine = m_renderer.doc()->plainKateTextLine(line());
     }
 
     Q_ASSERT(m_textLine);
@@ -74,6 +79,11 @@ const Kate::TextLine &KateLineLayout::textLine(bool reloadForce) const
     return m_textLine;
 }
 
+void KateLineLayout::releaseTextLine()
+{
+    m_textLine = Kate::TextLine();
+}
+
 int KateLineLayout::line() const
 {
     return m_line;
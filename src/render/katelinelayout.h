@@ -56,6 +56,11 @@ public:
     friend bool operator<= (const KateLineLayout &r, const KTextEditor::Cursor &c);
 
     const Kate::TextLine &textLine(bool forceReload = false) const;
+    /**
+     * Forget the text line, the next textLine() call fetches it from the document again.
+     * Needed if the buffer recreated the line object, e.g. after compressing its block.
+     */
+    void releaseTextLine();
     int length() const;
 
     int line() const;
@@ -385,18 +385,27 @@ QVector<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::T
     QVector<QTextLayout::FormatRange> newHighlight;
 
     // Don't compute the highlighting if there isn't going to be any highlighting
-    QList<Kate::TextRange *> rangesWithAttributes = m_doc->buffer().rangesForLine(line, m_printerFriendly ? nullptr : m_view, true);
-    if (selectionsOnly || !textLine->attributesList().isEmpty() || !rangesWithAttributes.isEmpty()) {
+    // collect the ranges without allocations, this is done for each painted line
+    QVarLengthArray<Kate::TextRange *, 16> rangesWithAttributes;
+    m_doc->buffer().forEachRangeForLine(line, m_printerFriendly ? nullptr : m_view, true, [&rangesWithAttributes](Kate::TextRange *range) {
+        rangesWithAttributes.append(range);
+    });
+    if (selectionsOnly || textLine->hasAttributes() || !rangesWithAttributes.isEmpty()) {
+        // all render ranges live on the stack, the list only points to them
         RenderRangeList renderRanges;
 
         // Add the inbuilt highlighting to the list
-        NormalRenderRange *inbuiltHighlight = new NormalRenderRange();
-        const QVector<Kate::TextLineData::Attribute> &al = textLine->attributesList();
-        for (int i = 0; i < al.count(); ++i)
-            if (al[i].length > 0 && al[i].attributeValue > 0) {
-                inbuiltHighlight->addRange(new KTextEditor::Range(KTextEditor::Cursor(line, al[i].offset), al[i].length), specificAttribute(al[i].attributeValue));
+        NormalRenderRange inbuiltHighlight;
+        textLine->forEachAttribute([this, line, &inbuiltHighlight](const Kate::TextLineData::Attribute &attribute) {
+            if (attribute.length > 0 && attribute.attributeValue > 0) {
+                inbuiltHighlight.addRange(KTextEditor::Range(KTextEditor::Cursor(line, attribute.offset), attribute.length), specificAttribute(attribute.attributeValue));
             }
-        renderRanges.append(inbuiltHighlight);
+        });
+        renderRanges.append(&inbuiltHighlight);
+
+        // one render range for each range, sized up-front, the list keeps pointers into it
+        QVarLengthArray<NormalRenderRange, 8> additionalHighlights;
+        NormalRenderRange selectionHighlight;
 
         if (!completionHighlight) {
             // check for dynamic hl stuff
@@ -408,6 +417,7 @@ QVector<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::T
             std::sort(rangesWithAttributes.begin(), rangesWithAttributes.end(), rangeLessThanForRenderer);
 
             // loop over all ranges
+            additionalHighlights.resize(rangesWithAttributes.size());
             for (int i = 0; i < rangesWithAttributes.size(); ++i) {
                 // real range
                 Kate::TextRange *kateRange = rangesWithAttributes[i];
@@ -431,9 +441,8 @@ QVector<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::T
                 }
 
                 // span range
-                NormalRenderRange *additionaHl = new NormalRenderRange();
-                additionaHl->addRange(new KTextEditor::Range(*kateRange), attribute);
-                renderRanges.append(additionaHl);
+                additionalHighlights[i].addRange(kateRange->toRange(), attribute);
+                renderRanges.append(&additionalHighlights[i]);
             }
         } else {
             // Add the code completion arbitrary highlight to the list
@@ -442,8 +451,6 @@ QVector<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::T
 
         // Add selection highlighting if we're creating the selection decorations
         if ((m_view && selectionsOnly && showSelections() && m_view->selection()) || (completionHighlight && completionSelected) || (m_view && m_view->blockSelection())) {
-            NormalRenderRange *selectionHighlight = new NormalRenderRange();
-
             // Set up the selection background attribute TODO: move this elsewhere, eg. into the config?
             static KTextEditor::Attribute::Ptr backgroundAttribute;
             if (!backgroundAttribute) {
@@ -455,14 +462,14 @@ QVector<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::T
 
             // Create a range for the current selection
             if (completionHighlight && completionSelected) {
-                selectionHighlight->addRange(new KTextEditor::Range(line, 0, line + 1, 0), backgroundAttribute);
+                selectionHighlight.addRange(KTextEditor::Range(line, 0, line + 1, 0), backgroundAttribute);
             } else if (m_view->blockSelection() && m_view->selectionRange().overlapsLine(line)) {
-                selectionHighlight->addRange(new KTextEditor::Range(m_doc->rangeOnLine(m_view->selectionRange(), line)), backgroundAttribute);
+                selectionHighlight.addRange(m_doc->rangeOnLine(m_view->selectionRange(), line), backgroundAttribute);
             } else {
-                selectionHighlight->addRange(new KTextEditor::Range(m_view->selectionRange()), backgroundAttribute);
+                selectionHighlight.addRange(m_view->selectionRange(), backgroundAttribute);
             }
 
-            renderRanges.append(selectionHighlight);
+            renderRanges.append(&selectionHighlight);
             // highlighting for the vi visual modes
         }
 
@@ -523,14 +530,6 @@ QVector<QTextLayout::FormatRange> KateRenderer::decorationsForLine(const Kate::T
 
             currentPosition = nextPosition;
         }
-
-        if (completionHighlight)
-            // Don't delete external completion render range
-        {
-            renderRanges.removeAll(completionHighlight);
-        }
-
-        qDeleteAll(renderRanges);
     }
 
     return newHighlight;
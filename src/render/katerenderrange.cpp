@@ -87,13 +87,9 @@ NormalRenderRange::NormalRenderRange()
 
 NormalRenderRange::~NormalRenderRange()
 {
-    QVectorIterator<pairRA> it = m_ranges;
-    while (it.hasNext()) {
-        delete it.next().first;
-    }
 }
 
-void NormalRenderRange::addRange(KTextEditor::Range *range, KTextEditor::Attribute::Ptr attribute)
+void NormalRenderRange::addRange(const KTextEditor::Range &range, KTextEditor::Attribute::Ptr attribute)
 {
     m_ranges.append(pairRA(range, attribute));
 }
@@ -108,19 +104,19 @@ bool NormalRenderRange::advanceTo(const KTextEditor::Cursor &pos)
     int index = m_currentRange;
     while (index < m_ranges.count()) {
         const pairRA &p = m_ranges.at(index);
-        KTextEditor::Range *r = p.first;
-        if (r->end() <= pos) {
+        const KTextEditor::Range &r = p.first;
+        if (r.end() <= pos) {
             ++index;
         } else {
             bool ret = index != m_currentRange;
             m_currentRange = index;
 
-            if (r->start() > pos) {
-                m_nextBoundary = r->start();
+            if (r.start() > pos) {
+                m_nextBoundary = r.start();
             } else {
-                m_nextBoundary = r->end();
+                m_nextBoundary = r.end();
             }
-            if (r->contains(pos)) {
+            if (r.contains(pos)) {
                 m_currentAttribute = p.second;
             } else {
                 m_currentAttribute.reset();
@@ -144,7 +140,7 @@ KTextEditor::Cursor RenderRangeList::nextBoundary() const
 {
     KTextEditor::Cursor ret = m_currentPos;
     bool first = true;
-    foreach (KateRenderRange *r, *this) {
+    for (KateRenderRange *r : *this) {
         if (first) {
             ret = r->nextBoundary();
             first = false;
@@ -165,23 +161,21 @@ RenderRangeList::~RenderRangeList()
 
 void RenderRangeList::advanceTo(const KTextEditor::Cursor &pos)
 {
-    foreach (KateRenderRange *r, *this) {
+    for (KateRenderRange *r : *this) {
         r->advanceTo(pos);
     }
 
-    //Delete lists that are ready, else the list may get too large due to temporaries
+    //Drop lists that are ready, else the list may get too large due to temporaries, they are owned by the caller
     for (int a = size() - 1; a >= 0; --a) {
-        KateRenderRange *r = at(a);
-        if (r->isReady()) {
-            delete r;
-            removeAt(a);
+        if (at(a)->isReady()) {
+            remove(a);
         }
     }
 }
 
 bool RenderRangeList::hasAttribute() const
 {
-    foreach (KateRenderRange *r, *this)
+    for (KateRenderRange *r : *this)
         if (r->currentAttribute()) {
             return true;
         }
@@ -194,7 +188,7 @@ KTextEditor::Attribute::Ptr RenderRangeList::generateAttribute() const
     KTextEditor::Attribute::Ptr a;
     bool ownsAttribute = false;
 
-    foreach (KateRenderRange *r, *this) {
+    for (KateRenderRange *r : *this) {
         if (KTextEditor::Attribute::Ptr a2 = r->currentAttribute()) {
             if (!a) {
                 a = a2;
@@ -27,6 +27,7 @@
 
 #include <QList>
 #include <QPair>
+#include <QVarLengthArray>
 
 class KateRenderRange
 {
@@ -38,7 +39,7 @@ public:
     virtual bool isReady() const;
 };
 
-typedef QPair<KTextEditor::Range *, KTextEditor::Attribute::Ptr> pairRA;
+typedef QPair<KTextEditor::Range, KTextEditor::Attribute::Ptr> pairRA;
 
 class NormalRenderRange : public KateRenderRange
 {
@@ -46,20 +47,22 @@ public:
     NormalRenderRange();
     ~NormalRenderRange() override;
 
-    void addRange(KTextEditor::Range *range, KTextEditor::Attribute::Ptr attribute);
+    void addRange(const KTextEditor::Range &range, KTextEditor::Attribute::Ptr attribute);
 
     KTextEditor::Cursor nextBoundary() const override;
     bool advanceTo(const KTextEditor::Cursor &pos) override;
     KTextEditor::Attribute::Ptr currentAttribute() const override;
 
 private:
-    QVector<pairRA> m_ranges;
+    // ranges by value, a few of them fit without any allocation
+    QVarLengthArray<pairRA, 8> m_ranges;
     KTextEditor::Cursor m_nextBoundary;
     KTextEditor::Attribute::Ptr m_currentAttribute;
     int m_currentRange = 0;
 };
 
-class RenderRangeList : public QVector<KateRenderRange *>
+// doesn't own the render ranges, they are usually created on the stack of the caller
+class RenderRangeList : public QVarLengthArray<KateRenderRange *, 16>
 {
 public:
     ~RenderRangeList();
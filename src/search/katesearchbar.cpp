@@ -791,6 +791,11 @@ void KateSearchBar::sendConfig()
 
 void KateSearchBar::replaceNext()
 {
+    // nothing to replace in read-only documents, e.g. the huge file viewer mode has no undo manager
+    if (!m_view->doc()->isReadWrite()) {
+        return;
+    }
+
     const QString replacement = m_powerUi->replacement->currentText();
 
     if (findOrReplace(SearchForward, &replacement)) {
@@ -981,7 +986,7 @@ void KateSearchBar::endFindOrReplaceAll()
     m_powerUi->searchCancelStacked->setCurrentIndex(m_powerUi->searchCancelStacked->indexOf(m_powerUi->searchPage));
     m_powerUi->findNext->setEnabled(true);
     m_powerUi->findPrev->setEnabled(true);
-    m_powerUi->replaceNext->setEnabled(true);
+    m_powerUi->replaceNext->setEnabled(m_view->doc()->isReadWrite());
 
     // Add to search history
     addCurrentTextToHistory(m_powerUi->pattern);
@@ -995,6 +1000,11 @@ void KateSearchBar::endFindOrReplaceAll()
 
 void KateSearchBar::replaceAll()
 {
+    // nothing to replace in read-only documents, e.g. the huge file viewer mode has no undo manager
+    if (!m_view->doc()->isReadWrite()) {
+        return;
+    }
+
     // clear prior highlightings (deletes info message if present)
     clearHighlights();
 
@@ -174,8 +174,9 @@ QList<QPair<KTextEditor::Range, QString> > KateSpellCheckManager::spellCheckWrtH
             }
             const int start = (line == startLine) ? startColumn : 0;
             const int end = (line == endLine) ? endColumn : kateTextLine->length();
+            Kate::TextLineData::AttributeIterator attributes(*kateTextLine);
             for (int i = start; i < end;) { // WARNING: 'i' has to be incremented manually!
-                int attr = kateTextLine->attribute(i);
+                int attr = attributes.attribute(i);
                 const KatePrefixStore &prefixStore = highlighting->getCharacterEncodingsPrefixStore(attr);
                 QString prefixFound = prefixStore.findPrefix(kateTextLine, i);
                 if (!document->highlight()->attributeRequiresSpellchecking(static_cast<unsigned int>(attr))
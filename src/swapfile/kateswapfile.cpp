@@ -140,6 +140,11 @@ KTextEditor::DocumentPrivate *SwapFile::document()
     return m_document;
 }
 
+qint64 SwapFile::memoryUsage() const
+{
+    return sizeof(*this) + m_swapfile.bytesToWrite() + m_editsDuringSave.capacity();
+}
+
 bool SwapFile::isValidSwapFile(QDataStream &stream, bool checkDigest) const
 {
     // read and check header
@@ -165,6 +170,11 @@ bool SwapFile::isValidSwapFile(QDataStream &stream, bool checkDigest) const
 
 void SwapFile::fileLoaded(const QString &)
 {
+    // no recovery in the read-only viewer mode for huge files
+    if (m_document->isHugeFileMode()) {
+        return;
+    }
+
     // look for swap file
     if (!updateFileName()) {
         return;
@@ -201,7 +211,8 @@ void SwapFile::fileLoaded(const QString &)
 
 void SwapFile::modifiedChanged()
 {
-    if (!m_document->isModified() && !shouldRecover()) {
+    // during a background save, the edits are needed until it is done, see fileSaved()
+    if (!m_document->isModified() && !shouldRecover() && m_backgroundSaveOffset == -1) {
         m_needSync = false;
         // the file is not modified and we are not in recover mode
         removeSwapFile();
@@ -418,6 +429,16 @@ void SwapFile::fileSaved(const QString &)
 {
     m_needSync = false;
 
+    // keep the edits done during a background save, the saved file doesn't contain them
+    m_editsDuringSave.clear();
+    if (m_backgroundSaveOffset >= 0 && m_swapfile.isOpen()) {
+        m_swapfile.flush();
+        QFile swapfile(m_swapfile.fileName());
+        if (swapfile.open(QIODevice::ReadOnly) && swapfile.seek(m_backgroundSaveOffset)) {
+            m_editsDuringSave = swapfile.readAll();
+        }
+    }
+
     // remove old swap file (e.g. if a file A was "saved as" B)
     removeSwapFile();
 
@@ -432,6 +453,14 @@ void SwapFile::startEditing()
         return;
     }
 
+    openSwapFile();
+
+    // format: qint8
+    m_stream << EA_StartEditing;
+}
+
+void SwapFile::openSwapFile()
+{
     // if swap file doesn't exists, open it in WriteOnly mode
     // if it does, append the data to the existing swap file,
     // in case you recover and start editing again
@@ -451,14 +480,42 @@ void SwapFile::startEditing()
 
         // write checksum
         m_stream << m_document->checksum();
+
+        // edits not part of the file saved in the background, they are in the same format
+        m_swapfile.write(m_editsDuringSave);
+        m_editsDuringSave.clear();
+
+        // a background save runs, its edits start here
+        if (m_backgroundSaveOffset == -2) {
+            m_backgroundSaveOffset = m_swapfile.pos();
+        }
     } else if (m_stream.device() == nullptr) {
         m_swapfile.open(QIODevice::Append);
         m_swapfile.setPermissions(QFileDevice::ReadOwner|QFileDevice::WriteOwner);
         m_stream.setDevice(&m_swapfile);
     }
+}
 
-    // format: qint8
-    m_stream << EA_StartEditing;
+void SwapFile::backgroundSaveStarted()
+{
+    // saves are never started inside an editing transaction, the next edit starts a new one
+    m_backgroundSaveOffset = m_swapfile.isOpen() ? m_swapfile.pos() : -2;
+}
+
+void SwapFile::backgroundSaveFinished(bool success)
+{
+    m_backgroundSaveOffset = -1;
+
+    // failed save: the swap file still holds all edits against the old file
+    if (!success || m_editsDuringSave.isEmpty() || m_swapfile.fileName().isEmpty()) {
+        m_editsDuringSave.clear();
+        return;
+    }
+
+    // new swap file with the edits against the saved file
+    openSwapFile();
+    m_swapfile.flush();
+    m_needSync = true;
 }
 
 void SwapFile::finishEditing()
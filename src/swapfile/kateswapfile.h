@@ -56,10 +56,30 @@ public:
     void fileClosed();
     QString fileName();
 
+    /**
+     * A background save of the document was started.
+     * Edits done until it is finished are not part of the saved file, they are kept for the new swap file.
+     */
+    void backgroundSaveStarted();
+
+    /**
+     * The background save is done, after fileSaved() if it worked.
+     * Writes the swap file for the edits done during the save, needs the new checksum of the document.
+     * @param success did the save work?
+     */
+    void backgroundSaveFinished(bool success);
+
     KTextEditor::DocumentPrivate *document();
 
+    /**
+     * Memory used by the swap file, including edits not yet written and edits kept during a background save.
+     * @return memory usage in bytes
+     */
+    qint64 memoryUsage() const;
+
 private:
     void setTrackingEnabled(bool trackingEnabled);
+    void openSwapFile();
     void removeSwapFile();
     bool updateFileName();
     bool isValidSwapFile(QDataStream &stream, bool checkDigest) const;
@@ -94,6 +114,17 @@ private:
     bool m_needSync;
     static QTimer *s_timer;
 
+    /**
+     * Offset in the swap file of the first edit after the start of a background save,
+     * -1 if no background save runs, -2 if the swap file was not yet created then.
+     */
+    qint64 m_backgroundSaveOffset = -1;
+
+    /**
+     * Edits done during the last background save, to be written to the new swap file.
+     */
+    QByteArray m_editsDuringSave;
+
 protected Q_SLOTS:
     void writeFileToDisk();
 
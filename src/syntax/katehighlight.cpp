@@ -39,6 +39,7 @@
 #include <KConfigGroup>
 #include <KMessageBox>
 
+#include <QElapsedTimer>
 #include <QSet>
 #include <QStringList>
 #include <QTextStream>
@@ -50,6 +51,41 @@
 //BEGIN STATICS
 namespace {
 
+/**
+ * Lines longer than this are checked against the time budget, by timing a first chunk of about this length
+ */
+const int KATE_HL_LINE_CHUNK = 16 * 1024;
+
+/**
+ * Time in milliseconds a line may take in doHighlight, the rest of it is continued later
+ */
+const int KATE_HL_LINE_BUDGET = 20;
+
+/**
+ * End of the chunk starting at the given offset.
+ * Prefers to cut behind a separator, constructs crossing the cut see it as line end.
+ */
+int chunkEnd(const QString &text, int offset)
+{
+    int end = offset + KATE_HL_LINE_CHUNK;
+    if (end >= text.size()) {
+        return text.size();
+    }
+
+    for (int i = end; i > end - 1024; --i) {
+        const QChar c = text.at(i - 1);
+        if (c.isSpace() || c == QLatin1Char(',') || c == QLatin1Char(';') || c == QLatin1Char('}') || c == QLatin1Char('>')) {
+            return i;
+        }
+    }
+
+    // never split a surrogate pair
+    if (text.at(end - 1).isHighSurrogate()) {
+        --end;
+    }
+    return end;
+}
+
 /**
  * convert from KSyntaxHighlighting => KTextEditor type
  * special handle non-1:1 things
@@ -168,7 +204,8 @@ KateHighlighting::KateHighlighting(const KSyntaxHighlighting::Definition &def)
     }
 }
 
-void KateHighlighting::doHighlight(const Kate::TextLineData *prevLine,
+void KateHighlighting::doHighlight(KateHighlightingStates &states,
+                                   const Kate::TextLineData *prevLine,
                                    Kate::TextLineData *textLine,
                                    const Kate::TextLineData *nextLine,
                                    bool &ctxChanged,
@@ -187,6 +224,7 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *prevLine,
 
     // reset folding start
     textLine->clearMarkedAsFoldingStart();
+    textLine->setHighlightingIncomplete(false);
 
     // no hl set, nothing to do more than the above cleaning ;)
     if (noHl) {
@@ -204,15 +242,50 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *prevLine,
      * a bit ugly: we set the line to highlight as member to be able to update its stats in the applyFormat and applyFolding member functions
      */
     m_textLineToHighlight = textLine;
-    const KSyntaxHighlighting::State initialState (!prevLine ? KSyntaxHighlighting::State() : prevLine->highlightingState());
-    const KSyntaxHighlighting::State endOfLineState = highlightLine(textLine->string(), initialState);
+    const int initialStateId = prevLine ? prevLine->highlightingStateId() : 0;
+    KSyntaxHighlighting::State endOfLineState;
+    if (textLine->length() <= KATE_HL_LINE_CHUNK) {
+        endOfLineState = highlightLine(textLine->string(), states.state(initialStateId));
+    } else {
+        /**
+         * long line: time a first chunk, if the whole line fits into the budget at that pace, highlight it in one go
+         * chunks see constructs crossing their end as line end, only lines really exceeding the budget accept that
+         */
+        QElapsedTimer timer;
+        timer.start();
+        int offset = 0;
+        endOfLineState = highlightChunks(textLine->string(), offset, states.state(initialStateId), 0);
+        const qint64 projected = timer.nsecsElapsed() * textLine->length() / offset / 1000000;
+        if (projected < KATE_HL_LINE_BUDGET) {
+            m_lineAttributes.clear();
+            endOfLineState = highlightLine(textLine->string(), states.state(initialStateId));
+            offset = textLine->length();
+        } else {
+            /**
+             * pathological long line: highlight chunks within the budget, the rest stays in default style until continueHighlight()
+             * the state after the last chunk is stored as the line's state, continuation starts from it
+             */
+            endOfLineState = highlightChunks(textLine->string(), offset, endOfLineState, qMax(KATE_HL_LINE_BUDGET - int(timer.elapsed()), 1));
+        }
+        if (offset < textLine->length()) {
+            textLine->setHighlightingIncomplete(true);
+            ++m_linesOverBudget;
+        }
+    }
     m_textLineToHighlight = nullptr;
 
     /**
-     * update highlighting state if needed
+     * pack the collected attributes into the line, keep the capacity for the next line
+     */
+    textLine->setAttributesList(m_lineAttributes);
+    m_lineAttributes.clear();
+
+    /**
+     * update highlighting state if needed, interned states are equal if their ids are
      */
-    if (textLine->highlightingState() != endOfLineState) {
-        textLine->setHighlightingState(endOfLineState);
+    const int endOfLineStateId = states.intern(endOfLineState, initialStateId, textLine->highlightingStateId());
+    if (textLine->highlightingStateId() != endOfLineStateId) {
+        textLine->setHighlightingStateId(endOfLineStateId);
         ctxChanged = true;
     }
 
@@ -248,6 +321,74 @@ void KateHighlighting::doHighlight(const Kate::TextLineData *prevLine,
 
 }
 
+void KateHighlighting::continueHighlight(KateHighlightingStates &states, Kate::TextLineData *textLine, bool &ctxChanged, int budget)
+{
+    // default: no context change
+    ctxChanged = false;
+    if (noHl || !textLine || !textLine->isHighlightingIncomplete()) {
+        return;
+    }
+
+    Q_ASSERT(!m_textLineToHighlight);
+    Q_ASSERT(m_foldingStartToCount.isEmpty());
+
+    /**
+     * the attributes cover the chunks done so far, continue behind them from the stored state
+     */
+    m_textLineToHighlight = textLine;
+    m_lineAttributes = textLine->attributesList();
+    int offset = m_lineAttributes.isEmpty() ? 0 : (m_lineAttributes.back().offset + m_lineAttributes.back().length);
+    const int stateId = textLine->highlightingStateId();
+    const KSyntaxHighlighting::State state = highlightChunks(textLine->string(), offset, states.state(stateId), budget);
+    m_textLineToHighlight = nullptr;
+
+    textLine->setAttributesList(m_lineAttributes);
+    m_lineAttributes.clear();
+    textLine->setHighlightingIncomplete(offset < textLine->length());
+
+    /**
+     * the next line was highlighted with an intermediate state, once done it must be checked again
+     */
+    textLine->setHighlightingStateId(states.intern(state, stateId, stateId));
+    ctxChanged = !textLine->isHighlightingIncomplete();
+
+    if (!m_foldingStartToCount.isEmpty()) {
+        textLine->markAsFoldingStartAttribute();
+        m_foldingStartToCount.clear();
+    }
+}
+
+KSyntaxHighlighting::State KateHighlighting::highlightChunks(const QString &text, int &offset, KSyntaxHighlighting::State state, int budget)
+{
+    QElapsedTimer timer;
+    timer.start();
+    do {
+        const int end = chunkEnd(text, offset);
+        m_chunkOffset = offset;
+        state = highlightLine(text.mid(offset, end - offset), state);
+
+        // the attributes must reach the chunk end, the next chunk continues behind them
+        const int attributesEnd = m_lineAttributes.isEmpty() ? 0 : (m_lineAttributes.back().offset + m_lineAttributes.back().length);
+        if (attributesEnd < end) {
+            m_lineAttributes.append(Kate::TextLineData::Attribute(attributesEnd, end - attributesEnd, 0));
+        }
+        offset = end;
+    } while (offset < text.size() && budget > 0 && !timer.hasExpired(budget));
+    m_chunkOffset = 0;
+    return state;
+}
+
+void KateHighlighting::addEditStatistics(int lines, bool converged)
+{
+    ++m_editStatistics.edits;
+    m_editStatistics.lines += lines;
+    m_editStatistics.maximumLines = qMax(m_editStatistics.maximumLines, lines);
+    if (!converged) {
+        ++m_editStatistics.unconvergedEdits;
+        qCDebug(LOG_KTE) << "highlighting state did not converge after" << lines << "re-highlighted lines for" << iName;
+    }
+}
+
 void KateHighlighting::applyFormat(int offset, int length, const KSyntaxHighlighting::Format &format)
 {
     // WE ATM assume ascending offset order
@@ -260,8 +401,14 @@ void KateHighlighting::applyFormat(int offset, int length, const KSyntaxHighligh
     const auto it = m_formatsIdToIndex.find(format.id());
     Q_ASSERT(it != m_formatsIdToIndex.end());
 
-    // remember highlighting info in our textline
-    m_textLineToHighlight->addAttribute(Kate::TextLineData::Attribute(offset, length, it->second));
+    // remember highlighting info for our textline, continue the previous run if it has the same format
+    offset += m_chunkOffset;
+    if (!m_lineAttributes.isEmpty() && m_lineAttributes.back().attributeValue == it->second
+        && m_lineAttributes.back().offset + m_lineAttributes.back().length == offset) {
+        m_lineAttributes.back().length += length;
+        return;
+    }
+    m_lineAttributes.append(Kate::TextLineData::Attribute(offset, length, it->second));
 }
 
 void KateHighlighting::applyFolding(int offset, int length, KSyntaxHighlighting::FoldingRegion region)
@@ -269,6 +416,7 @@ void KateHighlighting::applyFolding(int offset, int length, KSyntaxHighlighting:
     // WE ATM assume ascending offset order, we add the length to the offset for the folding ends to have ranges spanning the full folding region
     Q_ASSERT(m_textLineToHighlight);
     Q_ASSERT(region.isValid());
+    offset += m_chunkOffset;
     const int foldingValue = (region.type() == KSyntaxHighlighting::FoldingRegion::Begin) ? int(region.id()) : -int(region.id());
     m_textLineToHighlight->addFolding(offset + (region.type() == KSyntaxHighlighting::FoldingRegion::Begin) ? 0 : length, foldingValue);
 
@@ -448,6 +596,15 @@ QString KateHighlighting::nameForAttrib(int attrib) const
     return m_propertiesForFormat.at(sanitizeFormatIndex(attrib))->definition.name() + QLatin1Char(':') + QString(format.isValid() ? format.name() : QLatin1String("Normal"));
 }
 
+QString KateHighlighting::definitionVersions() const
+{
+    QStringList versions;
+    for (const auto &properties : m_properties) {
+        versions.append(properties.definition.name() + QLatin1Char(' ') + QString::number(properties.definition.version()));
+    }
+    return versions.join(QLatin1Char(','));
+}
+
 bool KateHighlighting::isInWord(QChar c, int attrib) const
 {
     return !m_propertiesForFormat.at(sanitizeFormatIndex(attrib))->definition.isWordDelimiter(c)
@@ -636,8 +793,8 @@ int KateHighlighting::attributeForLocation(KTextEditor::DocumentPrivate* doc, co
     if (cursor.column() < tl->length()) {
         return sanitizeFormatIndex(tl->attribute(cursor.column()));
     } else if (cursor.column() >= tl->length()) {
-        if (!tl->attributesList().isEmpty()) {
-            return sanitizeFormatIndex(tl->attributesList().back().attributeValue);
+        if (tl->hasAttributes()) {
+            return sanitizeFormatIndex(tl->lastAttribute());
         }
     }
     return 0;
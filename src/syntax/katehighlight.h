@@ -26,8 +26,10 @@
 #include <KSyntaxHighlighting/Definition>
 #include <KSyntaxHighlighting/FoldingRegion>
 #include <KSyntaxHighlighting/Format>
+#include <KSyntaxHighlighting/State>
 
 #include "katetextline.h"
+#include "katehighlightingstates.h"
 #include "kateextendedattribute.h"
 #include "katesyntaxmanager.h"
 #include "spellcheck/prefixstore.h"
@@ -95,17 +97,38 @@ public:
     /**
      * Parse the text and fill in the context array and folding list array
      *
+     * @param states state table of the buffer the lines belong to, the line states are ids in it
      * @param prevLine The previous line, the context array is picked up from that if present.
      * @param textLine The text line to parse
      * @param nextLine The next line, to check if indentation changed for indentation based folding.
      * @param ctxChanged will be set to reflect if the context changed
      * @param tabWidth tab width for indentation based folding, if wanted, else 0
      */
-    void doHighlight(const Kate::TextLineData *prevLine,
+    void doHighlight(KateHighlightingStates &states,
+                     const Kate::TextLineData *prevLine,
                      Kate::TextLineData *textLine,
                      const Kate::TextLineData *nextLine,
                      bool &ctxChanged,
                      int tabWidth = 0);
+    /**
+     * Continue the highlighting of a line that ran out of its time budget in doHighlight().
+     * Highlights further chunks of the line, starting at the state stored in the line.
+     * @param states state table of the buffer the line belongs to
+     * @param textLine line with isHighlightingIncomplete() set
+     * @param ctxChanged set if the line got completed, the next line needs to be checked then
+     * @param budget time in milliseconds to spend at most, at least one chunk is done
+     */
+    void continueHighlight(KateHighlightingStates &states, Kate::TextLineData *textLine, bool &ctxChanged, int budget);
+
+    /**
+     * Number of lines that hit the time budget in doHighlight() and were left incomplete.
+     * @return lines over budget
+     */
+    qint64 linesOverBudget() const
+    {
+        return m_linesOverBudget;
+    }
+
     /**
      * Saves the attribute definitions to the config file.
      *
@@ -194,6 +217,13 @@ public:
      */
     QString nameForAttrib(int attrib) const;
 
+    /**
+     * Name and version of the definition and all included ones.
+     * Changes if any of the definitions changes, e.g. to key cached highlighting results.
+     * @return versions of all used definitions
+     */
+    QString definitionVersions() const;
+
     /**
      * Get attribute for the given cursor position.
      * @param doc document to use
@@ -202,6 +232,47 @@ public:
      */
     int attributeForLocation(KTextEditor::DocumentPrivate* doc, const KTextEditor::Cursor& cursor);
 
+    /**
+     * Re-highlighting done for edits with this highlighting, shared by all documents using it.
+     */
+    struct EditStatistics {
+        /**
+         * number of edits that re-highlighted lines
+         */
+        qint64 edits = 0;
+
+        /**
+         * lines re-highlighted for all these edits
+         */
+        qint64 lines = 0;
+
+        /**
+         * most lines re-highlighted for one edit
+         */
+        int maximumLines = 0;
+
+        /**
+         * edits that stopped before the highlighting state converged again
+         */
+        qint64 unconvergedEdits = 0;
+    };
+
+    /**
+     * Remember the lines re-highlighted for one edit.
+     * @param lines number of re-highlighted lines
+     * @param converged did the state converge, allowing to keep the highlighting of the following lines
+     */
+    void addEditStatistics(int lines, bool converged);
+
+    /**
+     * Re-highlighting statistics of the edits so far.
+     * @return edit statistics
+     */
+    const EditStatistics &editStatistics() const
+    {
+        return m_editStatistics;
+    }
+
     /**
      * Get all keywords valid for the given cursor position.
      * @param doc document to use
@@ -267,6 +338,17 @@ private:
 
     int sanitizeFormatIndex(int attrib) const;
 
+    /**
+     * Highlight the text in chunks, starting at the given offset, until done or the budget is used up.
+     * Each chunk is highlighted like a line of its own, attributes are collected in m_lineAttributes.
+     * @param text text of the line
+     * @param offset start of the first chunk, moved behind the last highlighted one
+     * @param state state to start with
+     * @param budget time in milliseconds to spend at most, at least one chunk is done, 0 for just one chunk
+     * @return state after the last highlighted chunk
+     */
+    KSyntaxHighlighting::State highlightChunks(const QString &text, int &offset, KSyntaxHighlighting::State state, int budget);
+
 private:
     QStringList embeddedHighlightingModes;
 
@@ -338,11 +420,31 @@ public:
      */
     std::unordered_map<quint16, short> m_formatsIdToIndex;
 
+    /**
+     * Re-highlighting statistics of edits
+     */
+    EditStatistics m_editStatistics;
+
     /**
      * textline to do updates on during doHighlight
      */
     Kate::TextLineData *m_textLineToHighlight = nullptr;
 
+    /**
+     * attributes collected for m_textLineToHighlight during doHighlight, packed into the line at the end
+     */
+    QVector<Kate::TextLineData::Attribute> m_lineAttributes;
+
+    /**
+     * offset of the chunk highlighted in highlightChunks(), added to the offsets of formats and foldings
+     */
+    int m_chunkOffset = 0;
+
+    /**
+     * lines left incomplete by doHighlight()
+     */
+    qint64 m_linesOverBudget = 0;
+
     /**
      * check if the folding begin/ends are balanced!
      * updated during doHighlight
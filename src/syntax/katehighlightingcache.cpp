@@ -0,0 +1,212 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katehighlightingcache.h"
+#include "katebuffer.h"
+#include "katehighlight.h"
+#include "katepartdebug.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextCodec>
+
+/**
+ * Magic number and version of the cache files, bump the version on format changes
+ */
+static const quint32 KATE_HL_CACHE_MAGIC = 0x4b484c43;
+static const quint32 KATE_HL_CACHE_VERSION = 1;
+
+/**
+ * Maximal total size of the cache files in one directory
+ */
+static const qint64 KATE_HL_CACHE_MAX_SIZE = 256 * 1024 * 1024;
+
+/**
+ * Cache files not used for this many days are removed
+ */
+static const int KATE_HL_CACHE_MAX_AGE_DAYS = 30;
+
+QString KateHighlightingCache::key(KateBuffer &buffer)
+{
+    /**
+     * we need the digest of the file and a real highlighting
+     */
+    if (buffer.digest().isEmpty() || !buffer.highlight() || buffer.highlight()->noHighlighting()) {
+        return QString();
+    }
+
+    /**
+     * same bytes decoded with another codec are other lines
+     */
+    const QString codec = buffer.textCodec() ? QString::fromLatin1(buffer.textCodec()->name()) : QString();
+    return QStringLiteral("%1;%2;%3;%4").arg(QString::fromLatin1(buffer.digest().toHex()), codec, buffer.highlight()->definitionVersions(), QString::number(buffer.lines()));
+}
+
+QString KateHighlightingCache::fileName(const QString &directory, const QString &key)
+{
+    return QDir(directory).filePath(QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex()) + QStringLiteral(".hlcache"));
+}
+
+bool KateHighlightingCache::load(const QString &directory, KateBuffer &buffer)
+{
+    const QString cacheKey = key(buffer);
+    if (directory.isEmpty() || cacheKey.isEmpty()) {
+        return false;
+    }
+
+    QFile file(fileName(directory, cacheKey));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = qUncompress(file.readAll());
+    QDataStream stream(data);
+
+    /**
+     * header must match, the key guards against hash collisions
+     */
+    quint32 magic = 0, version = 0;
+    QString storedKey;
+    qint32 lines = 0;
+    stream >> magic >> version >> storedKey >> lines;
+    if (stream.status() != QDataStream::Ok || magic != KATE_HL_CACHE_MAGIC || version != KATE_HL_CACHE_VERSION || storedKey != cacheKey || lines != buffer.lines()) {
+        return false;
+    }
+
+    /**
+     * apply attributes line by line, each line length must match
+     */
+    int line = 0;
+    QVector<Kate::TextLineData::Attribute> lineAttributes;
+    for (; line < lines; ++line) {
+        qint32 length = 0, attributes = 0;
+        stream >> length >> attributes;
+
+        Kate::TextLineData *textLine = buffer.plainLineData(line);
+        if (stream.status() != QDataStream::Ok || length != textLine->length() || attributes < 0) {
+            break;
+        }
+
+        textLine->clearAttributesAndFoldings();
+        lineAttributes.clear();
+        for (qint32 i = 0; i < attributes; ++i) {
+            qint32 offset = 0, attributeLength = 0;
+            qint16 attributeValue = 0;
+            stream >> offset >> attributeLength >> attributeValue;
+            lineAttributes.append(Kate::TextLineData::Attribute(offset, attributeLength, attributeValue));
+        }
+        textLine->setAttributesList(lineAttributes);
+
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+    }
+
+    /**
+     * broken cache: back to plain lines
+     */
+    if (line < lines) {
+        qCWarning(LOG_KTE) << "ignoring broken highlighting cache" << file.fileName();
+        for (int i = 0; i <= line && i < lines; ++i) {
+            buffer.plainLineData(i)->clearAttributesAndFoldings();
+        }
+        return false;
+    }
+
+    /**
+     * remember the use, eviction drops the least recently used files
+     */
+    file.close();
+    if (!file.open(QIODevice::ReadWrite) || !file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime)) {
+        qCDebug(LOG_KTE) << "can't update modification time of highlighting cache" << file.fileName();
+    }
+
+    return true;
+}
+
+bool KateHighlightingCache::save(const QString &directory, KateBuffer &buffer)
+{
+    const QString cacheKey = key(buffer);
+    if (directory.isEmpty() || cacheKey.isEmpty() || !QDir().mkpath(directory)) {
+        return false;
+    }
+
+    /**
+     * unchanged files are only written once
+     */
+    const QString cacheFileName = fileName(directory, cacheKey);
+    if (QFile::exists(cacheFileName)) {
+        return true;
+    }
+
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << KATE_HL_CACHE_MAGIC << KATE_HL_CACHE_VERSION << cacheKey << qint32(buffer.lines());
+        for (int line = 0; line < buffer.lines(); ++line) {
+            const Kate::TextLineData *textLine = buffer.plainLineData(line);
+            const QVector<Kate::TextLineData::Attribute> attributes = textLine->attributesList();
+            stream << qint32(textLine->length()) << qint32(attributes.size());
+            for (const Kate::TextLineData::Attribute &attribute : attributes) {
+                stream << qint32(attribute.offset) << qint32(attribute.length) << qint16(attribute.attributeValue);
+            }
+        }
+    }
+
+    /**
+     * write atomically, concurrent instances might read the file
+     */
+    QSaveFile file(cacheFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    file.write(qCompress(data, 1));
+    if (!file.commit()) {
+        return false;
+    }
+
+    evict(directory);
+    return true;
+}
+
+void KateHighlightingCache::evict(const QString &directory)
+{
+    /**
+     * newest first, our file just written is kept
+     */
+    const QFileInfoList files = QDir(directory).entryInfoList(QStringList(QStringLiteral("*.hlcache")), QDir::Files, QDir::Time);
+    const QDateTime oldest = QDateTime::currentDateTime().addDays(-KATE_HL_CACHE_MAX_AGE_DAYS);
+    qint64 size = 0;
+    for (int i = 0; i < files.size(); ++i) {
+        const QFileInfo &info = files.at(i);
+        size += info.size();
+        if (i > 0 && (size > KATE_HL_CACHE_MAX_SIZE || info.lastModified() < oldest)) {
+            size -= info.size();
+            if (!QFile::remove(info.filePath())) {
+                qCDebug(LOG_KTE) << "can't remove highlighting cache" << info.filePath();
+            }
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_HIGHLIGHTINGCACHE_H
+#define KATE_HIGHLIGHTINGCACHE_H
+
+#include <QString>
+
+class KateBuffer;
+
+/**
+ * On disk cache of highlighting results.
+ *
+ * Stores the attributes of all lines of a buffer, keyed by the digest of the file,
+ * its encoding and the name and version of all used syntax definitions.
+ * Reopening an unchanged file can then show the highlighted text without running the highlighter.
+ *
+ * Folding markers and highlighting states are not cached: folding region ids are assigned
+ * at runtime and states can't be serialized, both are computed by the real highlighting later on.
+ *
+ * Cache files not used for some time are removed and the total size of the directory is bounded,
+ * dropping the least recently used files first.
+ */
+class KateHighlightingCache
+{
+public:
+    /**
+     * Apply the cached attributes to the lines of the buffer, if a matching cache file exists.
+     * @param directory cache directory
+     * @param buffer freshly loaded buffer with its highlighting already set
+     * @return true if all lines got their cached attributes
+     */
+    static bool load(const QString &directory, KateBuffer &buffer);
+
+    /**
+     * Store the attributes of the lines of the buffer.
+     * The buffer must be completely highlighted and unmodified since it was loaded or saved.
+     * @param directory cache directory, created if needed
+     * @param buffer buffer to cache the attributes of
+     * @return success
+     */
+    static bool save(const QString &directory, KateBuffer &buffer);
+
+private:
+    /**
+     * Key identifying content and highlighting of the buffer.
+     * @param buffer buffer to compute the key for
+     * @return key, empty if the buffer can't be cached
+     */
+    static QString key(KateBuffer &buffer);
+
+    /**
+     * Cache file for the given key.
+     * @param directory cache directory
+     * @param key key of the buffer
+     * @return file name
+     */
+    static QString fileName(const QString &directory, const QString &key);
+
+    /**
+     * Remove cache files exceeding the age limit, then the least recently used ones
+     * until the size limit is met.
+     * @param directory cache directory
+     */
+    static void evict(const QString &directory);
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#include "katehighlightingstates.h"
+
+/**
+ * Maximal number of interned states, bounds the search in intern()
+ * only distinct context stacks end up in the table, most highlightings need a few dozens
+ */
+static const int KATE_HL_MAX_STATES = 4096;
+
+int KateHighlightingStates::intern(const KSyntaxHighlighting::State &state, int hint1, int hint2)
+{
+    /**
+     * most lines don't change the state or reproduce the one they had before
+     */
+    if (this->state(hint1) == state) {
+        return (hint1 > 0 && hint1 < int(m_states.size())) ? hint1 : 0;
+    }
+    if (hint2 != hint1 && hint2 > 0 && hint2 < int(m_states.size()) && m_states[hint2] == state) {
+        return hint2;
+    }
+
+    /**
+     * states can't be hashed, search the table, recent states first
+     */
+    for (int id = int(m_states.size()) - 1; id >= 0; --id) {
+        if (m_states[id] == state) {
+            return id;
+        }
+    }
+
+    /**
+     * full table: start again, the caller detects this by the changed generation
+     */
+    if (int(m_states.size()) >= KATE_HL_MAX_STATES) {
+        clear();
+    }
+
+    m_states.push_back(state);
+    return int(m_states.size()) - 1;
+}
+
+void KateHighlightingStates::clear()
+{
+    m_states.resize(1);
+    ++m_generation;
+}
@@ -0,0 +1,96 @@
+/*  This file is part of the Kate project.
+ *
+ *  Copyright (C) 2019 Christoph Cullmann <cullmann@kde.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Library General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Library General Public License
+ *  along with this library; see the file COPYING.LIB.  If not, write to
+ *  the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KATE_HIGHLIGHTINGSTATES_H
+#define KATE_HIGHLIGHTINGSTATES_H
+
+#include <KSyntaxHighlighting/State>
+
+#include <vector>
+
+/**
+ * Interned highlighting states of one buffer, lines only store the index,
+ * see Kate::TextLineData::highlightingStateId().
+ * Index 0 is the initial state, equal states have equal indices.
+ *
+ * KSyntaxHighlighting::State can't be hashed, interning searches the table.
+ * Therefore the table is bounded: once full, it starts again with only the initial state.
+ * Each restart changes generation(), ids stored in lines before are stale then.
+ */
+class KateHighlightingStates
+{
+public:
+    /**
+     * Highlighting state for the given id.
+     * Unknown ids, e.g. stale ones, give the initial state.
+     * @param id state id
+     * @return interned state
+     */
+    const KSyntaxHighlighting::State &state(int id) const
+    {
+        return (id > 0 && id < int(m_states.size())) ? m_states[id] : m_states[0];
+    }
+
+    /**
+     * Number of distinct highlighting states in the table.
+     * @return size of the state table
+     */
+    int count() const
+    {
+        return int(m_states.size());
+    }
+
+    /**
+     * Generation of the table, changed on each clear() and each restart of a full table.
+     * @return generation
+     */
+    int generation() const
+    {
+        return m_generation;
+    }
+
+    /**
+     * Intern the given highlighting state.
+     * The hints are compared first, the state after a line mostly equals the one before or the previous result.
+     * @param state state to intern
+     * @param hint1 first state id to compare with
+     * @param hint2 second state id to compare with
+     * @return id of the state
+     */
+    int intern(const KSyntaxHighlighting::State &state, int hint1, int hint2);
+
+    /**
+     * Start again with only the initial state, all ids but 0 get stale.
+     */
+    void clear();
+
+private:
+    /**
+     * interned states, index 0 is the initial state
+     */
+    std::vector<KSyntaxHighlighting::State> m_states = std::vector<KSyntaxHighlighting::State>(1);
+
+    /**
+     * generation, see generation()
+     */
+    int m_generation = 0;
+};
+
+#endif
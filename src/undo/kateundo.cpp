@@ -401,6 +401,15 @@ KTextEditor::Document *KateUndoGroup::document()
     return m_manager->document();
 }
 
+qint64 KateUndoGroup::memoryUsage() const
+{
+    qint64 usage = sizeof(*this) + m_items.size() * sizeof(KateUndo *);
+    for (const KateUndo *item : m_items) {
+        usage += item->memoryUsage();
+    }
+    return usage;
+}
+
 KateUndo::UndoType KateUndoGroup::singleType() const
 {
     KateUndo::UndoType ret = KateUndo::editInvalid;
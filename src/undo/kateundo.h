@@ -102,6 +102,12 @@ public:
      */
     virtual KateUndo::UndoType type() const = 0;
 
+    /**
+     * memory used by this item, including the stored text
+     * @return memory usage in bytes
+     */
+    virtual qint64 memoryUsage() const = 0;
+
 protected:
     /**
      * Return the document the undo item belongs to.
@@ -194,6 +200,14 @@ public:
         return KateUndo::editInsertText;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this) + m_text.capacity() * sizeof(QChar);
+    }
+
 protected:
     inline int len() const
     {
@@ -243,6 +257,14 @@ public:
         return KateUndo::editRemoveText;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this) + m_text.capacity() * sizeof(QChar);
+    }
+
 protected:
     inline int len() const
     {
@@ -286,6 +308,14 @@ public:
         return KateUndo::editMarkLineAutoWrapped;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this);
+    }
+
 private:
     const int m_line;
     const bool m_autowrapped;
@@ -314,6 +344,14 @@ public:
         return KateUndo::editWrapLine;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this);
+    }
+
 protected:
     inline int line() const
     {
@@ -350,6 +388,14 @@ public:
         return KateUndo::editUnWrapLine;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this);
+    }
+
 protected:
     inline int line() const
     {
@@ -386,6 +432,14 @@ public:
         return KateUndo::editInsertLine;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this) + m_text.capacity() * sizeof(QChar);
+    }
+
 protected:
     inline int line() const
     {
@@ -420,6 +474,14 @@ public:
         return KateUndo::editRemoveLine;
     }
 
+    /**
+     * @copydoc KateUndo::memoryUsage()
+     */
+    qint64 memoryUsage() const override
+    {
+        return sizeof(*this) + m_text.capacity() * sizeof(QChar);
+    }
+
 protected:
     inline int line() const
     {
@@ -485,6 +547,12 @@ public:
         return m_items.isEmpty();
     }
 
+    /**
+     * memory used by this group and its items
+     * @return memory usage in bytes
+     */
+    qint64 memoryUsage() const;
+
     /**
      * Change all LineSaved flags to LineModified of the line modification system.
      */
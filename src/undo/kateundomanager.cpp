@@ -35,6 +35,11 @@ KateUndoManager::KateUndoManager(KTextEditor::DocumentPrivate *doc)
     connect(this, SIGNAL(redoEnd(KTextEditor::Document*)), this, SIGNAL(undoChanged()));
 
     connect(doc, SIGNAL(viewCreated(KTextEditor::Document*,KTextEditor::View*)), SLOT(viewCreated(KTextEditor::Document*,KTextEditor::View*)));
+
+    // views might exist already, if we are created on leaving the viewer mode for huge files
+    foreach (KTextEditor::View *view, doc->views()) {
+        viewCreated(doc, view);
+    }
 }
 
 KateUndoManager::~KateUndoManager()
@@ -236,6 +241,18 @@ uint KateUndoManager::undoCount() const
     return undoItems.count();
 }
 
+qint64 KateUndoManager::memoryUsage() const
+{
+    qint64 usage = sizeof(*this);
+    for (const KateUndoGroup *group : undoItems) {
+        usage += group->memoryUsage();
+    }
+    for (const KateUndoGroup *group : redoItems) {
+        usage += group->memoryUsage();
+    }
+    return usage;
+}
+
 uint KateUndoManager::redoCount() const
 {
     return redoItems.count();
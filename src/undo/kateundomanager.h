@@ -74,6 +74,13 @@ public:
      */
     uint redoCount() const;
 
+    /**
+     * Returns the memory used by the undo and redo groups, including the stored texts.
+     *
+     * @return memory usage in bytes
+     */
+    qint64 memoryUsage() const;
+
     /**
      * Prevent latest KateUndoGroup from being merged with the next one.
      */
@@ -124,6 +124,11 @@ bool Document::replaceText(const Range &range, const QStringList &text, bool blo
     return success;
 }
 
+bool Document::applyEdits(const QVector<QPair<KTextEditor::Range, QString> > &edits)
+{
+    return d->applyEdits(edits);
+}
+
 bool Document::isEmpty() const
 {
     return documentEnd() == Cursor::start();
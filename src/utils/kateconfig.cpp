@@ -262,6 +262,11 @@ KateGlobalConfig::KateGlobalConfig()
      */
     addConfigEntry(ConfigEntry(EncodingProberType, "Encoding Prober Type", QString(), KEncodingProber::Universal));
     addConfigEntry(ConfigEntry(FallbackEncoding, "Fallback Encoding", QString(), QStringLiteral("ISO 8859-15"), [](const QVariant &value) { return isEncodingOk(value.toString()); }));
+    addConfigEntry(ConfigEntry(HugeFileThreshold, "Huge File Threshold", QString(), 1024, [](const QVariant &value) { return value.toInt() >= 0; }));
+    addConfigEntry(ConfigEntry(BlockCompressionDelay, "Block Compression Delay", QString(), 0, [](const QVariant &value) { return value.toInt() >= 0; }));
+    addConfigEntry(ConfigEntry(HistoryMemoryLimit, "History Memory Limit", QString(), 0, [](const QVariant &value) { return value.toInt() >= 0; }));
+    addConfigEntry(ConfigEntry(HighlightingCacheDirectory, "Highlighting Cache Directory", QString(), QString()));
+    addConfigEntry(ConfigEntry(BackgroundSaveThreshold, "Background Save Threshold", QString(), 100000, [](const QVariant &value) { return value.toInt() >= 0; }));
 
     /**
      * finalize the entries, e.g. hashs them
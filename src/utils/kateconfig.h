@@ -303,7 +303,32 @@ public:
         /**
          * Fallback encoding
          */
-        FallbackEncoding
+        FallbackEncoding,
+
+        /**
+         * Files larger than this (in MiB) are opened in the read-only viewer mode, 0 to disable
+         */
+        HugeFileThreshold,
+
+        /**
+         * Text blocks untouched for this many seconds are compressed in memory, 0 to disable, the default
+         */
+        BlockCompressionDelay,
+
+        /**
+         * Memory limit for the editing history of a document in MiB, 0 to disable, the default
+         */
+        HistoryMemoryLimit,
+
+        /**
+         * Directory to cache the highlighting of large files in, empty to disable
+         */
+        HighlightingCacheDirectory,
+
+        /**
+         * Documents with at least this many lines are saved in the background, 0 to disable
+         */
+        BackgroundSaveThreshold
     };
 
 public:
@@ -348,6 +373,76 @@ public:
         return setValue(FallbackEncoding, encoding);
     }
 
+    /**
+     * Files larger than this are opened in the read-only viewer mode.
+     * @return threshold in MiB, 0 if disabled
+     */
+    int hugeFileThreshold() const
+    {
+        return value(HugeFileThreshold).toInt();
+    }
+
+    bool setHugeFileThreshold(int threshold)
+    {
+        return setValue(HugeFileThreshold, threshold);
+    }
+
+    /**
+     * Text blocks of documents untouched for this time are compressed in memory.
+     * @return delay in seconds, 0 if disabled
+     */
+    int blockCompressionDelay() const
+    {
+        return value(BlockCompressionDelay).toInt();
+    }
+
+    bool setBlockCompressionDelay(int seconds)
+    {
+        return setValue(BlockCompressionDelay, seconds);
+    }
+
+    /**
+     * The editing history kept to transform cursors of old revisions is limited to this size per document.
+     * @return limit in MiB, 0 if unlimited
+     */
+    int historyMemoryLimit() const
+    {
+        return value(HistoryMemoryLimit).toInt();
+    }
+
+    bool setHistoryMemoryLimit(int limit)
+    {
+        return setValue(HistoryMemoryLimit, limit);
+    }
+
+    /**
+     * Highlighting of large files is cached in this directory and reused if they are opened unchanged again.
+     * @return cache directory, empty if disabled
+     */
+    QString highlightingCacheDirectory() const
+    {
+        return value(HighlightingCacheDirectory).toString();
+    }
+
+    bool setHighlightingCacheDirectory(const QString &directory)
+    {
+        return setValue(HighlightingCacheDirectory, directory);
+    }
+
+    /**
+     * Local documents with at least this many lines are saved in the background and stay editable meanwhile.
+     * @return threshold in lines, 0 if disabled
+     */
+    int backgroundSaveThreshold() const
+    {
+        return value(BackgroundSaveThreshold).toInt();
+    }
+
+    bool setBackgroundSaveThreshold(int lines)
+    {
+        return setValue(BackgroundSaveThreshold, lines);
+    }
+
 private:
     static KateGlobalConfig *s_global;
 };
@@ -3828,16 +3828,15 @@ QList<KTextEditor::AttributeBlock> KTextEditor::ViewPrivate::lineAttributes(int
         return attribs;
     }
 
-    const QVector<Kate::TextLineData::Attribute> &intAttrs = kateLine->attributesList();
-    for (int i = 0; i < intAttrs.size(); ++i) {
-        if (intAttrs[i].length > 0 && intAttrs[i].attributeValue > 0) {
+    kateLine->forEachAttribute([this, &attribs](const Kate::TextLineData::Attribute &attribute) {
+        if (attribute.length > 0 && attribute.attributeValue > 0) {
             attribs << KTextEditor::AttributeBlock(
-                        intAttrs.at(i).offset,
-                        intAttrs.at(i).length,
-                        renderer()->attribute(intAttrs.at(i).attributeValue)
+                        attribute.offset,
+                        attribute.length,
+                        renderer()->attribute(attribute.attributeValue)
                     );
         }
-    }
+    });
 
     return attribs;
 }
@@ -597,11 +597,11 @@ void KateScrollBar::updatePixmap()
             QString lineText = m_doc->line(realLineNumber);
 
             if (!simpleMode) {
-                m_doc->buffer().ensureHighlighted(realLineNumber);
+                m_doc->buffer().ensureHighlightedForDisplay(realLineNumber);
             }
             const Kate::TextLine &kateline = m_doc->plainKateTextLine(realLineNumber);
 
-            const QVector<Kate::TextLineData::Attribute> &attributes = kateline->attributesList();
+            const QVector<Kate::TextLineData::Attribute> attributes = kateline->attributesList();
             QVector<QTextLayout::FormatRange> decorations = m_view->renderer()->decorationsForLine(kateline, realLineNumber);
             int attributeIndex = 0;
 
@@ -2146,7 +2146,9 @@ void KateIconBorder::paintBorder(int /*x*/, int y, int /*width*/, int height)
                         anyFolded = true;
                     }
 
-                Kate::TextLine tl = m_doc->kateTextLine(realLine);
+                // far away lines are highlighted in the background, they get tagged once done
+                m_doc->buffer().ensureHighlightedForDisplay(realLine);
+                Kate::TextLine tl = m_doc->plainKateTextLine(realLine);
 
                 if (!startingRanges.isEmpty() || tl->markedAsFoldingStart()) {
                     if (anyFolded) {
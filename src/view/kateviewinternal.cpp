@@ -1731,7 +1731,9 @@ int KateViewInternal::maxLen(int startLine)
 
     int displayLines = (view()->height() / renderer()->lineHeight()) + 1;
 
-    int maxLen = 0;
+    // estimate the width of the longest line of the document from the length index of the buffer,
+    // no layout needed and the range doesn't jump while scrolling, exact for fixed pitch fonts
+    int maxLen = qRound(doc()->buffer().maximumVirtualLineLength(doc()->config()->tabWidth()) * renderer()->spaceWidth());
 
     for (int z = 0; z < displayLines; z++) {
         int virtualLine = startLine + z;
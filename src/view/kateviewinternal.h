@@ -361,7 +361,7 @@ private:
     // They get set in the event of a double click, and is used with mouse move + leftbutton
     KTextEditor::Range m_selectionCached;
 
-    // maximal length of textlines visible from given startLine
+    // maximal length of textlines visible from given startLine, at least the estimated width of the longest line
     int maxLen(int startLine);
 
     // are we allowed to scroll columns?
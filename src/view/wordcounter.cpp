@@ -31,10 +31,12 @@ WordCounter::WordCounter(KTextEditor::ViewPrivate *view)
     , m_charsInSelection(0)
     , m_startRecalculationFrom(0)
     , m_document(view->document())
+    , m_doc(view->doc())
 {
     connect(view->doc(), &KTextEditor::DocumentPrivate::textInserted, this, &WordCounter::textInserted);
     connect(view->doc(), &KTextEditor::DocumentPrivate::textRemoved, this, &WordCounter::textRemoved);
     connect(view->doc(), &KTextEditor::DocumentPrivate::loaded, this, &WordCounter::recalculate);
+    connect(view->doc(), &KTextEditor::DocumentPrivate::hugeFileModeChanged, this, &WordCounter::recalculate);
     connect(view, &KTextEditor::View::selectionChanged, this, &WordCounter::selectionChanged);
 
     m_timer.setInterval(500);
@@ -82,12 +84,25 @@ void WordCounter::textRemoved(KTextEditor::Document *, const KTextEditor::Range
 
 void WordCounter::recalculate(KTextEditor::Document *)
 {
+    // no counting in the read-only viewer mode for huge files
+    if (m_doc->isHugeFileMode()) {
+        m_countByLine.clear();
+        m_timer.stop();
+        m_wordsInDocument = m_wordsInSelection = m_charsInDocument = m_charsInSelection = 0;
+        emit changed(0, 0, 0, 0);
+        return;
+    }
+
     m_countByLine = QVector<int>(m_document->lines(), -1);
     m_timer.start();
 }
 
 void WordCounter::selectionChanged(KTextEditor::View *view)
 {
+    if (m_doc->isHugeFileMode()) {
+        return;
+    }
+
     if (view->selectionRange().isEmpty()) {
         m_wordsInSelection = m_charsInSelection = 0;
         emit changed(m_wordsInDocument, 0, m_charsInDocument, 0);
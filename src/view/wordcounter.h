@@ -58,6 +58,7 @@ private:
     QTimer m_timer;
     int m_startRecalculationFrom;
     KTextEditor::Document *m_document;
+    KTextEditor::DocumentPrivate *m_doc;
 };
 
 #endif
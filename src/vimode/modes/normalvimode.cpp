@@ -92,10 +92,10 @@ NormalViMode::NormalViMode(InputModeManager *viInputModeManager,
     resetParser(); // initialise with start configuration
 
     m_isUndo = false;
-    connect(doc()->undoManager(), SIGNAL(undoStart(KTextEditor::Document*)),
-            this, SLOT(undoBeginning()));
-    connect(doc()->undoManager(), SIGNAL(undoEnd(KTextEditor::Document*)),
-            this, SLOT(undoEnded()));
+    connectUndoManager();
+    // the undo manager is only around outside of the viewer mode for huge files
+    connect(doc(), SIGNAL(hugeFileModeChanged(KTextEditor::DocumentPrivate*)),
+            this, SLOT(connectUndoManager()));
 
     updateYankHighlightAttrib();
     connect(view, SIGNAL(configChanged()),
@@ -4124,6 +4124,18 @@ void NormalViMode::textRemoved(KTextEditor::Document *document, KTextEditor::Ran
     }
 }
 
+void NormalViMode::connectUndoManager()
+{
+    if (!doc()->undoManager()) {
+        return;
+    }
+
+    connect(doc()->undoManager(), SIGNAL(undoStart(KTextEditor::Document*)),
+            this, SLOT(undoBeginning()), Qt::UniqueConnection);
+    connect(doc()->undoManager(), SIGNAL(undoEnd(KTextEditor::Document*)),
+            this, SLOT(undoEnded()), Qt::UniqueConnection);
+}
+
 void NormalViMode::undoBeginning()
 {
     m_isUndo = true;
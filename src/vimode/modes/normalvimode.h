@@ -385,6 +385,7 @@ protected:
 private Q_SLOTS:
     void textInserted(KTextEditor::Document *document, KTextEditor::Range range);
     void textRemoved(KTextEditor::Document *, KTextEditor::Range);
+    void connectUndoManager();
     void undoBeginning();
     void undoEnded();
 